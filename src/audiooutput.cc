@@ -0,0 +1,433 @@
+#include "audiooutput.hh"
+#include "bufferpool.hh"
+#include "logger.hh"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace sdr;
+
+
+/** Maximum RTP payload in bytes, keeps the packets below the MTU. */
+static const size_t rtp_max_payload = 1024;
+
+
+/** Guards the initialization of PortAudio. */
+static std::once_flag portaudio_init;
+
+void
+initPortAudio() {
+  std::call_once(portaudio_init, &PortAudio::init);
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of AudioOutput
+ * ******************************************************************************************** */
+AudioOutput::AudioOutput(const std::string &name, size_t queueSize)
+  : _name(name), _queue(queueSize), _dropped(0), _running(false)
+{
+  // pass...
+}
+
+AudioOutput::~AudioOutput() {
+  stop();
+}
+
+void
+AudioOutput::start() {
+  if (_running) { return; }
+  _running = true;
+  _thread = std::thread(&AudioOutput::_run, this);
+}
+
+void
+AudioOutput::stop() {
+  _running = false;
+  _cond.notify_one();
+  if (_thread.joinable()) { _thread.join(); }
+  // Release the slots still queued
+  AudioSlot *slot;
+  while (_queue.take(&slot, 1)) { slot->users--; }
+}
+
+bool
+AudioOutput::push(AudioSlot *slot) {
+  slot->users++;
+  if (! _queue.put(slot)) {
+    slot->users--; _dropped++;
+    return false;
+  }
+  _cond.notify_one();
+  return true;
+}
+
+void
+AudioOutput::configure(const Config &cfg) {
+  std::lock_guard<std::mutex> guard(_io_lock);
+  _configure(cfg);
+}
+
+void
+AudioOutput::_run() {
+  AudioSlot *slot;
+  while (_running) {
+    if (0 == _queue.take(&slot, 1)) {
+      std::unique_lock<std::mutex> guard(_wait_lock);
+      _cond.wait_for(guard, std::chrono::milliseconds(10));
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> guard(_io_lock);
+      _write(RawBuffer(slot->buffer, 0, slot->bytes));
+    }
+    slot->users--;
+  }
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of PortAudioOutput
+ * ******************************************************************************************** */
+PortAudioOutput::PortAudioOutput()
+  : AudioOutput("portaudio"), _sink(), _probe(0)
+{
+  // pass...
+}
+
+PortAudioOutput::~PortAudioOutput() {
+  stop();
+}
+
+void
+PortAudioOutput::setLatencyProbe(LatencyProbe *probe) {
+  std::lock_guard<std::mutex> guard(_io_lock);
+  // The probe measures outside of the processing thread
+  if (probe) { probe->enableCPUTime(false); }
+  _probe = probe;
+}
+
+void
+PortAudioOutput::_configure(const Config &cfg) {
+  initPortAudio();
+  _sink.config(cfg);
+  if (_probe) { _probe->config(cfg); }
+}
+
+bool
+PortAudioOutput::_write(const RawBuffer &buffer) {
+  // Blocks until the sound card accepted the audio
+  _sink.handleBuffer(buffer, false);
+  // The audio passed the output queue and was accepted by the sound card
+  if (_probe) { _probe->handleBuffer(buffer, false); }
+  return true;
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of UDPOutput
+ * ******************************************************************************************** */
+UDPOutput::UDPOutput(uint16_t port)
+  : AudioOutput("udp"), _port(port), _socket(-1), _channels(1), _sequence(0), _timestamp(0),
+    _ssrc(uint32_t(std::rand()) ^ uint32_t(std::time(0)))
+{
+  _socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (0 > _socket) {
+    LogMessage msg(LOG_WARNING);
+    msg << "UDPOutput: Can not create socket: " << strerror(errno);
+    Logger::get().log(msg);
+    return;
+  }
+  struct sockaddr_in addr; memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(_port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  // Connected UDP socket, send does not need the address
+  if (0 > ::connect(_socket, (struct sockaddr *)&addr, sizeof(addr))) {
+    LogMessage msg(LOG_WARNING);
+    msg << "UDPOutput: Can not connect to port " << _port << ": " << strerror(errno);
+    Logger::get().log(msg);
+    ::close(_socket); _socket = -1;
+  }
+}
+
+UDPOutput::~UDPOutput() {
+  stop();
+  if (0 <= _socket) { ::close(_socket); }
+}
+
+void
+UDPOutput::_configure(const Config &cfg) {
+  _channels = (Config::typeId<int16_t>() == cfg.type()) ? 1 : 2;
+}
+
+bool
+UDPOutput::_write(const RawBuffer &buffer) {
+  if (0 > _socket) { return false; }
+  const int16_t *in = reinterpret_cast<const int16_t *>(buffer.data());
+  size_t N = buffer.bytesLen()/sizeof(int16_t);
+  // Whole frames per packet
+  size_t per_packet = (rtp_max_payload/(2*_channels))*_channels;
+  uint8_t packet[12+rtp_max_payload];
+  for (size_t offset=0; offset<N; offset+=per_packet) {
+    size_t n = std::min(per_packet, N-offset);
+    // RTP header: version 2, payload type 96
+    packet[0] = 0x80; packet[1] = 96;
+    packet[2] = uint8_t(_sequence >> 8); packet[3] = uint8_t(_sequence);
+    for (int i=0; i<4; i++) {
+      packet[4+i] = uint8_t(_timestamp >> (24-8*i));
+      packet[8+i] = uint8_t(_ssrc >> (24-8*i));
+    }
+    // L16 is big endian
+    for (size_t i=0; i<n; i++) {
+      uint16_t v = uint16_t(in[offset+i]);
+      packet[12+2*i] = uint8_t(v >> 8); packet[13+2*i] = uint8_t(v);
+    }
+    // A missing receiver (ECONNREFUSED) is not an error
+    ::send(_socket, packet, 12+2*n, MSG_NOSIGNAL);
+    _sequence++; _timestamp += n/_channels;
+  }
+  return true;
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of PipeOutput
+ * ******************************************************************************************** */
+PipeOutput::PipeOutput(const std::string &path)
+  : AudioOutput("pipe"), _path(path), _fd(-1)
+{
+  // A reader closing the pipe must not terminate the receiver
+  signal(SIGPIPE, SIG_IGN);
+  if ("-" == _path) { _fd = STDOUT_FILENO; return; }
+  struct stat info;
+  if (0 == stat(_path.c_str(), &info)) {
+    // Never write into an existing regular file, _open fails for anything but a pipe
+    if (! S_ISFIFO(info.st_mode)) {
+      LogMessage msg(LOG_WARNING);
+      msg << "PipeOutput: " << _path << " exists and is not a pipe.";
+      Logger::get().log(msg);
+    }
+  } else if (0 != mkfifo(_path.c_str(), 0644)) {
+    LogMessage msg(LOG_WARNING);
+    msg << "PipeOutput: Can not create pipe " << _path << ": " << strerror(errno);
+    Logger::get().log(msg);
+  }
+}
+
+PipeOutput::~PipeOutput() {
+  stop();
+  if ((0 <= _fd) && (STDOUT_FILENO != _fd)) { ::close(_fd); }
+}
+
+void
+PipeOutput::_configure(const Config &cfg) {
+  // Raw audio, nothing to configure
+}
+
+bool
+PipeOutput::_open() {
+  if (0 <= _fd) { return true; }
+  // Fails with ENXIO while there is no reader
+  _fd = ::open(_path.c_str(), O_WRONLY | O_NONBLOCK);
+  if (0 > _fd) { return false; }
+  // The path may have been replaced by another file meanwhile
+  struct stat info;
+  if ((0 != fstat(_fd, &info)) || (! S_ISFIFO(info.st_mode))) {
+    ::close(_fd); _fd = -1;
+    return false;
+  }
+  // Block the writer thread if the reader is slow, the queue of this output absorbs it
+  fcntl(_fd, F_SETFL, fcntl(_fd, F_GETFL) & ~O_NONBLOCK);
+  return true;
+}
+
+bool
+PipeOutput::_write(const RawBuffer &buffer) {
+  // Discard audio while no reader is connected
+  if (! _open()) { return true; }
+  const char *data = buffer.data();
+  size_t len = buffer.bytesLen();
+  while (len) {
+    ssize_t n = ::write(_fd, data, len);
+    if (0 > n) {
+      if (EINTR == errno) { continue; }
+      // Reader is gone, reopen with the next buffer
+      if (STDOUT_FILENO != _fd) { ::close(_fd); _fd = -1; }
+      return false;
+    }
+    data += n; len -= n;
+  }
+  return true;
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of FileOutput
+ * ******************************************************************************************** */
+FileOutput::FileOutput(const std::string &path)
+  : AudioOutput("file"), _path(path), _file(0)
+{
+  _file = std::fopen(_path.c_str(), "ab");
+  if (0 == _file) {
+    LogMessage msg(LOG_WARNING);
+    msg << "FileOutput: Can not open " << _path << ": " << strerror(errno);
+    Logger::get().log(msg);
+  }
+}
+
+FileOutput::~FileOutput() {
+  stop();
+  if (_file) { std::fclose(_file); }
+}
+
+void
+FileOutput::_configure(const Config &cfg) {
+  // Raw audio, nothing to configure
+}
+
+bool
+FileOutput::_write(const RawBuffer &buffer) {
+  if (0 == _file) { return false; }
+  return 1 == std::fwrite(buffer.data(), buffer.bytesLen(), 1, _file);
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of AudioFanOut
+ * ******************************************************************************************** */
+AudioFanOut::AudioFanOut()
+  : SinkBase(), _lock(), _outputs(), _slots(), _slotBytes(0), _next(0), _config(), _dropped(0)
+{
+  _addSlots();
+}
+
+AudioFanOut::~AudioFanOut() {
+  for (std::list<AudioOutput *>::iterator output=_outputs.begin();
+       output!=_outputs.end(); output++) {
+    delete *output;
+  }
+  for (size_t i=0; i<_slots.size(); i++) {
+    BufferPool::get().release(_slots[i]->buffer);
+    delete _slots[i];
+  }
+}
+
+void
+AudioFanOut::addOutput(AudioOutput *output) {
+  removeOutput(output->name());
+  if (_config.hasType() && _config.hasSampleRate() && _config.hasBufferSize()) {
+    output->configure(_config);
+  }
+  output->start();
+  std::lock_guard<std::mutex> guard(_lock);
+  _outputs.push_back(output);
+  _addSlots();
+}
+
+void
+AudioFanOut::removeOutput(const std::string &name) {
+  AudioOutput *removed = 0;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    for (std::list<AudioOutput *>::iterator output=_outputs.begin();
+         output!=_outputs.end(); output++) {
+      if (name == (*output)->name()) { removed = *output; _outputs.erase(output); break; }
+    }
+  }
+  // Join the writer thread outside of the lock, this must not block the processing
+  if (removed) { delete removed; }
+}
+
+bool
+AudioFanOut::hasOutput(const std::string &name) {
+  std::lock_guard<std::mutex> guard(_lock);
+  for (std::list<AudioOutput *>::iterator output=_outputs.begin();
+       output!=_outputs.end(); output++) {
+    if (name == (*output)->name()) { return true; }
+  }
+  return false;
+}
+
+void
+AudioFanOut::config(const Config &src_cfg) {
+  // Requires type, sample rate & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+  if ((Config::typeId<int16_t>() != src_cfg.type()) &&
+      (Config::typeId< std::complex<int16_t> >() != src_cfg.type())) {
+    ConfigError err;
+    err << "Can not configure AudioFanOut: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId<int16_t>() << " or "
+        << Config::typeId< std::complex<int16_t> >();
+    throw err;
+  }
+
+  std::lock_guard<std::mutex> guard(_lock);
+  // Stop all outputs, this releases the slots
+  for (std::list<AudioOutput *>::iterator output=_outputs.begin();
+       output!=_outputs.end(); output++) {
+    (*output)->stop();
+  }
+  _slotBytes = src_cfg.bufferSize()*((Config::typeId<int16_t>() == src_cfg.type()) ? 2 : 4);
+  for (size_t i=0; i<_slots.size(); i++) {
+    BufferPool::get().release(_slots[i]->buffer);
+    _slots[i]->buffer = BufferPool::get().acquire<char>(_slotBytes);
+    _slots[i]->bytes = 0; _slots[i]->users = 0;
+  }
+  _next = 0;
+  _config = src_cfg;
+  for (std::list<AudioOutput *>::iterator output=_outputs.begin();
+       output!=_outputs.end(); output++) {
+    (*output)->configure(src_cfg);
+    (*output)->start();
+  }
+}
+
+void
+AudioFanOut::handleBuffer(const RawBuffer &buffer, bool allow_overwrite) {
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_outputs.empty()) { return; }
+
+  // Find a free slot
+  AudioSlot *slot = 0;
+  size_t N = _slots.size();
+  for (size_t i=0; i<N; i++, _next=(_next+1)%N) {
+    if (0 == _slots[_next]->users) { slot = _slots[_next]; _next = (_next+1)%N; break; }
+  }
+  if ((0 == slot) || slot->buffer.isEmpty()) { _dropped++; return; }
+
+  // The only copy, all outputs share the slot
+  slot->bytes = std::min(buffer.bytesLen(), slot->buffer.bytesLen());
+  memcpy(slot->buffer.data(), buffer.data(), slot->bytes);
+  for (std::list<AudioOutput *>::iterator output=_outputs.begin();
+       output!=_outputs.end(); output++) {
+    (*output)->push(slot);
+  }
+}
+
+void
+AudioFanOut::_addSlots() {
+  // Each output holds at most its queue and the slot it writes, one more slot gets filled
+  size_t N = 1;
+  for (std::list<AudioOutput *>::iterator output=_outputs.begin();
+       output!=_outputs.end(); output++) {
+    N += (*output)->queueSize()+1;
+  }
+  while (_slots.size() < N) {
+    AudioSlot *slot = new AudioSlot();
+    if (_slotBytes) { slot->buffer = BufferPool::get().acquire<char>(_slotBytes); }
+    slot->bytes = 0; slot->users = 0;
+    _slots.push_back(slot);
+  }
+}
@@ -0,0 +1,231 @@
+#ifndef __SDR_RX_AUDIOOUTPUT_HH__
+#define __SDR_RX_AUDIOOUTPUT_HH__
+
+#include "node.hh"
+#include "portaudio.hh"
+#include "lockfreering.hh"
+#include "latency.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+
+/** A buffer of audio shared by all outputs of a @c AudioFanOut. The content is immutable while
+ * any output uses the slot. */
+typedef struct {
+  /** The storage obtained from the @c BufferPool. */
+  sdr::RawBuffer buffer;
+  /** Number of valid bytes. */
+  size_t bytes;
+  /** Number of outputs still using the slot. */
+  std::atomic<int> users;
+} AudioSlot;
+
+
+/** Base class of all audio outputs of a @c AudioFanOut.
+ *
+ * Each output has its own bounded queue of shared slots and its own writer thread. If the queue
+ * of an output is full, the output is too slow and the slot is dropped for this output only.
+ * Hence, a slow or blocking output never delays the other outputs or the processing. */
+class AudioOutput
+{
+public:
+  /** Constructor.
+   * @param name Specifies the name of the output.
+   * @param queueSize Specifies the number of slots the queue can hold. */
+  AudioOutput(const std::string &name, size_t queueSize=16);
+  /** Destructor. Derived classes must call @c stop in their destructor. */
+  virtual ~AudioOutput();
+
+  /** Returns the name of the output. */
+  inline const std::string &name() const { return _name; }
+  /** Returns the number of buffers dropped by this output. */
+  inline size_t droppedBuffers() const { return _dropped; }
+  /** Returns the number of slots the queue can hold. */
+  inline size_t queueSize() const { return _queue.capacity(); }
+
+  /** Starts the writer thread. */
+  void start();
+  /** Stops the writer thread, releases all queued slots. */
+  void stop();
+  /** Passes a slot to the output (processing thread). Returns @c false and counts the buffer as
+   * dropped if the queue is full. */
+  bool push(AudioSlot *slot);
+  /** (Re-) Configures the output for the given audio format. */
+  void configure(const sdr::Config &cfg);
+
+protected:
+  /** The writer loop. */
+  void _run();
+  /** Implements the configuration, called with the I/O lock held. */
+  virtual void _configure(const sdr::Config &cfg) = 0;
+  /** Writes the given buffer, called with the I/O lock held. Returns @c false on error. */
+  virtual bool _write(const sdr::RawBuffer &buffer) = 0;
+
+protected:
+  std::string _name;
+  /** The queue of slots. */
+  LockFreeRing<AudioSlot *> _queue;
+  std::atomic<size_t> _dropped;
+  std::atomic<bool> _running;
+  /** Wakes the writer thread. */
+  std::mutex _wait_lock;
+  std::condition_variable _cond;
+  /** Serializes writing and configuration. */
+  std::mutex _io_lock;
+  std::thread _thread;
+};
+
+
+/** Initializes PortAudio once, on the first use by a PortAudio source or output. Later calls
+ * return immediately. */
+void initPortAudio();
+
+
+/** Plays the audio on the default sound card, the blocking writes happen in the writer
+ * thread. PortAudio gets initialized once the output is configured. */
+class PortAudioOutput: public AudioOutput
+{
+public:
+  PortAudioOutput();
+  virtual ~PortAudioOutput();
+
+  /** Sets the latency probe receiving the buffers once they were written to the sound card,
+   * the probe gets called from the writer thread. */
+  void setLatencyProbe(LatencyProbe *probe);
+
+protected:
+  virtual void _configure(const sdr::Config &cfg);
+  virtual bool _write(const sdr::RawBuffer &buffer);
+
+protected:
+  sdr::PortSink _sink;
+  /** Latency probe or 0. */
+  LatencyProbe *_probe;
+};
+
+
+/** Streams the audio as RTP (L16, dynamic payload type 96) over UDP to localhost. */
+class UDPOutput: public AudioOutput
+{
+public:
+  /** Constructor.
+   * @param port Specifies the destination port on localhost. */
+  UDPOutput(uint16_t port);
+  virtual ~UDPOutput();
+
+  inline uint16_t port() const { return _port; }
+
+protected:
+  virtual void _configure(const sdr::Config &cfg);
+  virtual bool _write(const sdr::RawBuffer &buffer);
+
+protected:
+  uint16_t _port;
+  int _socket;
+  size_t _channels;
+  /** RTP state. */
+  uint16_t _sequence;
+  uint32_t _timestamp, _ssrc;
+};
+
+
+/** Writes the raw audio (signed 16 bit, little endian) into a named pipe or to stdout ("-").
+ * The pipe is created if needed, any other existing file is refused. While no reader is
+ * connected, the audio is discarded. */
+class PipeOutput: public AudioOutput
+{
+public:
+  PipeOutput(const std::string &path);
+  virtual ~PipeOutput();
+
+  inline const std::string &path() const { return _path; }
+
+protected:
+  virtual void _configure(const sdr::Config &cfg);
+  virtual bool _write(const sdr::RawBuffer &buffer);
+  /** Tries to open the pipe without blocking. */
+  bool _open();
+
+protected:
+  std::string _path;
+  int _fd;
+};
+
+
+/** Appends the raw audio (signed 16 bit, little endian) to a file. */
+class FileOutput: public AudioOutput
+{
+public:
+  FileOutput(const std::string &path);
+  virtual ~FileOutput();
+
+  inline const std::string &path() const { return _path; }
+
+protected:
+  virtual void _configure(const sdr::Config &cfg);
+  virtual bool _write(const sdr::RawBuffer &buffer);
+
+protected:
+  std::string _path;
+  std::FILE *_file;
+};
+
+
+/** Passes the audio to any number of outputs without copying it per output.
+ *
+ * Each received buffer is copied once into one of a set of slots, whose storage is obtained from
+ * the @c BufferPool in @c config. The slot is then passed by reference to the queue of every
+ * output. A slot counts its users atomically and gets reused once all outputs are done with it;
+ * the reference counting of @c sdr::RawBuffer is not used here, as it is not thread safe. Each
+ * output holds at most its queue and the slot it writes, hence the set grows with the outputs to
+ * their sum plus one slot. Thus a slot is free even if all outputs stall and a stalled output
+ * only drops the buffers of its own queue. Accepts mono (@c int16_t) and stereo
+ * (@c std::complex<int16_t>) audio. */
+class AudioFanOut: public sdr::SinkBase
+{
+public:
+  /** Constructor. */
+  AudioFanOut();
+  /** Destructor, deletes all outputs. */
+  virtual ~AudioFanOut();
+
+  /** Adds an output and starts it, the fan-out takes ownership. An output with the same name
+   * gets replaced. */
+  void addOutput(AudioOutput *output);
+  /** Stops and deletes the named output. */
+  void removeOutput(const std::string &name);
+  /** Returns @c true if the named output exists. */
+  bool hasOutput(const std::string &name);
+
+  /** Returns the number of buffers dropped, as no slot was free. */
+  inline size_t droppedBuffers() const { return _dropped; }
+
+  virtual void config(const sdr::Config &src_cfg);
+  virtual void handleBuffer(const sdr::RawBuffer &buffer, bool allow_overwrite);
+
+protected:
+  /** Adds slots until there are enough for all outputs, the lock must be held. */
+  void _addSlots();
+
+protected:
+  /** Guards the list of outputs and the slots. */
+  std::mutex _lock;
+  std::list<AudioOutput *> _outputs;
+  /** The shared slots, their size in bytes and the next one to use. Slots are never deleted
+   * while the outputs run, as their queues refer to them. */
+  std::vector<AudioSlot *> _slots;
+  size_t _slotBytes, _next;
+  /** The current configuration. */
+  sdr::Config _config;
+  std::atomic<size_t> _dropped;
+};
+
+#endif // __SDR_RX_AUDIOOUTPUT_HH__
@@ -1,43 +1,182 @@
 #include "audiopostproc.hh"
+#include "configuration.hh"
+#include "bufferpool.hh"
 #include <QLineEdit>
 #include <QDoubleValidator>
 #include <QCheckBox>
 #include <QFormLayout>
+#include <QDateTime>
+#include <QDir>
 
 using namespace sdr;
 
 AudioPostProc::AudioPostProc(QObject *parent)
-  : QObject(parent), Sink<int16_t>()
+  : QObject(parent), SinkBase(), _stereo(false), _downmix()
 {
   // Assemble processing chain
   _sub_sample = new SubSample<int16_t>(16000.0);
   _low_pass   = new FIRLowPass<int16_t>(31, 3e3);
   _low_pass->enable(false);
-  _sink       = new PortSink();
+  _noise_reduction = new NoiseReduction(256, 0.5);
+  _outputs    = new AudioFanOut();
   _audio_spectrum = new gui::Spectrum(2, 256, 5, this);
+  _recorder   = new AudioRecorder();
 
   // Connect all
-  _sub_sample->connect(_low_pass, true);
-  _low_pass->connect(_sink);
+  _sub_sample->connect(_noise_reduction, true);
+  _noise_reduction->connect(_low_pass, true);
   _low_pass->connect(_audio_spectrum);
+  // The recorder and the outputs only copy the audio, hence direct connections
+  _low_pass->connect(_recorder, true);
+  _low_pass->connect(_outputs, true);
+
+  // Restore outputs
+  _soundcard = new PortAudioOutput();
+  _outputs->addOutput(_soundcard);
+  Configuration &conf = Configuration::get();
+  if (conf.value("AudioOutput/udp", false).toBool()) { enableUDPOutput(true); }
+  if (conf.value("AudioOutput/pipe", false).toBool()) { enablePipeOutput(true); }
+  if (conf.value("AudioOutput/file", false).toBool()) { enableFileOutput(true); }
 }
 
 AudioPostProc::~AudioPostProc() {
+  delete _noise_reduction;
   delete _low_pass;
-  delete _sink;
+  delete _outputs;
+  delete _recorder;
+  BufferPool::get().release(_downmix);
 }
 
 
 void
 AudioPostProc::config(const Config &src_cfg) {
-  // Forward to low pass
+  if (src_cfg.hasType()) { _stereo = (Config::Type_cs16 == src_cfg.type()); }
+  // Stereo audio goes directly to the outputs
+  if (_stereo) {
+    _outputs->config(src_cfg);
+    _recorder->config(src_cfg);
+    // The spectrum shows the mono down-mix
+    if (src_cfg.hasSampleRate() && src_cfg.hasBufferSize()) {
+      BufferPool::get().release(_downmix);
+      _downmix = BufferPool::get().acquire<int16_t>(src_cfg.bufferSize());
+      _audio_spectrum->config(Config(Config::Type_s16, src_cfg.sampleRate(),
+                                     src_cfg.bufferSize(), 1));
+    }
+    return;
+  }
+  // Forward mono audio to low pass
   _sub_sample->config(src_cfg);
 }
 
 void
-AudioPostProc::process(const Buffer<int16_t> &buffer, bool allow_overwrite) {
+AudioPostProc::handleBuffer(const RawBuffer &buffer, bool allow_overwrite) {
+  if (_stereo) {
+    _recorder->handleBuffer(buffer, false);
+    _outputs->handleBuffer(buffer, false);
+    // Skip the spectrum if it still holds the previous down-mix
+    if (_downmix.isUnused()) {
+      const int16_t *in = reinterpret_cast<const int16_t *>(buffer.data());
+      size_t N = std::min(buffer.bytesLen()/(2*sizeof(int16_t)), _downmix.size());
+      for (size_t i=0; i<N; i++) { _downmix[i] = int16_t((int32_t(in[2*i])+in[2*i+1])/2); }
+      _audio_spectrum->handleBuffer(_downmix.head(N), false);
+    }
+    return;
+  }
   // Forward to low pass
-  _sub_sample->process(buffer, allow_overwrite);
+  _sub_sample->handleBuffer(buffer, allow_overwrite);
+}
+
+void
+AudioPostProc::connectLatencyProbe(LatencyProbe *probe) {
+  _soundcard->setLatencyProbe(probe);
+}
+
+bool
+AudioPostProc::startRecording(WavWriter::Encoding encoding) {
+  QString dir = Configuration::get().value("AudioRecorder/directory", QDir::homePath()).toString();
+  QString name = QString("sdr-rx-%1.wav").arg(
+        QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss"));
+  return _recorder->start(QDir(dir).filePath(name).toStdString(), encoding);
+}
+
+void
+AudioPostProc::stopRecording() {
+  _recorder->stop();
+}
+
+bool
+AudioPostProc::udpOutputEnabled() const {
+  return _outputs->hasOutput("udp");
+}
+
+void
+AudioPostProc::enableUDPOutput(bool enable) {
+  Configuration::get().setValue("AudioOutput/udp", enable);
+  if (enable) { _outputs->addOutput(new UDPOutput(udpOutputPort())); }
+  else { _outputs->removeOutput("udp"); }
+}
+
+uint16_t
+AudioPostProc::udpOutputPort() const {
+  return Configuration::get().value("AudioOutput/udpPort", 7355).toUInt();
+}
+
+void
+AudioPostProc::setUDPOutputPort(uint16_t port) {
+  Configuration::get().setValue("AudioOutput/udpPort", port);
+  // Re-create the output for the new port
+  if (udpOutputEnabled()) { _outputs->addOutput(new UDPOutput(port)); }
+}
+
+bool
+AudioPostProc::pipeOutputEnabled() const {
+  return _outputs->hasOutput("pipe");
+}
+
+void
+AudioPostProc::enablePipeOutput(bool enable) {
+  Configuration::get().setValue("AudioOutput/pipe", enable);
+  if (enable) { _outputs->addOutput(new PipeOutput(pipeOutputPath().toStdString())); }
+  else { _outputs->removeOutput("pipe"); }
+}
+
+QString
+AudioPostProc::pipeOutputPath() const {
+  return Configuration::get().value(
+        "AudioOutput/pipePath", QDir::temp().filePath("sdr-rx.pcm")).toString();
+}
+
+void
+AudioPostProc::setPipeOutputPath(const QString &path) {
+  Configuration::get().setValue("AudioOutput/pipePath", path);
+}
+
+bool
+AudioPostProc::fileOutputEnabled() const {
+  return _outputs->hasOutput("file");
+}
+
+void
+AudioPostProc::enableFileOutput(bool enable) {
+  Configuration::get().setValue("AudioOutput/file", enable);
+  if (enable) { _outputs->addOutput(new FileOutput(fileOutputPath().toStdString())); }
+  else { _outputs->removeOutput("file"); }
+}
+
+QString
+AudioPostProc::fileOutputPath() const {
+  return Configuration::get().value(
+        "AudioOutput/filePath", QDir::home().filePath("sdr-rx.raw")).toString();
+}
+
+void
+AudioPostProc::setFileOutputPath(const QString &path) {
+  Configuration::get().setValue("AudioOutput/filePath", path);
+}
+
+bool
+AudioPostProc::isStereo() const {
+  return _stereo;
 }
 
 bool
@@ -57,7 +196,8 @@ AudioPostProc::lowPassFreq() const {
 
 void
 AudioPostProc::setLowPassFreq(double freq) {
-  _low_pass->setFreq(freq);
+  // Avoid redesigning the filter if unchanged
+  if (freq != _low_pass->freq()) { _low_pass->setFreq(freq); }
 }
 
 size_t
@@ -67,7 +207,32 @@ AudioPostProc::lowPassOrder() const {
 
 void
 AudioPostProc::setLowPassOrder(size_t order) {
-  _low_pass->setOrder(order);
+  if (order != _low_pass->order()) { _low_pass->setOrder(order); }
+}
+
+bool
+AudioPostProc::noiseReductionEnabled() const {
+  return _noise_reduction->enabled();
+}
+
+void
+AudioPostProc::enableNoiseReduction(bool enable) {
+  _noise_reduction->enable(enable);
+}
+
+double
+AudioPostProc::noiseReductionStrength() const {
+  return _noise_reduction->strength();
+}
+
+void
+AudioPostProc::setNoiseReductionStrength(double strength) {
+  _noise_reduction->setStrength(strength);
+}
+
+double
+AudioPostProc::noiseReductionLoad() const {
+  return _noise_reduction->cpuLoad();
 }
 
 gui::Spectrum *
@@ -83,8 +248,11 @@ AudioPostProc::spectrum() const {
 AudioPostProcView::AudioPostProcView(AudioPostProc *proc, QWidget *parent)
   : QWidget(parent), _proc(proc)
 {
-  QCheckBox *lp_enable = new QCheckBox("enable");
-  lp_enable->setChecked(proc->lowPassEnabled());
+  _mode = new QLabel("-");
+  _mode->setToolTip("Low pass and noise reduction only apply to mono audio.");
+
+  _lp_enable = new QCheckBox("enable");
+  _lp_enable->setChecked(proc->lowPassEnabled());
 
   _lp_freq = new QLineEdit(QString("%1").arg(proc->lowPassFreq()));
   QDoubleValidator *lpf_val = new QDoubleValidator();
@@ -94,10 +262,38 @@ AudioPostProcView::AudioPostProcView(AudioPostProc *proc, QWidget *parent)
   _lp_order->setRange(0, 1024); _lp_order->setValue(_proc->lowPassOrder());
   _lp_order->setSingleStep(5);
 
-  if (! proc->lowPassEnabled()) {
-    _lp_freq->setEnabled(false);
-    _lp_order->setEnabled(false);
-  }
+  _nr_enable = new QCheckBox("enable");
+  _nr_enable->setChecked(proc->noiseReductionEnabled());
+
+  _nr_strength = new QDoubleSpinBox();
+  _nr_strength->setRange(0, 1); _nr_strength->setSingleStep(0.1);
+  _nr_strength->setValue(proc->noiseReductionStrength());
+
+  _nr_load = new QLabel("-");
+
+  _record = new QCheckBox("record");
+  _record->setChecked(proc->recorder().isRecording());
+  _record_format = new QComboBox();
+  _record_format->addItem("WAV (PCM)", int(WavWriter::PCM16));
+  _record_format->addItem("WAV (IMA ADPCM)", int(WavWriter::IMA_ADPCM));
+  _record_format->setEnabled(! proc->recorder().isRecording());
+  _record_status = new QLabel("-");
+
+  QCheckBox *udp_enable = new QCheckBox("enable");
+  udp_enable->setChecked(proc->udpOutputEnabled());
+  _udp_port = new QSpinBox();
+  _udp_port->setRange(1024, 65535); _udp_port->setValue(proc->udpOutputPort());
+  _udp_port->setEnabled(! proc->udpOutputEnabled());
+  QCheckBox *pipe_enable = new QCheckBox("enable");
+  pipe_enable->setChecked(proc->pipeOutputEnabled());
+  _pipe_path = new QLineEdit(proc->pipeOutputPath());
+  _pipe_path->setToolTip("Named pipe, created if missing, or \"-\" for stdout.");
+  _pipe_path->setEnabled(! proc->pipeOutputEnabled());
+  QCheckBox *file_enable = new QCheckBox("enable");
+  file_enable->setChecked(proc->fileOutputEnabled());
+  _file_path = new QLineEdit(proc->fileOutputPath());
+  _file_path->setEnabled(! proc->fileOutputEnabled());
+  _output_status = new QLabel("-");
 
   // Create spectrum view:
   _spectrum = new gui::SpectrumView(_proc->spectrum());
@@ -105,19 +301,45 @@ AudioPostProcView::AudioPostProcView(AudioPostProc *proc, QWidget *parent)
 
   QObject::connect(_lp_freq, SIGNAL(textEdited(QString)), this, SLOT(onSetLowPassFreq(QString)));
   QObject::connect(_lp_order, SIGNAL(valueChanged(int)), this, SLOT(onSetLowPassOrder(int)));
-  QObject::connect(lp_enable, SIGNAL(toggled(bool)), this, SLOT(onLowPassToggled(bool)));
+  QObject::connect(_lp_enable, SIGNAL(toggled(bool)), this, SLOT(onLowPassToggled(bool)));
+  QObject::connect(_nr_enable, SIGNAL(toggled(bool)), this, SLOT(onNoiseReductionToggled(bool)));
+  QObject::connect(_nr_strength, SIGNAL(valueChanged(double)),
+                   this, SLOT(onSetNoiseReductionStrength(double)));
+  QObject::connect(_record, SIGNAL(toggled(bool)), this, SLOT(onRecordToggled(bool)));
+  QObject::connect(udp_enable, SIGNAL(toggled(bool)), this, SLOT(onUDPOutputToggled(bool)));
+  QObject::connect(pipe_enable, SIGNAL(toggled(bool)), this, SLOT(onPipeOutputToggled(bool)));
+  QObject::connect(file_enable, SIGNAL(toggled(bool)), this, SLOT(onFileOutputToggled(bool)));
+  QObject::connect(&_load_update, SIGNAL(timeout()), this, SLOT(onUpdateLoad()));
+  _load_update.setInterval(1000);
+  _load_update.setSingleShot(false);
+  _load_update.start();
 
   // Layout
   QVBoxLayout *layout = new QVBoxLayout();
   QFormLayout *table = new QFormLayout();
+  table->addRow("Audio", _mode);
   table->addRow("Low Pass (Hz)", _lp_freq);
   table->addRow("order", _lp_order);
-  table->addWidget(lp_enable);
+  table->addWidget(_lp_enable);
+  table->addRow("Noise red.", _nr_strength);
+  table->addWidget(_nr_enable);
+  table->addRow("NR load", _nr_load);
+  table->addRow("Recording", _record_format);
+  table->addWidget(_record);
+  table->addRow("Recorded", _record_status);
+  table->addRow("UDP port", _udp_port);
+  table->addWidget(udp_enable);
+  table->addRow("Pipe", _pipe_path);
+  table->addWidget(pipe_enable);
+  table->addRow("Raw file", _file_path);
+  table->addWidget(file_enable);
+  table->addRow("Output drops", _output_status);
   layout->addLayout(table, 0);
 
   layout->addWidget(_spectrum, 1);
 
   this->setLayout(layout);
+  _updateMode();
 }
 
 AudioPostProcView::~AudioPostProcView() {
@@ -127,8 +349,7 @@ AudioPostProcView::~AudioPostProcView() {
 void
 AudioPostProcView::onLowPassToggled(bool enable) {
   _proc->enableLowPass(enable);
-  _lp_freq->setEnabled(enable);
-  _lp_order->setEnabled(enable);
+  _updateMode();
 }
 
 void
@@ -144,3 +365,78 @@ AudioPostProcView::onSetLowPassOrder(int value) {
   if (value < 1) { _lp_order->setValue(1); }
   _proc->setLowPassOrder((size_t) value);
 }
+
+void
+AudioPostProcView::onNoiseReductionToggled(bool enable) {
+  _proc->enableNoiseReduction(enable);
+  _updateMode();
+}
+
+void
+AudioPostProcView::onSetNoiseReductionStrength(double value) {
+  _proc->setNoiseReductionStrength(value);
+}
+
+void
+AudioPostProcView::onRecordToggled(bool enable) {
+  if (enable) {
+    WavWriter::Encoding encoding = WavWriter::Encoding(
+          _record_format->itemData(_record_format->currentIndex()).toInt());
+    if (! _proc->startRecording(encoding)) {
+      _record->blockSignals(true); _record->setChecked(false); _record->blockSignals(false);
+      _record_status->setText("Can not create file.");
+      return;
+    }
+  } else {
+    _proc->stopRecording();
+  }
+  _record_format->setEnabled(! enable);
+  onUpdateLoad();
+}
+
+void
+AudioPostProcView::onUDPOutputToggled(bool enable) {
+  // The port is applied when the output gets enabled
+  if (enable) { _proc->setUDPOutputPort(_udp_port->value()); }
+  _proc->enableUDPOutput(enable);
+  _udp_port->setEnabled(! enable);
+}
+
+void
+AudioPostProcView::onPipeOutputToggled(bool enable) {
+  if (enable) { _proc->setPipeOutputPath(_pipe_path->text()); }
+  _proc->enablePipeOutput(enable);
+  _pipe_path->setEnabled(! enable);
+}
+
+void
+AudioPostProcView::onFileOutputToggled(bool enable) {
+  if (enable) { _proc->setFileOutputPath(_file_path->text()); }
+  _proc->enableFileOutput(enable);
+  _file_path->setEnabled(! enable);
+}
+
+void
+AudioPostProcView::onUpdateLoad() {
+  _updateMode();
+  _output_status->setText(QString("%1").arg(_proc->outputs().droppedBuffers()));
+  const AudioRecorder &recorder = _proc->recorder();
+  if (recorder.isRecording()) {
+    _record_status->setText(QString("%1 s, %2 dropped").arg(recorder.duration(), 0, 'f', 0)
+                            .arg(recorder.droppedSamples()));
+    _record_status->setToolTip(QString::fromStdString(recorder.filename()));
+  }
+  if (_proc->isStereo() || (! _proc->noiseReductionEnabled())) { _nr_load->setText("-"); return; }
+  _nr_load->setText(QString("%1 %").arg(100*_proc->noiseReductionLoad(), 0, 'f', 2));
+}
+
+void
+AudioPostProcView::_updateMode() {
+  bool mono = ! _proc->isStereo();
+  _mode->setText(mono ? "mono" : "stereo, filters bypassed");
+  _lp_enable->setEnabled(mono);
+  _lp_freq->setEnabled(mono && _proc->lowPassEnabled());
+  _lp_order->setEnabled(mono && _proc->lowPassEnabled());
+  _nr_enable->setEnabled(mono);
+  _nr_strength->setEnabled(mono && _proc->noiseReductionEnabled());
+}
@@ -5,15 +5,29 @@
 #include "portaudio.hh"
 #include "firfilter.hh"
 #include "gui/gui.hh"
+#include "noisereduction.hh"
+#include "audiorecorder.hh"
+#include "audiooutput.hh"
 
 #include <QObject>
 #include <QWidget>
 #include <QLineEdit>
 #include <QSpinBox>
 #include <QDoubleSpinBox>
+#include <QLabel>
+#include <QTimer>
+#include <QCheckBox>
+#include <QComboBox>
 
+#include <atomic>
 
-class AudioPostProc : public QObject, public sdr::Sink<int16_t>
+
+/** Post processing of the demodulated audio. Accepts mono audio (@c int16_t) and stereo audio
+ * (@c std::complex<int16_t>, left & right channel). The latter is passed directly to the
+ * audio outputs, the sub-sampler, noise reduction and low pass only apply to mono audio. The
+ * audio spectrum shows the mono down-mix of stereo audio. The audio is passed to the sound card and optionally to a UDP port, a named pipe
+ * and a file, see @c AudioFanOut. */
+class AudioPostProc : public QObject, public sdr::SinkBase
 {
   Q_OBJECT
 
@@ -21,9 +35,12 @@ public:
   explicit AudioPostProc(QObject *parent=0);
   virtual ~AudioPostProc();
 
-  /** Implements sdr::Sink<double> interface. */
+  /** Implements sdr::SinkBase interface. */
   virtual void config(const sdr::Config &src_cfg);
-  virtual void process(const sdr::Buffer<int16_t> &buffer, bool allow_overwrite);
+  virtual void handleBuffer(const sdr::RawBuffer &buffer, bool allow_overwrite);
+
+  /** Returns @c true if the current input is a stereo signal, the filters are bypassed then. */
+  bool isStereo() const;
 
   bool lowPassEnabled() const;
   void enableLowPass(bool enable);
@@ -34,13 +51,60 @@ public:
   size_t lowPassOrder() const;
   void setLowPassOrder(size_t order);
 
+  bool noiseReductionEnabled() const;
+  void enableNoiseReduction(bool enable);
+
+  double noiseReductionStrength() const;
+  void setNoiseReductionStrength(double strength);
+
+  /** Returns the CPU load of the noise reduction. */
+  double noiseReductionLoad() const;
+
   sdr::gui::Spectrum *spectrum() const;
 
+  /** Connects a latency probe to the sound card output, the probe receives the buffers once
+   * they passed the queue of the output and were written to the sound card. */
+  void connectLatencyProbe(LatencyProbe *probe);
+
+  /** Returns the recorder of the audio output. */
+  inline const AudioRecorder &recorder() const { return *_recorder; }
+  /** Starts recording the audio output into a new file in the configured directory. Returns
+   * @c false if the file can not be created. */
+  bool startRecording(WavWriter::Encoding encoding);
+  /** Stops recording. */
+  void stopRecording();
+
+  /** Returns the audio outputs. */
+  inline const AudioFanOut &outputs() const { return *_outputs; }
+
+  bool udpOutputEnabled() const;
+  void enableUDPOutput(bool enable);
+  uint16_t udpOutputPort() const;
+  void setUDPOutputPort(uint16_t port);
+
+  bool pipeOutputEnabled() const;
+  void enablePipeOutput(bool enable);
+  QString pipeOutputPath() const;
+  void setPipeOutputPath(const QString &path);
+
+  bool fileOutputEnabled() const;
+  void enableFileOutput(bool enable);
+  QString fileOutputPath() const;
+  void setFileOutputPath(const QString &path);
+
 protected:
   sdr::FIRLowPass<int16_t> *_low_pass;
   sdr::SubSample<int16_t>  *_sub_sample;
-  sdr::PortSink            *_sink;
+  NoiseReduction           *_noise_reduction;
+  AudioFanOut              *_outputs;
+  /** The sound card output, owned by @c _outputs. */
+  PortAudioOutput          *_soundcard;
   sdr::gui::Spectrum       *_audio_spectrum;
+  AudioRecorder            *_recorder;
+  /** If @c true, the input is a stereo signal, read by the view. */
+  std::atomic<bool> _stereo;
+  /** Mono down-mix of stereo audio for the spectrum. */
+  sdr::Buffer<int16_t> _downmix;
 };
 
 
@@ -56,11 +120,36 @@ protected slots:
   void onLowPassToggled(bool enable);
   void onSetLowPassFreq(QString value);
   void onSetLowPassOrder(int value);
+  void onNoiseReductionToggled(bool enable);
+  void onSetNoiseReductionStrength(double value);
+  void onUpdateLoad();
+  void onRecordToggled(bool enable);
+  void onUDPOutputToggled(bool enable);
+  void onPipeOutputToggled(bool enable);
+  void onFileOutputToggled(bool enable);
+
+protected:
+  /** Enables the filter controls for mono audio only. */
+  void _updateMode();
 
 protected:
   AudioPostProc *_proc;
+  /** Shows whether the filters apply (mono) or are bypassed (stereo). */
+  QLabel *_mode;
+  QCheckBox *_lp_enable;
   QLineEdit *_lp_freq;
   QSpinBox  *_lp_order;
+  QCheckBox *_nr_enable;
+  QDoubleSpinBox *_nr_strength;
+  QLabel *_nr_load;
+  QCheckBox *_record;
+  QComboBox *_record_format;
+  QLabel *_record_status;
+  QSpinBox *_udp_port;
+  QLineEdit *_pipe_path;
+  QLineEdit *_file_path;
+  QLabel *_output_status;
+  QTimer _load_update;
   sdr::gui::SpectrumView *_spectrum;
 };
 
@@ -0,0 +1,346 @@
+#include "audiorecorder.hh"
+#include "logger.hh"
+
+#include <cstring>
+#include <sstream>
+
+using namespace sdr;
+
+
+/** Step size table of the IMA ADPCM. */
+static const int16_t ima_step_table[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+  73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408,
+  449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630,
+  9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767 };
+
+/** Step index adjustment of the IMA ADPCM. */
+static const int ima_index_table[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+/** Encodes a sample into a 4 bit code, updates the predictor and step index. */
+static inline uint8_t
+ima_encode(int sample, int &predictor, int &index) {
+  int step = ima_step_table[index], diff = sample-predictor;
+  uint8_t code = 0;
+  if (diff < 0) { code = 8; diff = -diff; }
+  int delta = step >> 3;
+  if (diff >= step) { code |= 4; diff -= step; delta += step; }
+  step >>= 1;
+  if (diff >= step) { code |= 2; diff -= step; delta += step; }
+  step >>= 1;
+  if (diff >= step) { code |= 1; delta += step; }
+  predictor += (code & 8) ? -delta : delta;
+  predictor = std::max(-32768, std::min(32767, predictor));
+  index = std::max(0, std::min(88, index + ima_index_table[code & 7]));
+  return code;
+}
+
+/** Appends little endian integers to a header. */
+static inline void
+put_le(std::vector<uint8_t> &buf, uint64_t value, size_t bytes) {
+  for (size_t i=0; i<bytes; i++) { buf.push_back(uint8_t(value >> (8*i))); }
+}
+
+static inline void
+put_tag(std::vector<uint8_t> &buf, const char *tag) {
+  buf.insert(buf.end(), tag, tag+4);
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of WavWriter
+ * ******************************************************************************************** */
+WavWriter::WavWriter()
+  : _file(0), _encoding(PCM16), _rate(0), _channels(1), _frames(0), _data_bytes(0),
+    _block_align(0), _block_frames(0), _block_fill(0)
+{
+  // pass...
+}
+
+WavWriter::~WavWriter() {
+  close();
+}
+
+bool
+WavWriter::open(const std::string &filename, Encoding encoding, uint32_t rate, uint16_t channels)
+{
+  close();
+  _file = std::fopen(filename.c_str(), "wb");
+  if (0 == _file) { return false; }
+  _encoding = encoding; _rate = rate;
+  _channels = std::max(uint16_t(1), std::min(uint16_t(2), channels));
+  _frames = _data_bytes = 0;
+  if (IMA_ADPCM == _encoding) {
+    // 256 bytes per channel and block
+    _block_align = 256*_channels;
+    _block_frames = (_block_align-4*_channels)*8/(4*_channels) + 1;
+  } else {
+    _block_align = 2*_channels;
+    _block_frames = 1;
+  }
+  _block.assign(_block_frames*_channels, 0);
+  _block_fill = 0;
+  _predictor[0] = _predictor[1] = 0;
+  _index[0] = _index[1] = 0;
+  _encoded.assign(_block_align, 0);
+  if (! _writeHeader()) { close(); return false; }
+  return true;
+}
+
+bool
+WavWriter::write(const int16_t *frames, size_t N) {
+  if (0 == _file) { return false; }
+  if (PCM16 == _encoding) {
+    // The file is little endian like the host
+    if (N != std::fwrite(frames, 2*_channels, N, _file)) { return false; }
+    _frames += N; _data_bytes += 2*_channels*N;
+    return true;
+  }
+  // Collect complete blocks
+  while (N) {
+    size_t n = std::min(N, _block_frames-_block_fill);
+    memcpy(&_block[_block_fill*_channels], frames, 2*_channels*n);
+    _block_fill += n; frames += n*_channels; N -= n; _frames += n;
+    if ((_block_fill == _block_frames) && (! _encodeBlock())) { return false; }
+  }
+  return true;
+}
+
+bool
+WavWriter::_encodeBlock() {
+  uint8_t *out = &_encoded[0];
+  // Block header: first sample and step index per channel
+  for (size_t c=0; c<_channels; c++) {
+    _predictor[c] = _block[c];
+    out[0] = uint8_t(_predictor[c] & 0xff); out[1] = uint8_t((_predictor[c] >> 8) & 0xff);
+    out[2] = uint8_t(_index[c]); out[3] = 0;
+    out += 4;
+  }
+  // Groups of 8 samples per channel, 4 bytes each, low nibble first
+  for (size_t g=1; g<_block_frames; g+=8) {
+    for (size_t c=0; c<_channels; c++) {
+      for (size_t k=0; k<8; k+=2) {
+        uint8_t lo = ima_encode(_block[(g+k)*_channels+c], _predictor[c], _index[c]);
+        uint8_t hi = ima_encode(_block[(g+k+1)*_channels+c], _predictor[c], _index[c]);
+        *out++ = lo | (hi << 4);
+      }
+    }
+  }
+  _block_fill = 0;
+  if (1 != std::fwrite(&_encoded[0], _block_align, 1, _file)) { return false; }
+  _data_bytes += _block_align;
+  return true;
+}
+
+bool
+WavWriter::_writeHeader() {
+  bool adpcm = (IMA_ADPCM == _encoding);
+  size_t fmt_size = adpcm ? 20 : 16;
+  size_t header_size = 12 + 36 + 8+fmt_size + (adpcm ? 12 : 0) + 8;
+  uint64_t riff_size = header_size-8 + _data_bytes;
+  // Switch to RF64 if the sizes do not fit into 32 bit
+  bool rf64 = (riff_size > 0xffffffffULL);
+
+  std::vector<uint8_t> header;
+  put_tag(header, rf64 ? "RF64" : "RIFF");
+  put_le(header, rf64 ? 0xffffffffULL : riff_size, 4);
+  put_tag(header, "WAVE");
+  // ds64 chunk or placeholder of the same size
+  put_tag(header, rf64 ? "ds64" : "JUNK");
+  put_le(header, 28, 4);
+  put_le(header, rf64 ? riff_size : 0, 8);
+  put_le(header, rf64 ? _data_bytes : 0, 8);
+  put_le(header, rf64 ? _frames : 0, 8);
+  put_le(header, 0, 4);
+  // Format
+  put_tag(header, "fmt ");
+  put_le(header, fmt_size, 4);
+  put_le(header, adpcm ? 0x11 : 0x01, 2);
+  put_le(header, _channels, 2);
+  put_le(header, _rate, 4);
+  put_le(header, uint64_t(_rate)*_block_align/_block_frames, 4);
+  put_le(header, _block_align, 2);
+  put_le(header, adpcm ? 4 : 16, 2);
+  if (adpcm) {
+    put_le(header, 2, 2);
+    put_le(header, _block_frames, 2);
+    put_tag(header, "fact");
+    put_le(header, 4, 4);
+    put_le(header, rf64 ? 0xffffffffULL : _frames, 4);
+  }
+  put_tag(header, "data");
+  put_le(header, rf64 ? 0xffffffffULL : _data_bytes, 4);
+
+  if (0 != std::fseek(_file, 0, SEEK_SET)) { return false; }
+  if (1 != std::fwrite(&header[0], header.size(), 1, _file)) { return false; }
+  return 0 == std::fseek(_file, 0, SEEK_END);
+}
+
+bool
+WavWriter::update() {
+  if (0 == _file) { return false; }
+  if (! _writeHeader()) { return false; }
+  return 0 == std::fflush(_file);
+}
+
+void
+WavWriter::close() {
+  if (0 == _file) { return; }
+  if ((IMA_ADPCM == _encoding) && _block_fill) {
+    // Pad the last block by repeating the last frame, the fact chunk holds the true length
+    for (size_t i=_block_fill; i<_block_frames; i++) {
+      memcpy(&_block[i*_channels], &_block[(_block_fill-1)*_channels], 2*_channels);
+    }
+    _encodeBlock();
+  }
+  _writeHeader();
+  std::fclose(_file);
+  _file = 0;
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of AudioRecorder
+ * ******************************************************************************************** */
+AudioRecorder::AudioRecorder(double buffer)
+  : SinkBase(), _rate(0), _channels(1), _sequence(0), _encoding(WavWriter::PCM16), _writer(),
+    _ring(size_t(buffer*48000*2)), _recording(false), _frames(0), _dropped(0)
+{
+  // pass...
+}
+
+AudioRecorder::~AudioRecorder() {
+  stop();
+}
+
+bool
+AudioRecorder::start(const std::string &filename, WavWriter::Encoding encoding) {
+  std::lock_guard<std::mutex> guard(_control);
+  _stop();
+  _basename = filename; _sequence = 0; _encoding = encoding;
+  _dropped = 0;
+  // The file gets opened once the format is known
+  if ((0 < _rate) && (! _open())) { return false; }
+  _recording = true;
+  if (_writer.isOpen()) { _thread = std::thread(&AudioRecorder::_run, this); }
+  return true;
+}
+
+void
+AudioRecorder::stop() {
+  std::lock_guard<std::mutex> guard(_control);
+  _stop();
+}
+
+void
+AudioRecorder::_stop() {
+  _recording = false;
+  _cond.notify_one();
+  // The writer drains the ring before it exits
+  if (_thread.joinable()) { _thread.join(); }
+  _writer.close();
+}
+
+std::string
+AudioRecorder::filename() const {
+  std::lock_guard<std::mutex> guard(_control);
+  return _filename;
+}
+
+double
+AudioRecorder::duration() const {
+  if (0 >= _rate) { return 0; }
+  return double(_frames)/_rate;
+}
+
+bool
+AudioRecorder::_open() {
+  _filename = _basename;
+  if (_sequence) {
+    // Insert sequence number before the extension
+    std::stringstream name;
+    size_t dot = _basename.rfind('.');
+    if (std::string::npos == dot) { dot = _basename.size(); }
+    name << _basename.substr(0, dot) << "-" << _sequence << _basename.substr(dot);
+    _filename = name.str();
+  }
+  _frames = 0;
+  if (! _writer.open(_filename, _encoding, uint32_t(_rate), _channels)) {
+    LogMessage msg(LOG_WARNING);
+    msg << "AudioRecorder: Can not create file " << _filename;
+    Logger::get().log(msg);
+    return false;
+  }
+  return true;
+}
+
+void
+AudioRecorder::config(const Config &src_cfg) {
+  // Requires type and sample rate
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate()) { return; }
+  if ((Config::typeId<int16_t>() != src_cfg.type()) &&
+      (Config::typeId< std::complex<int16_t> >() != src_cfg.type())) {
+    ConfigError err;
+    err << "Can not configure AudioRecorder: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId<int16_t>() << " or "
+        << Config::typeId< std::complex<int16_t> >();
+    throw err;
+  }
+
+  uint16_t channels = (Config::typeId<int16_t>() == src_cfg.type()) ? 1 : 2;
+  std::lock_guard<std::mutex> guard(_control);
+  if ((channels == _channels) && (src_cfg.sampleRate() == _rate) && _writer.isOpen()) { return; }
+
+  bool recording = _recording;
+  if (recording && _writer.isOpen()) {
+    // Format changed, continue in a new file
+    _recording = false; _cond.notify_one();
+    if (_thread.joinable()) { _thread.join(); }
+    _writer.close();
+    _sequence++;
+  }
+  _channels = channels; _rate = src_cfg.sampleRate();
+  if (recording && _open()) {
+    _recording = true;
+    _thread = std::thread(&AudioRecorder::_run, this);
+  }
+}
+
+void
+AudioRecorder::handleBuffer(const RawBuffer &buffer, bool allow_overwrite) {
+  if (! _recording) { return; }
+  // Put whole buffers only, keeps the frames of the ring aligned
+  size_t N = buffer.bytesLen()/sizeof(int16_t);
+  if (N > _ring.free()) { _dropped += N; return; }
+  _ring.put(reinterpret_cast<const int16_t *>(buffer.data()), N);
+  _cond.notify_one();
+}
+
+void
+AudioRecorder::_run() {
+  std::vector<int16_t> chunk(8192*_channels);
+  size_t since_update = 0;
+  while (_recording || _ring.stored()) {
+    size_t n = _ring.take(&chunk[0], chunk.size());
+    if (0 == n) {
+      std::unique_lock<std::mutex> guard(_lock);
+      _cond.wait_for(guard, std::chrono::milliseconds(50));
+      continue;
+    }
+    if (! _writer.write(&chunk[0], n/_channels)) {
+      LogMessage msg(LOG_ERROR);
+      msg << "AudioRecorder: Can not write to " << _filename << ", recording stopped.";
+      Logger::get().log(msg);
+      _recording = false;
+      break;
+    }
+    _frames = _writer.frames();
+    // Keep the header up to date about once a second
+    since_update += n/_channels;
+    if (since_update >= _rate) { _writer.update(); since_update = 0; }
+  }
+  // Drop what is left after an error or was put while stopping, the ring is consumed here only
+  _ring.clear();
+}
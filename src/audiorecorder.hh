@@ -0,0 +1,146 @@
+#ifndef __SDR_RX_AUDIORECORDER_HH__
+#define __SDR_RX_AUDIORECORDER_HH__
+
+#include "node.hh"
+#include "lockfreering.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+
+/** Writes 16 bit audio into a WAV file, either as PCM or IMA ADPCM (4 bit per sample).
+ *
+ * The header reserves space for a @c ds64 chunk (as a @c JUNK chunk). If the file exceeds the
+ * 4 GB limit of RIFF, the header gets converted into a RF64 header on update, hence recordings
+ * are not limited in length. The header is updated regularly by @c update, a recording
+ * interrupted by a crash remains readable up to the last update. */
+class WavWriter
+{
+public:
+  /** Sample encodings. */
+  typedef enum {
+    PCM16, IMA_ADPCM
+  } Encoding;
+
+public:
+  /** Constructor. */
+  WavWriter();
+  /** Destructor, closes the file. */
+  virtual ~WavWriter();
+
+  /** Creates the file. Returns @c false on error. */
+  bool open(const std::string &filename, Encoding encoding, uint32_t rate, uint16_t channels);
+  /** Returns @c true if a file is open. */
+  inline bool isOpen() const { return 0 != _file; }
+  /** Appends @c N frames of interleaved samples. Returns @c false on error. */
+  bool write(const int16_t *frames, size_t N);
+  /** Rewrites the header for the data written so far and flushes the file. */
+  bool update();
+  /** Encodes the pending partial block, updates the header and closes the file. */
+  void close();
+
+  /** Returns the number of frames written. */
+  inline uint64_t frames() const { return _frames; }
+  /** Returns the number of bytes of audio data written. */
+  inline uint64_t dataBytes() const { return _data_bytes; }
+
+protected:
+  /** Encodes a complete block of ADPCM from @c _block. */
+  bool _encodeBlock();
+  /** Writes the header. */
+  bool _writeHeader();
+
+protected:
+  std::FILE *_file;
+  Encoding _encoding;
+  uint32_t _rate;
+  uint16_t _channels;
+  /** Frames and bytes of audio data written. */
+  uint64_t _frames, _data_bytes;
+  /** ADPCM block size in bytes and frames. */
+  size_t _block_align, _block_frames;
+  /** ADPCM frames collected for the next block and their number. */
+  std::vector<int16_t> _block;
+  size_t _block_fill;
+  /** ADPCM predictor and step index per channel. */
+  int _predictor[2], _index[2];
+  /** Encoded block. */
+  std::vector<uint8_t> _encoded;
+};
+
+
+/** Records the demodulated audio into WAV files.
+ *
+ * The recorder accepts mono (@c int16_t) and stereo (@c std::complex<int16_t>) audio. The samples
+ * are only copied into a bounded lock-free ring by the processing thread; a writer thread takes
+ * them from the ring and encodes and writes them. Hence, the disk or the encoder can never block
+ * the processing. If the writer can not keep up, the samples not fitting into the ring are
+ * dropped and counted. Only the writer thread consumes from the ring, it drops the samples left
+ * when it exits. If the sample rate or number of channels changes while recording, a new
+ * file is started with a sequence number appended to the file name. */
+class AudioRecorder: public sdr::SinkBase
+{
+public:
+  /** Constructor.
+   * @param buffer Specifies the capacity of the ring in seconds at 48 kHz stereo. */
+  AudioRecorder(double buffer=4.0);
+  /** Destructor, stops recording. */
+  virtual ~AudioRecorder();
+
+  /** Starts recording into the given file. Returns @c false if the file can not be created. */
+  bool start(const std::string &filename, WavWriter::Encoding encoding);
+  /** Stops recording and closes the file. */
+  void stop();
+  /** Returns @c true while recording. */
+  inline bool isRecording() const { return _recording; }
+
+  /** Returns the name of the current file. */
+  std::string filename() const;
+  /** Returns the length of the current recording in seconds. */
+  double duration() const;
+  /** Returns the number of samples dropped since recording started. */
+  inline size_t droppedSamples() const { return _dropped; }
+
+  virtual void config(const sdr::Config &src_cfg);
+  virtual void handleBuffer(const sdr::RawBuffer &buffer, bool allow_overwrite);
+
+protected:
+  /** Stops the writer thread and closes the file, the control lock must be held. */
+  void _stop();
+  /** Opens the file for the current format. */
+  bool _open();
+  /** The writer loop. */
+  void _run();
+
+protected:
+  /** The sample rate and number of channels of the input. */
+  double _rate;
+  uint16_t _channels;
+  /** File name, sequence number and encoding of the recording. */
+  std::string _filename, _basename;
+  size_t _sequence;
+  WavWriter::Encoding _encoding;
+  WavWriter _writer;
+  /** Audio passed to the writer thread. */
+  LockFreeRing<int16_t> _ring;
+  std::atomic<bool> _recording;
+  /** Frames written, read by the GUI. */
+  std::atomic<uint64_t> _frames;
+  /** Samples dropped as the ring was full. */
+  std::atomic<size_t> _dropped;
+  /** Serializes @c start, @c stop (GUI) and @c config (processing thread), which open and
+   * close the file and start and join the writer thread. */
+  mutable std::mutex _control;
+  /** Wakes the writer thread. */
+  std::mutex _lock;
+  std::condition_variable _cond;
+  std::thread _thread;
+};
+
+#endif // __SDR_RX_AUDIORECORDER_HH__
@@ -0,0 +1,118 @@
+#include "bufferpool.hh"
+#include "logger.hh"
+
+#include <stdint.h>
+
+using namespace sdr;
+
+
+/* ******************************************************************************************** *
+ * Implementation of BufferPool
+ * ******************************************************************************************** */
+BufferPool *BufferPool::_instance = 0;
+
+BufferPool::BufferPool()
+  : _lock(), _classes()
+{
+  // pass...
+}
+
+BufferPool::~BufferPool() {
+  for (size_t i=0; i<_classes.size(); i++) {
+    for (std::list<Block>::iterator block=_classes[i].begin(); block!=_classes[i].end(); block++) {
+      block->storage.unref();
+    }
+  }
+}
+
+BufferPool &
+BufferPool::get() {
+  if (0 == _instance) { _instance = new BufferPool(); }
+  return *_instance;
+}
+
+RawBuffer
+BufferPool::_acquire(size_t bytes) {
+  // Determine size class
+  size_t cls = 0, size = MinClassSize;
+  while (size < bytes) { size <<= 1; cls++; }
+
+  std::lock_guard<std::mutex> guard(_lock);
+  if (cls >= _classes.size()) { _classes.resize(cls+1); }
+
+  // Reuse a released block, that is not referenced by any other node
+  std::list<Block> &blocks = _classes[cls];
+  for (std::list<Block>::iterator block=blocks.begin(); block!=blocks.end(); block++) {
+    if ((! block->acquired) && block->aligned.isUnused()) {
+      block->acquired = true;
+      return block->aligned;
+    }
+  }
+
+  // Allocate a new block and align it to a cache line
+  Block block;
+  block.storage = RawBuffer(size + Alignment);
+  size_t offset = (Alignment - (uintptr_t(block.storage.data()) % Alignment)) % Alignment;
+  block.aligned = RawBuffer(block.storage, offset, size);
+  block.acquired = true;
+  blocks.push_back(block);
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "BufferPool: Allocated block of " << size << " bytes, "
+      << blocks.size() << " blocks in this class.";
+  Logger::get().log(msg);
+
+  return block.aligned;
+}
+
+void
+BufferPool::release(const RawBuffer &buffer) {
+  if (buffer.isEmpty()) { return; }
+  std::lock_guard<std::mutex> guard(_lock);
+  for (size_t i=0; i<_classes.size(); i++) {
+    for (std::list<Block>::iterator block=_classes[i].begin(); block!=_classes[i].end(); block++) {
+      if (block->storage.ptr() == buffer.ptr()) { block->acquired = false; return; }
+    }
+  }
+}
+
+size_t
+BufferPool::allocatedBytes() {
+  std::lock_guard<std::mutex> guard(_lock);
+  size_t bytes = 0;
+  for (size_t i=0; i<_classes.size(); i++) {
+    bytes += _classes[i].size()*(MinClassSize << i);
+  }
+  return bytes;
+}
+
+size_t
+BufferPool::acquiredBytes() {
+  std::lock_guard<std::mutex> guard(_lock);
+  size_t bytes = 0;
+  for (size_t i=0; i<_classes.size(); i++) {
+    for (std::list<Block>::iterator block=_classes[i].begin(); block!=_classes[i].end(); block++) {
+      if (block->acquired) { bytes += (MinClassSize << i); }
+    }
+  }
+  return bytes;
+}
+
+void
+BufferPool::report(std::ostream &stream) {
+  std::lock_guard<std::mutex> guard(_lock);
+  size_t total = 0;
+  for (size_t i=0; i<_classes.size(); i++) {
+    if (0 == _classes[i].size()) { continue; }
+    size_t acquired = 0;
+    for (std::list<Block>::iterator block=_classes[i].begin(); block!=_classes[i].end(); block++) {
+      if (block->acquired) { acquired++; }
+    }
+    size_t size = MinClassSize << i;
+    stream << " " << size/1024 << " KiB: " << _classes[i].size() << " blocks, "
+           << acquired << " acquired, " << (_classes[i].size()*size)/1024 << " KiB total"
+           << std::endl;
+    total += _classes[i].size()*size;
+  }
+  stream << " total: " << total/1024 << " KiB";
+}
@@ -0,0 +1,81 @@
+#ifndef __SDR_RX_BUFFERPOOL_HH__
+#define __SDR_RX_BUFFERPOOL_HH__
+
+#include "buffer.hh"
+
+#include <list>
+#include <mutex>
+#include <vector>
+#include <ostream>
+
+
+/** A receiver-wide pool of sample buffers.
+ *
+ * Nodes obtain their output buffers in @c config with @c acquire and hand them back with
+ * @c release (instead of @c unref) when they get reconfigured or destroyed. The pool keeps the
+ * memory and hands it out again, hence reconfiguring the processing chain, switching demodulators
+ * or restarting the queue does not allocate once the pool is warm.
+ *
+ * The storage is organized in size classes of powers of two bytes, each class is a pool of its
+ * own. All buffers are aligned to cache lines. A released buffer is only handed out again once
+ * it is no longer referenced by any downstream node. */
+class BufferPool
+{
+public:
+  /** Alignment of the buffers in bytes. */
+  static const size_t Alignment = 64;
+  /** Size of the smallest class in bytes. */
+  static const size_t MinClassSize = 4096;
+
+protected:
+  /** A block of the pool. */
+  typedef struct {
+    /** The allocated storage. */
+    sdr::RawBuffer storage;
+    /** The aligned part of the storage handed out. */
+    sdr::RawBuffer aligned;
+    /** If @c true, the block is owned by a node. */
+    bool acquired;
+  } Block;
+
+  /** Hidden constructor, use @c get to obtain the instance. */
+  BufferPool();
+
+public:
+  /** Destructor, frees all blocks. */
+  virtual ~BufferPool();
+
+  /** Returns the pool instance. */
+  static BufferPool &get();
+
+  /** Obtains a buffer of @c N elements. */
+  template <class Scalar>
+  sdr::Buffer<Scalar> acquire(size_t N) {
+    return sdr::Buffer<Scalar>(_acquire(N*sizeof(Scalar))).head(N);
+  }
+
+  /** Returns the given buffer (obtained by @c acquire) to the pool. Empty buffers and buffers
+   * not obtained from the pool are ignored. */
+  void release(const sdr::RawBuffer &buffer);
+
+  /** Returns the total number of bytes allocated. */
+  size_t allocatedBytes();
+  /** Returns the number of bytes currently owned by nodes. */
+  size_t acquiredBytes();
+  /** Writes the usage of each size class to the given stream. */
+  void report(std::ostream &stream);
+
+protected:
+  /** Obtains a block of at least the given size in bytes. */
+  sdr::RawBuffer _acquire(size_t bytes);
+
+protected:
+  /** Serializes access, buffers are acquired in the GUI and in the processing thread. */
+  std::mutex _lock;
+  /** The blocks per size class. */
+  std::vector< std::list<Block> > _classes;
+  /** The singleton instance. */
+  static BufferPool *_instance;
+};
+
+#endif // __SDR_RX_BUFFERPOOL_HH__
@@ -0,0 +1,145 @@
+#include "channelagc.hh"
+#include "bufferpool.hh"
+#include "logger.hh"
+#include <algorithm>
+
+using namespace sdr;
+
+
+/* ******************************************************************************************** *
+ * Implementation of ChannelAGC
+ * ******************************************************************************************** */
+ChannelAGC::ChannelAGC(double attack, double decay, double hang, double target)
+  : Sink< std::complex<int16_t> >(), Source(), _enabled(false), _attack(attack), _decay(decay),
+    _hang(hang), _target(target*32767), _maxGain(1e4), _rate(0), _block(1), _hangBlocks(0),
+    _attackCoef(1), _decayCoef(1), _gain(1), _hangCount(0), _buffer()
+{
+  // pass...
+}
+
+ChannelAGC::~ChannelAGC() {
+  BufferPool::get().release(_buffer);
+}
+
+void
+ChannelAGC::setAttack(double attack) {
+  _attack = std::max(0.0, attack);
+  _updateCoefficients();
+}
+
+void
+ChannelAGC::setDecay(double decay) {
+  _decay = std::max(0.0, decay);
+  _updateCoefficients();
+}
+
+void
+ChannelAGC::setHang(double hang) {
+  _hang = std::max(0.0, hang);
+  _updateCoefficients();
+}
+
+void
+ChannelAGC::config(const Config &src_cfg) {
+  // Requires type, sample rate & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+  // Check buffer type
+  if (Config::typeId< std::complex<int16_t> >() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure ChannelAGC: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId< std::complex<int16_t> >();
+    throw err;
+  }
+
+  _rate = src_cfg.sampleRate();
+  _updateCoefficients();
+  _hangCount = 0;
+
+  BufferPool::get().release(_buffer);
+  _buffer = BufferPool::get().acquire< std::complex<int16_t> >(src_cfg.bufferSize());
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Configured ChannelAGC node: " << this << std::endl
+      << " sample-rate: " << _rate << std::endl
+      << " block size: " << _block << std::endl
+      << " attack: " << _attack << "s, decay: " << _decay << "s, hang: " << _hang << "s";
+  Logger::get().log(msg);
+
+  this->setConfig(Config(Config::typeId< std::complex<int16_t> >(), src_cfg.sampleRate(),
+                         src_cfg.bufferSize(), 1));
+}
+
+void
+ChannelAGC::_updateCoefficients() {
+  if (0 >= _rate) { return; }
+  // Blocks of about 1ms
+  _block = std::max(size_t(8), size_t(_rate/1000));
+  double T = _block/_rate;
+  _attackCoef = (_attack > 0) ? (1-std::exp(-T/_attack)) : 1;
+  _decayCoef = (_decay > 0) ? (1-std::exp(-T/_decay)) : 1;
+  _hangBlocks = size_t(_hang/T);
+}
+
+void
+ChannelAGC::process(const Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite) {
+  if (! _enabled) {
+    this->send(buffer, allow_overwrite);
+    return;
+  }
+
+  Buffer< std::complex<int16_t> > out;
+  if (allow_overwrite) {
+    out = buffer;
+  } else if (_buffer.isUnused()) {
+    out = _buffer;
+  } else {
+#ifdef SDR_DEBUG
+    LogMessage msg(LOG_WARNING);
+    msg << "ChannelAGC: Drop buffer: Output buffer still in use.";
+    Logger::get().log(msg);
+#endif
+    return;
+  }
+
+  const int16_t *in = reinterpret_cast<const int16_t *>(buffer.data());
+  int16_t *res = reinterpret_cast<int16_t *>(out.data());
+  size_t N = buffer.size();
+  for (size_t offset=0; offset<N; offset+=_block) {
+    size_t n = std::min(_block, N-offset);
+    const int16_t *x = in + 2*offset;
+    int16_t *y = res + 2*offset;
+
+    // Peak envelope of the block, the squared magnitude reaches 2^31 for I=Q=-32768
+    uint32_t peak2 = 0;
+    for (size_t i=0; i<n; i++) {
+      int32_t I = x[2*i], Q = x[2*i+1];
+      peak2 = std::max(peak2, uint32_t(I*I) + uint32_t(Q*Q));
+    }
+    float peak = std::max(1.0f, std::sqrt(float(peak2)));
+
+    // New gain
+    float desired = std::min(_maxGain, _target/peak), gain = _gain;
+    if (desired < gain) {
+      gain += _attackCoef*(desired-gain);
+      _hangCount = _hangBlocks;
+    } else if (_hangCount) {
+      _hangCount--;
+    } else {
+      gain += _decayCoef*(desired-gain);
+    }
+    // Never clip: Neither the new gain nor the start of the ramp may exceed the headroom of the
+    // block, the previous gain was limited by the peak of the previous block only
+    float limit = 32767/peak;
+    gain = std::min(gain, limit);
+
+    // Ramp from the previous gain to the new gain over the block
+    float g = std::min(_gain, limit), dg = (gain-g)/n;
+    for (size_t i=0; i<2*n; i++) {
+      float v = x[i]*(g + (i/2)*dg);
+      y[i] = int16_t(std::max(-32768.0f, std::min(32767.0f, v)));
+    }
+    _gain = gain;
+  }
+
+  this->send(out.head(N), true);
+}
@@ -0,0 +1,74 @@
+#ifndef __SDR_RX_CHANNELAGC_HH__
+#define __SDR_RX_CHANNELAGC_HH__
+
+#include "node.hh"
+#include <cmath>
+
+
+/** An AGC for the channel filtered, decimated I/Q signal with separate attack, decay and hang.
+ *
+ * In contrast to @c sdr::AGC ahead of the filter node, this AGC runs at the channel sample rate
+ * and reacts to the level of the received channel only. The input is processed in blocks of about
+ * 1 ms. The peak envelope of each block determines the desired gain: If the gain must drop, it
+ * follows within the attack time and the hang period is (re-)started. Once the hang period
+ * expired, the gain rises within the decay time. The gain is additionally limited such that the
+ * block does not clip. Within each block, the gain ramps linearly from the previous to the new
+ * gain, hence gain changes do not cause clicks. Both, the envelope and the ramp, are simple loops
+ * over the block which get vectorized by the compiler. */
+class ChannelAGC: public sdr::Sink< std::complex<int16_t> >, public sdr::Source
+{
+public:
+  /** Constructor.
+   * @param attack Specifies the attack time in seconds.
+   * @param decay Specifies the decay time in seconds.
+   * @param hang Specifies the hang time in seconds.
+   * @param target Specifies the target peak level relative to full scale. */
+  ChannelAGC(double attack=0.002, double decay=0.1, double hang=0.25, double target=0.25);
+  /** Destructor. */
+  virtual ~ChannelAGC();
+
+  /** Returns @c true if the AGC is enabled. */
+  inline bool enabled() const { return _enabled; }
+  /** Enables or disables the AGC. If disabled, the input is passed through. */
+  inline void enable(bool enable) { _enabled = enable; }
+
+  inline double attack() const { return _attack; }
+  void setAttack(double attack);
+  inline double decay() const { return _decay; }
+  void setDecay(double decay);
+  inline double hang() const { return _hang; }
+  void setHang(double hang);
+
+  /** Returns the current gain (factor). */
+  inline float gain() const { return _gain; }
+  /** Returns the current gain in dB. */
+  inline double gaindB() const { return 20*std::log10(_gain); }
+
+  /** Configures the AGC. */
+  virtual void config(const sdr::Config &src_cfg);
+  /** Performs the gain control. */
+  virtual void process(const sdr::Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite);
+
+protected:
+  /** Updates the block size and the per-block coefficients. */
+  void _updateCoefficients();
+
+protected:
+  bool _enabled;
+  /** Attack, decay and hang time in seconds. */
+  double _attack, _decay, _hang;
+  /** Target peak level and maximum gain. */
+  float _target, _maxGain;
+  double _rate;
+  /** Samples per block and number of blocks in the hang period. */
+  size_t _block, _hangBlocks;
+  /** Per block weights of the desired gain during attack and decay. */
+  float _attackCoef, _decayCoef;
+  /** Current gain and remaining hang blocks. */
+  float _gain;
+  size_t _hangCount;
+  /** The output buffer. */
+  sdr::Buffer< std::complex<int16_t> > _buffer;
+};
+
+#endif // __SDR_RX_CHANNELAGC_HH__
@@ -0,0 +1,140 @@
+#include "channelfilter.hh"
+#include "filterdesign.hh"
+#include "bufferpool.hh"
+#include "logger.hh"
+#include <cmath>
+#include <algorithm>
+
+using namespace sdr;
+
+
+/* ******************************************************************************************** *
+ * Implementation of ChannelFilter
+ * ******************************************************************************************** */
+ChannelFilter::ChannelFilter(double Fc, double Ff, double width, size_t order, double oFs)
+  : Sink< std::complex<int16_t> >(), Source(), _nco(-Fc), _Ff(Ff), _width(width),
+    _order(std::max(size_t(1), order)), _oFs(oFs), _Fs(0), _bufferSize(0), _decim(1),
+    _decim_count(0), _acc(0), _delay_idx(0), _buffer()
+{
+  // pass...
+}
+
+ChannelFilter::~ChannelFilter() {
+  BufferPool::get().release(_buffer);
+}
+
+void
+ChannelFilter::setFilterFrequency(double Ff) {
+  std::lock_guard<std::mutex> guard(_lock);
+  _Ff = Ff;
+  if (_Fs > 0) { _design(); }
+}
+
+void
+ChannelFilter::setFilterWidth(double width) {
+  std::lock_guard<std::mutex> guard(_lock);
+  _width = width;
+  if (_Fs > 0) { _design(); }
+}
+
+void
+ChannelFilter::setOutputSampleRate(double oFs) {
+  _oFs = oFs;
+  if (_Fs > 0) { _configure(); }
+}
+
+void
+ChannelFilter::config(const Config &src_cfg) {
+  // Requires type, sample rate & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+  // Check buffer type
+  if (Config::typeId< std::complex<int16_t> >() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure ChannelFilter: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId< std::complex<int16_t> >();
+    throw err;
+  }
+
+  _Fs = src_cfg.sampleRate();
+  _bufferSize = src_cfg.bufferSize();
+  _configure();
+}
+
+void
+ChannelFilter::_configure() {
+  _decim = std::max(size_t(1), size_t(_Fs/_oFs));
+  _nco.setSampleRate(_Fs);
+  _mixed.resize(NCO::BlockSize);
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _design();
+    _delay.assign(2*_taps.size(), 0);
+    _delay_idx = 0; _decim_count = 0; _acc = 0;
+  }
+  size_t N = _bufferSize/_decim + 1;
+  BufferPool::get().release(_buffer);
+  _buffer = BufferPool::get().acquire< std::complex<int16_t> >(N);
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Configured ChannelFilter node: " << this << std::endl
+      << " sample-rate: " << _Fs << std::endl
+      << " center frequency: " << centerFrequency() << std::endl
+      << " filter: " << _Ff << " +/- " << _width/2 << std::endl
+      << " output rate: " << outputSampleRate() << "Hz (decimation " << _decim << ")";
+  Logger::get().log(msg);
+
+  this->setConfig(Config(Config::typeId< std::complex<int16_t> >(), outputSampleRate(), N, 1));
+}
+
+void
+ChannelFilter::_design() {
+  // Low-pass at the output rate, rotated to the filter frequency. The taps also undo the gain
+  // of the integrate & dump.
+  double Fr = _Fs/_decim;
+  std::vector<float> lp;
+  FilterDesign::lowPass(lp, _order, _width/2, Fr);
+  size_t M = lp.size();
+  if (M != _taps.size()) { _delay.assign(2*M, 0); _delay_idx = 0; }
+  _taps.resize(M);
+  // The delay line holds the oldest sample first
+  for (size_t j=0; j<M; j++) {
+    double phi = 2*M_PI*_Ff*((M-1)/2.0 - j)/Fr;
+    _taps[j] = std::complex<float>(lp[j]*std::cos(phi)/_decim, lp[j]*std::sin(phi)/_decim);
+  }
+}
+
+void
+ChannelFilter::process(const Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite) {
+  if (! _buffer.isUnused()) {
+#ifdef SDR_DEBUG
+    LogMessage msg(LOG_WARNING);
+    msg << "ChannelFilter: Drop buffer: Output buffer still in use.";
+    Logger::get().log(msg);
+#endif
+    return;
+  }
+
+  std::lock_guard<std::mutex> guard(_lock);
+  const std::complex<int16_t> *in = reinterpret_cast<const std::complex<int16_t> *>(buffer.data());
+  std::complex<int16_t> *out = reinterpret_cast<std::complex<int16_t> *>(_buffer.data());
+  size_t M = _taps.size(), j = 0;
+  for (size_t offset=0; offset<buffer.size(); offset+=_mixed.size()) {
+    size_t N = std::min(_mixed.size(), buffer.size()-offset);
+    _nco.mix(in+offset, _mixed.data(), N);
+    for (size_t i=0; i<N; i++) {
+      _acc += std::complex<float>(_mixed[i].real(), _mixed[i].imag());
+      if (++_decim_count < _decim) { continue; }
+      _delay[_delay_idx] = _delay[_delay_idx+M] = _acc;
+      _delay_idx = (_delay_idx+1) % M;
+      _acc = 0; _decim_count = 0;
+      // Evaluate filter only at the output rate
+      std::complex<float> y = 0;
+      const std::complex<float> *x = &_delay[_delay_idx];
+      for (size_t k=0; k<M; k++) { y += _taps[k]*x[k]; }
+      out[j++] = std::complex<int16_t>(int16_t(std::max(-32768.0f, std::min(32767.0f, y.real()))),
+                                       int16_t(std::max(-32768.0f, std::min(32767.0f, y.imag()))));
+    }
+  }
+
+  if (j) { this->send(_buffer.head(j), true); }
+}
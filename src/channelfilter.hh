@@ -0,0 +1,93 @@
+#ifndef __SDR_RX_CHANNELFILTER_HH__
+#define __SDR_RX_CHANNELFILTER_HH__
+
+#include "node.hh"
+#include "nco.hh"
+
+#include <mutex>
+#include <vector>
+
+
+/** Selects the channel from the wide-band I/Q signal in a single pass: Shifts the center
+ * frequency to 0 using a @c NCO, band-pass filters the signal around the filter frequency
+ * (relative to the center) and decimates it to the output sample rate.
+ *
+ * The mixed samples are summed over the decimation factor (integrate & dump) and the complex
+ * band-pass FIR is evaluated at the output rate only. Hence, the cost per input sample is a
+ * single complex multiplication with the oscillator and one addition, while a shift followed by
+ * @c sdr::IQBaseBand mixes twice and runs the FIR at the input rate.
+ *
+ * Retuning the center frequency only changes the phase increment of the oscillator and may be
+ * done from any thread. Changing the filter frequency or width redesigns the taps, these are
+ * guarded by a mutex held by @c process for the duration of a buffer. */
+class ChannelFilter: public sdr::Sink< std::complex<int16_t> >, public sdr::Source
+{
+public:
+  /** Constructor.
+   * @param Fc Specifies the center frequency shifted to 0.
+   * @param Ff Specifies the filter frequency relative to the center frequency.
+   * @param width Specifies the filter width.
+   * @param order Specifies the number of filter taps.
+   * @param oFs Specifies the minimum output sample rate. */
+  ChannelFilter(double Fc, double Ff, double width, size_t order, double oFs);
+  /** Destructor. */
+  virtual ~ChannelFilter();
+
+  /** Returns the center frequency. */
+  inline double centerFrequency() const { return -_nco.frequency(); }
+  /** Sets the center frequency, may be called from any thread. */
+  inline void setCenterFrequency(double Fc) { _nco.setFrequency(-Fc); }
+
+  /** Returns the filter frequency relative to the center frequency. */
+  inline double filterFrequency() const { return _Ff; }
+  /** Sets the filter frequency relative to the center frequency. */
+  void setFilterFrequency(double Ff);
+  /** Returns the filter width. */
+  inline double filterWidth() const { return _width; }
+  /** Sets the filter width. */
+  void setFilterWidth(double width);
+
+  /** Returns the output sample rate. */
+  inline double outputSampleRate() const { return _Fs/_decim; }
+  /** Sets the minimum output sample rate, reconfigures the node if already configured. The
+   * queue must be stopped. */
+  void setOutputSampleRate(double oFs);
+
+  virtual void config(const sdr::Config &src_cfg);
+  virtual void process(const sdr::Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite);
+
+protected:
+  /** Computes the decimation, designs the taps and propagates the output config. */
+  void _configure();
+  /** Designs the complex band-pass taps at the output rate, the lock must be held. */
+  void _design();
+
+protected:
+  /** The oscillator shifting the center frequency to 0. */
+  NCO _nco;
+  /** Filter frequency and width. */
+  double _Ff, _width;
+  /** Number of filter taps. */
+  size_t _order;
+  /** Minimum output sample rate. */
+  double _oFs;
+  /** Input sample rate and buffer size. */
+  double _Fs;
+  size_t _bufferSize;
+  /** Decimation factor and number of samples summed for the next output sample. */
+  size_t _decim, _decim_count;
+  /** Running sum of the mixed samples. */
+  std::complex<float> _acc;
+  /** Guards the taps and the delay line. */
+  std::mutex _lock;
+  /** Band-pass taps and the doubled delay line of the decimated signal. */
+  std::vector< std::complex<float> > _taps;
+  std::vector< std::complex<float> > _delay;
+  size_t _delay_idx;
+  /** Mixer output of a block. */
+  std::vector< std::complex<int16_t> > _mixed;
+  /** The output buffer. */
+  sdr::Buffer< std::complex<int16_t> > _buffer;
+};
+
+#endif // __SDR_RX_CHANNELFILTER_HH__
@@ -0,0 +1,342 @@
+#include "controlserver.hh"
+#include "receiver.hh"
+#include "source.hh"
+#include "demodulator.hh"
+#include "logger.hh"
+
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace sdr;
+
+
+/** Names of the demodulators, indexed by @c DemodulatorCtrl::Demod. */
+static const char *demod_names[] = { "am", "wfm", "nfm", "usb", "lsb", "cw", "bpsk31" };
+static const size_t num_demods = sizeof(demod_names)/sizeof(demod_names[0]);
+
+/** Returns the current time in ms. */
+static inline int64_t
+now_ms() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of ControlServer
+ * ******************************************************************************************** */
+ControlServer::ControlServer(Receiver *receiver, DataSourceCtrl *src, DemodulatorCtrl *demod)
+  : QObject(receiver), _receiver(receiver), _src(src), _demod(demod), _socket(-1), _path(),
+    _running(false), _status_lock(), _status_ready(), _status_line(), _status_requested(0),
+    _status_serial(0), _commands(256), _boundary(this)
+{
+  // pass...
+}
+
+ControlServer::~ControlServer() {
+  stop();
+}
+
+bool
+ControlServer::start(const QString &path) {
+  stop();
+
+  std::string spath = path.toStdString();
+  struct sockaddr_un addr; memset(&addr, 0, sizeof(addr));
+  if (spath.size() >= sizeof(addr.sun_path)) {
+    LogMessage msg(LOG_ERROR);
+    msg << "Control server: Socket path too long: " << spath;
+    Logger::get().log(msg);
+    return false;
+  }
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, spath.c_str(), sizeof(addr.sun_path)-1);
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (0 > sock) {
+    LogMessage msg(LOG_ERROR);
+    msg << "Control server: Can not create socket: " << strerror(errno);
+    Logger::get().log(msg);
+    return false;
+  }
+  // Remove stale socket of a previous instance, but never any other file at the given path
+  struct stat info;
+  if ((0 == lstat(spath.c_str(), &info)) && S_ISSOCK(info.st_mode)) {
+    unlink(spath.c_str());
+  }
+  if ((0 != bind(sock, (struct sockaddr *)&addr, sizeof(addr))) || (0 != listen(sock, 4))) {
+    LogMessage msg(LOG_ERROR);
+    msg << "Control server: Can not listen on " << spath << ": " << strerror(errno);
+    Logger::get().log(msg);
+    ::close(sock);
+    return false;
+  }
+
+  _socket = sock; _path = path; _running = true;
+  _thread = std::thread(&ControlServer::_serve, this);
+
+  LogMessage msg(LOG_INFO);
+  msg << "Control server listening on " << spath;
+  Logger::get().log(msg);
+  return true;
+}
+
+void
+ControlServer::stop() {
+  if (! _running) { return; }
+  _running = false;
+  if (_thread.joinable()) { _thread.join(); }
+  for (std::list<Client>::iterator client=_clients.begin(); client!=_clients.end(); client++) {
+    ::close(client->socket);
+  }
+  _clients.clear();
+  ::close(_socket); _socket = -1;
+  unlink(_path.toStdString().c_str());
+}
+
+void
+ControlServer::_serve() {
+  std::vector<struct pollfd> fds;
+  char data[4096];
+  while (_running) {
+    // Wait at most until the next status update is due
+    int64_t now = now_ms(), timeout = 200;
+    for (std::list<Client>::iterator client=_clients.begin(); client!=_clients.end(); client++) {
+      if (client->period) { timeout = std::min(timeout, std::max(int64_t(0), client->next-now)); }
+    }
+
+    fds.resize(1+_clients.size());
+    fds[0].fd = _socket; fds[0].events = POLLIN; fds[0].revents = 0;
+    size_t i = 1;
+    for (std::list<Client>::iterator client=_clients.begin(); client!=_clients.end(); client++, i++) {
+      fds[i].fd = client->socket; fds[i].events = POLLIN; fds[i].revents = 0;
+    }
+    if (0 > poll(&fds[0], fds.size(), timeout)) { continue; }
+
+    // Serve clients
+    now = now_ms(); i = 1;
+    std::list<Client>::iterator client = _clients.begin();
+    while (client != _clients.end()) {
+      bool alive = true;
+      if (fds[i++].revents & (POLLIN|POLLHUP|POLLERR)) {
+        ssize_t n = recv(client->socket, data, sizeof(data), MSG_DONTWAIT);
+        if (0 >= n) {
+          alive = false;
+        } else {
+          client->buffer.append(data, n);
+          size_t eol;
+          while (alive && (std::string::npos != (eol = client->buffer.find('\n')))) {
+            std::string line = client->buffer.substr(0, eol);
+            client->buffer.erase(0, eol+1);
+            std::string reply;
+            // Subscriptions are handled here, all other requests by _handle
+            if (0 == line.compare(0, 9, "subscribe")) {
+              int period = atoi(line.c_str()+9);
+              client->period = (period > 0) ? std::max(10, period) : 0;
+              client->next = now;
+              reply = "OK\n";
+            } else {
+              reply = _handle(line);
+            }
+            alive = (ssize_t(reply.size()) == ::send(client->socket, reply.c_str(), reply.size(),
+                                                     MSG_NOSIGNAL));
+          }
+          // Protect against clients sending garbage without line breaks
+          if (client->buffer.size() > 1024) { alive = false; }
+        }
+      }
+      if (alive && client->period && (client->next <= now)) {
+        std::string status = _status();
+        alive = (ssize_t(status.size()) == ::send(client->socket, status.c_str(), status.size(),
+                                                  MSG_NOSIGNAL|MSG_DONTWAIT));
+        client->next = now + client->period;
+      }
+      if (alive) { client++; continue; }
+      ::close(client->socket);
+      client = _clients.erase(client);
+    }
+
+    // Accept new clients
+    if (fds[0].revents & POLLIN) {
+      int sock = accept(_socket, 0, 0);
+      if (0 <= sock) {
+        Client client; client.socket = sock; client.period = 0; client.next = 0;
+        _clients.push_back(client);
+      }
+    }
+  }
+}
+
+std::string
+ControlServer::_handle(const std::string &line) {
+  std::istringstream stream(line);
+  std::string cmd, arg;
+  stream >> cmd >> arg;
+  if (cmd.empty()) { return "ERR empty request\n"; }
+  if ("status" == cmd) { return _status(); }
+  if ("latency" == cmd) { return _latency(""); }
+  if ("histogram" == cmd) { return arg.empty() ? "ERR missing argument\n" : _latency(arg); }
+
+  // Commands without argument
+  if (("start" == cmd) || ("stop" == cmd)) {
+    QMetaObject::invokeMethod(this, "_execute", Qt::QueuedConnection,
+                              Q_ARG(QString, QString::fromStdString(cmd)), Q_ARG(QString, QString()));
+    return "OK\n";
+  }
+
+  if (arg.empty()) { return "ERR missing argument\n"; }
+  if ("demod" == cmd) {
+    size_t i=0;
+    while ((i<num_demods) && (arg != demod_names[i])) { i++; }
+    if (num_demods == i) { return "ERR unknown demodulator\n"; }
+  } else {
+    char *end = 0;
+    double value = strtod(arg.c_str(), &end);
+    if (*end) { return "ERR invalid argument\n"; }
+    // Fast commands get applied by the processing thread, if it is running
+    if ((("tune" == cmd) || ("center" == cmd) || ("filter" == cmd)) && _receiver->isRunning()) {
+      Command command; command.value = value;
+      if ("tune" == cmd) { command.type = Command::TUNE; }
+      else if ("center" == cmd) { command.type = Command::CENTER; }
+      else { command.type = Command::FILTER; }
+      if (! _commands.put(command)) { return "ERR busy\n"; }
+      return "OK\n";
+    }
+    if (("tune" != cmd) && ("center" != cmd) && ("filter" != cmd) && ("width" != cmd) &&
+        ("agc" != cmd) && ("gain" != cmd) && ("tunergain" != cmd)) {
+      return "ERR unknown command\n";
+    }
+  }
+
+  QMetaObject::invokeMethod(this, "_execute", Qt::QueuedConnection,
+                            Q_ARG(QString, QString::fromStdString(cmd)),
+                            Q_ARG(QString, QString::fromStdString(arg)));
+  return "OK\n";
+}
+
+void
+ControlServer::_execute(QString command, QString arg) {
+  if ("start" == command) { _receiver->start(); }
+  else if ("stop" == command) { _receiver->stop(); }
+  else if ("tune" == command) { _src->tune(arg.toDouble()); }
+  else if ("center" == command) { _demod->setCenterFreq(arg.toDouble()); }
+  else if ("filter" == command) { _demod->setFilterFrequency(arg.toDouble()); }
+  else if ("width" == command) { _demod->setFilterWidth(arg.toDouble()); }
+  else if ("agc" == command) { _demod->enableAGC(0 != arg.toDouble()); }
+  else if ("gain" == command) { _demod->setGain(arg.toDouble()); }
+  else if ("tunergain" == command) { _src->setTunerGain(arg.toDouble()); }
+  else if ("demod" == command) {
+    for (size_t i=0; i<num_demods; i++) {
+      if (arg == demod_names[i]) { _demod->setDemod(DemodulatorCtrl::Demod(i)); }
+    }
+  }
+}
+
+std::string
+ControlServer::_status() {
+  // The state of the receiver is owned by the GUI thread, hence request a status line from there
+  // and wait for it. Waiting gets interrupted if the server gets stopped, as stop() is called
+  // from the GUI thread too.
+  std::unique_lock<std::mutex> lock(_status_lock);
+  uint64_t request = ++_status_requested;
+  lock.unlock();
+  QMetaObject::invokeMethod(this, "_updateStatus", Qt::QueuedConnection);
+  lock.lock();
+  while ((_status_serial < request) && _running) {
+    _status_ready.wait_for(lock, std::chrono::milliseconds(100));
+  }
+  if (_status_serial < request) { return "ERR stopped\n"; }
+  return _status_line;
+}
+
+void
+ControlServer::_updateStatus() {
+  std::ostringstream status;
+  status << "STATUS running=" << (_receiver->isRunning() ? 1 : 0)
+         << " tuner=" << _src->tunerFrequency()
+         << " center=" << _demod->centerFreq()
+         << " filter=" << _demod->filterFrequency()
+         << " width=" << _demod->filterWidth()
+         << " demod=" << demod_names[_demod->demodType()]
+         << " agc=" << (_demod->isAGCEnabled() ? 1 : 0)
+         << " gain=" << _demod->gain()
+         << " level=" << _demod->signalLevel()
+         << " blanked=" << _demod->blankedSamples()
+         << " dropped=" << _src->droppedSamples()
+         << " load=" << _receiver->latency().cpuLoad()
+         << " pending=" << _commands.stored() << "\n";
+  // Answers all requests made so far
+  std::lock_guard<std::mutex> lock(_status_lock);
+  _status_line = status.str();
+  _status_serial = _status_requested;
+  _status_ready.notify_all();
+}
+
+std::string
+ControlServer::_latency(const std::string &stage) const {
+  // Statistics are read while the processing thread updates them, values may be off by one
+  const std::vector<LatencyProbe *> &probes = _receiver->latency().probes();
+  std::ostringstream reply;
+  if (stage.empty()) {
+    reply << "LATENCY";
+    for (size_t i=0; i<probes.size(); i++) {
+      reply << " " << probes[i]->name() << "=" << probes[i]->count() << ","
+            << probes[i]->mean() << "," << probes[i]->quantile(0.5) << ","
+            << probes[i]->quantile(0.99) << "," << probes[i]->max();
+    }
+    reply << "\n";
+    return reply.str();
+  }
+  for (size_t i=0; i<probes.size(); i++) {
+    if (stage != probes[i]->name()) { continue; }
+    std::vector<size_t> bins; probes[i]->histogram(bins);
+    reply << "HISTOGRAM";
+    for (size_t j=0; j<bins.size(); j++) { reply << " " << bins[j]; }
+    reply << "\n";
+    return reply.str();
+  }
+  return "ERR unknown stage\n";
+}
+
+void
+ControlServer::_applyCommands() {
+  // Coalesce pending commands, only the last one of each type is applied
+  Command command;
+  bool tune=false, center=false, filter=false;
+  double tuneValue=0, centerValue=0, filterValue=0;
+  while (_commands.take(&command, 1)) {
+    switch (command.type) {
+    case Command::TUNE: tune = true; tuneValue = command.value; break;
+    case Command::CENTER: center = true; centerValue = command.value; break;
+    case Command::FILTER: filter = true; filterValue = command.value; break;
+    }
+  }
+  if (tune) { _src->tune(tuneValue); }
+  if (center) { _demod->tuneCenterFreq(centerValue); }
+  if (filter) { _demod->setFilterFrequency(filterValue); }
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of ControlServer::Boundary
+ * ******************************************************************************************** */
+ControlServer::Boundary::Boundary(ControlServer *server)
+  : Proxy(), _server(server)
+{
+  // pass...
+}
+
+void
+ControlServer::Boundary::handleBuffer(const RawBuffer &buffer, bool allow_overwrite) {
+  _server->_applyCommands();
+  Proxy::handleBuffer(buffer, allow_overwrite);
+}
@@ -0,0 +1,148 @@
+#ifndef __SDR_RX_CONTROLSERVER_HH__
+#define __SDR_RX_CONTROLSERVER_HH__
+
+#include <QObject>
+#include <QString>
+
+#include "lockfreering.hh"
+#include "node.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Forward declarations
+class Receiver;
+class DataSourceCtrl;
+class DemodulatorCtrl;
+
+
+/** A line based control interface on a local (Unix domain) socket.
+ *
+ * Each request is a single line consisting of a command and its argument, each request gets
+ * answered by a single line, either "OK" or "ERR <reason>". The commands are
+ * @code
+ *  tune <Hz>        Retunes the tuner of the source.
+ *  center <Hz>      Sets the center (VFO) frequency relative to the tuner.
+ *  filter <Hz>      Sets the filter offset relative to the center frequency.
+ *  width <Hz>       Sets the filter width.
+ *  demod <name>     Selects the demodulator (am, wfm, nfm, usb, lsb, cw, bpsk31).
+ *  agc <0|1>        Disables or enables the AGC.
+ *  gain <dB>        Sets the gain of the demodulator (AGC disabled).
+ *  tunergain <val>  Sets the tuner gain in tenth of dB.
+ *  start, stop      Starts or stops the receiver.
+ *  status           Answers with a single status line.
+ *  subscribe <ms>   Sends a status line periodically (0 unsubscribes).
+ *  latency          Answers with the latency statistics of all stages.
+ *  histogram <stage> Answers with the latency histogram of the given stage.
+ * @endcode
+ * A status line has the form "STATUS key=value ...", the key @c load is the CPU time in ms spent
+ * per second of input (see @c LatencyMonitor::cpuLoad). The latency statistics have the form
+ * "LATENCY stage=count,mean,p50,p99,max ..." (in ms) and a histogram has the form
+ * "HISTOGRAM bin0 bin1 ...", see @c LatencyProbe::histogram.
+ *
+ * All clients are served by a single thread. The frequent commands @c tune, @c center and
+ * @c filter are passed through a lock-free queue and applied at buffer boundaries by the node
+ * returned by @c boundary, which passes the input of the demodulator. Hence they get applied in
+ * whichever thread delivers the buffers, the queue or a capture thread. Pending retunes get coalesced, only the last one gets
+ * applied. All other commands may reconfigure the processing chain and are therefore executed in
+ * the thread of the GUI. The reply is sent once the request got queued. Status lines are assembled
+ * in the thread of the GUI too, as they read its state. */
+class ControlServer: public QObject
+{
+  Q_OBJECT
+
+protected:
+  /** A fast command applied at a buffer boundary. */
+  typedef struct {
+    enum { TUNE, CENTER, FILTER } type;
+    double value;
+  } Command;
+
+  /** State of a connected client. */
+  typedef struct {
+    int socket;
+    /** Received but not yet processed data. */
+    std::string buffer;
+    /** Status period in ms or 0. */
+    int period;
+    /** Time of the next status update in ms. */
+    int64_t next;
+  } Client;
+
+  /** Passes the buffers unchanged, applies the pending fast commands ahead of each buffer. */
+  class Boundary: public sdr::Proxy
+  {
+  public:
+    Boundary(ControlServer *server);
+    virtual void handleBuffer(const sdr::RawBuffer &buffer, bool allow_overwrite);
+
+  protected:
+    ControlServer *_server;
+  };
+
+public:
+  ControlServer(Receiver *receiver, DataSourceCtrl *src, DemodulatorCtrl *demod);
+  virtual ~ControlServer();
+
+  /** Listens on the given socket path. Returns @c false on error. */
+  bool start(const QString &path);
+  /** Stops the server and disconnects all clients. */
+  void stop();
+  /** Returns @c true if the server is listening. */
+  inline bool isRunning() const { return _running; }
+  /** Returns the socket path. */
+  inline const QString &path() const { return _path; }
+  /** Returns the node applying the fast commands, it must be connected directly ahead of the
+   * demodulator input. */
+  inline sdr::Proxy *boundary() { return &_boundary; }
+
+protected slots:
+  /** Executes a command in the GUI thread. */
+  void _execute(QString command, QString arg);
+  /** Assembles a status line in the GUI thread and answers pending status requests. */
+  void _updateStatus();
+
+protected:
+  /** The server loop. */
+  void _serve();
+  /** Handles a single request, returns the reply. */
+  std::string _handle(const std::string &line);
+  /** Requests a status line from the GUI thread and waits for it. */
+  std::string _status();
+  /** Assembles the latency statistics or the histogram of a stage. */
+  std::string _latency(const std::string &stage) const;
+  /** Applies pending fast commands, called by the boundary node ahead of each buffer. */
+  void _applyCommands();
+
+protected:
+  Receiver *_receiver;
+  DataSourceCtrl *_src;
+  DemodulatorCtrl *_demod;
+  /** Listening socket. */
+  int _socket;
+  QString _path;
+  std::atomic<bool> _running;
+  std::thread _thread;
+  /** Protects the status line and the request counters. */
+  std::mutex _status_lock;
+  /** Signals an updated status line. */
+  std::condition_variable _status_ready;
+  /** The last status line assembled by the GUI thread. */
+  std::string _status_line;
+  /** Number of status requests made by the server thread. */
+  uint64_t _status_requested;
+  /** Number of status requests answered by @c _status_line. */
+  uint64_t _status_serial;
+  /** Connected clients, only accessed by the server thread. */
+  std::list<Client> _clients;
+  /** Fast commands for the thread delivering the buffers. */
+  LockFreeRing<Command> _commands;
+  /** Applies the fast commands at buffer boundaries. */
+  Boundary _boundary;
+};
+
+#endif // __SDR_RX_CONTROLSERVER_HH__
@@ -3,10 +3,19 @@
 
 #include <QPainter>
 #include <QPaintEvent>
+#include <QMouseEvent>
+#include <QSplitter>
+#include <QWheelEvent>
+#include <QImage>
+#include <QDateTime>
 #include <QComboBox>
 #include <QTimer>
 #include <QFormLayout>
 #include <QTextEdit>
+#include <QTextCursor>
+#include <QTextDocument>
+
+#include <algorithm>
 
 
 using namespace sdr;
@@ -66,6 +75,36 @@ DemodulatorCtrlConfig::storeAgcTau(double tau) {
   _config.setValue("BaseBand/agcTau", tau);
 }
 
+int
+DemodulatorCtrlConfig::agcMode() const {
+  return _config.value("BaseBand/agcMode", 0).toInt();
+}
+
+void
+DemodulatorCtrlConfig::storeAgcMode(int mode) {
+  _config.setValue("BaseBand/agcMode", mode);
+}
+
+double
+DemodulatorCtrlConfig::agcAttack() const {
+  return _config.value("BaseBand/agcAttack", 0.002).toDouble();
+}
+
+void
+DemodulatorCtrlConfig::storeAgcAttack(double attack) {
+  _config.setValue("BaseBand/agcAttack", attack);
+}
+
+double
+DemodulatorCtrlConfig::agcHang() const {
+  return _config.value("BaseBand/agcHang", 0.25).toDouble();
+}
+
+void
+DemodulatorCtrlConfig::storeAgcHang(double hang) {
+  _config.setValue("BaseBand/agcHang", hang);
+}
+
 double
 DemodulatorCtrlConfig::gain() const {
   return _config.value("BaseBand/gain", 1.0).toDouble();
@@ -76,6 +115,36 @@ DemodulatorCtrlConfig::storeGain(double gain) {
   _config.setValue("BaseBand/gain", gain);
 }
 
+bool
+DemodulatorCtrlConfig::noiseBlankerEnabled() const {
+  return _config.value("BaseBand/nbEnabled", false).toBool();
+}
+
+void
+DemodulatorCtrlConfig::storeNoiseBlankerEnabled(bool enabled) {
+  _config.setValue("BaseBand/nbEnabled", enabled);
+}
+
+double
+DemodulatorCtrlConfig::noiseBlankerThreshold() const {
+  return _config.value("BaseBand/nbThreshold", 8.0).toDouble();
+}
+
+void
+DemodulatorCtrlConfig::storeNoiseBlankerThreshold(double threshold) {
+  _config.setValue("BaseBand/nbThreshold", threshold);
+}
+
+unsigned int
+DemodulatorCtrlConfig::historyBudget() const {
+  return _config.value("Spectrum/historyBudget", 64).toUInt();
+}
+
+void
+DemodulatorCtrlConfig::storeHistoryBudget(unsigned int mb) {
+  _config.setValue("Spectrum/historyBudget", mb);
+}
+
 
 
 
@@ -83,27 +152,44 @@ DemodulatorCtrlConfig::storeGain(double gain) {
  * Implementation of DemodulatorCtrl
  * ******************************************************************************************** */
 DemodulatorCtrl::DemodulatorCtrl(Receiver *receiver) :
-  gui::Spectrum(2, 1024, 5, receiver), _receiver(receiver), _demodObj(0), _config()
+  gui::Spectrum(2, 1024, 5, receiver), _receiver(receiver), _demodObj(0), _demodType(DEMOD_USB),
+  _outputRate(16000), _traces(), _history(), _zoom(0), _config()
 {
   // Assemble processing chain
+  _blanker = new NoiseBlanker(_config.noiseBlankerThreshold());
   _agc = new AGC< std::complex<int16_t> >();
-  _filter_node = new IQBaseBand<int16_t>(_config.centerFrequency(), 2000,
-                                         _config.filterOrder(), 1, 16000.0);
+  // Shifts the center frequency, filters and decimates in one pass
+  _filter_node = new ChannelFilter(_config.centerFrequency(), 0, 2000, _config.filterOrder(),
+                                   16000.0);
+  _channel_agc = new ChannelAGC(_config.agcAttack(), _config.agcTau(), _config.agcHang());
   _audio_source = new sdr::Proxy();
 
+  _blanker->connect(_agc, true);
+  _blanker->enable(_config.noiseBlankerEnabled());
   _agc->connect(_filter_node, true);
+  _filter_node->connect(_channel_agc, true);
   _agc->connect(this);
-  _agc->enable(_config.agcEnabled());
+  // High resolution spectrum of the channel, reuses the decimated output of the filter node
+  _zoom = new gui::Spectrum(2, 4096, 5, this);
+  _filter_node->connect(_zoom);
   _agc->setTau(_config.agcTau());
   _agc->setGain(_config.gain());
+  _agcMode = (AGC_CHANNEL == _config.agcMode()) ? AGC_CHANNEL : AGC_WIDEBAND;
+  enableAGC(_config.agcEnabled());
+
+  _history.setBudget(size_t(_config.historyBudget())*1024*1024);
+  // Update traces and history with every new spectrum
+  QObject::connect(this, SIGNAL(spectrumUpdated()), this, SLOT(_onSpectrumUpdated()));
 
   setDemod(DEMOD_USB);
 }
 
 
 DemodulatorCtrl::~DemodulatorCtrl() {
+  delete _blanker;
   delete _agc;
   delete _filter_node;
+  delete _channel_agc;
   delete _audio_source;
   if (_demodObj) {
     delete _demodObj;
@@ -117,11 +203,13 @@ DemodulatorCtrl::receiver() const {
 
 bool
 DemodulatorCtrl::isAGCEnabled() const {
-  return _agc->enabled();
+  return _agc->enabled() || _channel_agc->enabled();
 }
 
 double
 DemodulatorCtrl::gain() const {
+  // The fixed gain ahead of the filter node applies in channel mode too
+  if (_channel_agc->enabled()) { return 20*std::log10(_agc->gain()) + _channel_agc->gaindB(); }
   return 20*std::log10(_agc->gain());
 }
 
@@ -140,41 +228,122 @@ DemodulatorCtrl::agcTime() const {
 void
 DemodulatorCtrl::setAGCTime(double tau) {
   _agc->setTau(tau);
+  _channel_agc->setDecay(tau);
   _config.storeAgcTau(tau);
 }
 
+double
+DemodulatorCtrl::agcAttack() const {
+  return _channel_agc->attack();
+}
+
+void
+DemodulatorCtrl::setAGCAttack(double attack) {
+  _channel_agc->setAttack(attack);
+  _config.storeAgcAttack(attack);
+}
+
+double
+DemodulatorCtrl::agcHang() const {
+  return _channel_agc->hang();
+}
+
+void
+DemodulatorCtrl::setAGCHang(double hang) {
+  _channel_agc->setHang(hang);
+  _config.storeAgcHang(hang);
+}
+
+void
+DemodulatorCtrl::setAGCMode(AGCMode mode) {
+  bool enabled = isAGCEnabled();
+  _agcMode = mode;
+  _config.storeAgcMode(int(mode));
+  enableAGC(enabled);
+}
 
 void
 DemodulatorCtrl::enableAGC(bool enable) {
-  _agc->enable(enable);
+  // Without the wideband AGC, its fixed gain applies
+  _agc->enable(enable && (AGC_WIDEBAND == _agcMode));
+  _channel_agc->enable(enable && (AGC_CHANNEL == _agcMode));
   _config.storeAgcEnabled(enable);
 }
 
+bool
+DemodulatorCtrl::isNoiseBlankerEnabled() const {
+  return _blanker->enabled();
+}
+
+void
+DemodulatorCtrl::enableNoiseBlanker(bool enable) {
+  _blanker->enable(enable);
+  _config.storeNoiseBlankerEnabled(enable);
+}
+
+double
+DemodulatorCtrl::noiseBlankerThreshold() const {
+  return _blanker->threshold();
+}
+
+void
+DemodulatorCtrl::setNoiseBlankerThreshold(double threshold) {
+  _blanker->setThreshold(threshold);
+  _config.storeNoiseBlankerThreshold(_blanker->threshold());
+}
+
+void
+DemodulatorCtrl::connectLatencyProbes(LatencyMonitor *monitor) {
+  _agc->connect(monitor->probe("agc"), true);
+  _filter_node->connect(monitor->probe("baseband"), true);
+  _channel_agc->connect(monitor->probe("channel agc"), true);
+  _audio_source->connect(monitor->probe("demod"), true);
+}
+
+double
+DemodulatorCtrl::signalLevel() const {
+  return _blanker->level();
+}
+
+size_t
+DemodulatorCtrl::blankedSamples() const {
+  return _blanker->blankedSamples();
+}
+
 void
 DemodulatorCtrl::setCenterFreq(double f) {
-  double dF = this->filterFrequency();
-  _filter_node->setCenterFrequency(f);
+  tuneCenterFreq(f);
   _config.storeCenterFrequency(f);
-  this->setFilterFrequency(dF);
+}
+
+void
+DemodulatorCtrl::tuneCenterFreq(double f) {
+  // Only changes the phase increment of the oscillator, the filter is relative to the center
+  _filter_node->setCenterFrequency(f);
+  emit filterChanged();
 }
 
 void
 DemodulatorCtrl::setFilterFrequency(double f) {
-  _filter_node->setFilterFrequency(_filter_node->centerFrequency() + f);
+  // Avoid redesigning the filter if unchanged
+  if (f != _filter_node->filterFrequency()) { _filter_node->setFilterFrequency(f); }
   emit filterChanged();
 }
 
 void
 DemodulatorCtrl::setFilterWidth(double w) {
-  _filter_node->setFilterWidth(w);
-
-  bool was_running = _receiver->isRunning();
-  if (was_running) { _receiver->stop(); }
-  // Update resampling of IQBaseBand node. Ensures that the output sample-rate is at least
+  // Update resampling of the channel filter. Ensures that the output sample-rate is at least
   // filter width and >= 8000 Hz
   double oFs = std::max(w, 8000.0);
-  _filter_node->setOutputSampleRate(oFs);
-  if (was_running) { _receiver->start(); }
+  // Avoid redesigning the filter and restarting the queue if nothing changed
+  if (w != _filter_node->filterWidth()) { _filter_node->setFilterWidth(w); }
+  if (oFs != _outputRate) {
+    bool was_running = _receiver && _receiver->isRunning();
+    if (was_running) { _receiver->stop(); }
+    _filter_node->setOutputSampleRate(oFs);
+    _outputRate = oFs;
+    if (was_running) { _receiver->start(); }
+  }
 
   emit filterChanged();
 }
@@ -182,12 +351,12 @@ DemodulatorCtrl::setFilterWidth(double w) {
 
 void
 DemodulatorCtrl::setDemod(Demod demod) {
-  bool was_running = _receiver->isRunning();
+  bool was_running = _receiver && _receiver->isRunning();
   if (was_running) { _receiver->stop(); }
 
   // Unlink current demodulator
   if (_demodObj) {
-    _filter_node->disconnect(_demodObj->sink());
+    _channel_agc->disconnect(_demodObj->sink());
     _demodObj->audioSource()->disconnect(_audio_source);
     delete _demodObj; _demodObj = 0;
   }
@@ -201,9 +370,10 @@ DemodulatorCtrl::setDemod(Demod demod) {
   case DEMOD_CW:     _demodObj = new CWDemodulator(this); break;
   case DEMOD_BPSK31: _demodObj = new BPSK31Demodulator(this); break;
   }
+  _demodType = demod;
 
   // Link new demodulator
-  _filter_node->connect(_demodObj->sink());
+  _channel_agc->connect(_demodObj->sink());
   _demodObj->audioSource()->connect(_audio_source);
 
   // Restart queue if it was running...
@@ -219,10 +389,41 @@ DemodulatorCtrl::createCtrlView() {
 
 QWidget *
 DemodulatorCtrl::createSpectrumView() {
-  //DemodulatorSpectrumView *view = new DemodulatorSpectrumView(this);
+  // Traces and zoom spectrum above the waterfall
+  QSplitter *splitter = new QSplitter(Qt::Vertical);
+  QSplitter *top = new QSplitter(Qt::Horizontal);
+  DemodulatorSpectrumView *spectrum = new DemodulatorSpectrumView(this);
+  gui::SpectrumView *zoom = new gui::SpectrumView(_zoom);
+  zoom->setNumXTicks(5);
+  zoom->setMinimumWidth(320);
   DemodulatorWaterFallView *view = new DemodulatorWaterFallView(this);
   QObject::connect(view, SIGNAL(click(double)), this, SLOT(setCenterFreq(double)));
-  return view;
+  top->addWidget(spectrum);
+  top->addWidget(zoom);
+  top->setStretchFactor(0, 2);
+  top->setStretchFactor(1, 1);
+  splitter->addWidget(top);
+  splitter->addWidget(view);
+  splitter->setStretchFactor(1, 1);
+  return splitter;
+}
+
+void
+DemodulatorCtrl::resetTraces() {
+  _traces.reset();
+}
+
+void
+DemodulatorCtrl::setHistoryBudget(unsigned int mb) {
+  _history.setBudget(size_t(mb)*1024*1024);
+  _config.storeHistoryBudget(mb);
+}
+
+void
+DemodulatorCtrl::_onSpectrumUpdated() {
+  _traces.update(reinterpret_cast<const double *>(spectrum().data()), spectrum().size());
+  // The history stores the spectrum already converted to dB
+  _history.add(_traces.current().data(), _traces.size(), QDateTime::currentMSecsSinceEpoch());
 }
 
 
@@ -242,19 +443,63 @@ DemodulatorSpectrumView::~DemodulatorSpectrumView() {
   // pass...
 }
 
+void
+DemodulatorSpectrumView::mouseDoubleClickEvent(QMouseEvent *evt) {
+  _demodulator->resetTraces();
+  evt->accept();
+}
+
 
 void
 DemodulatorSpectrumView::paintEvent(QPaintEvent *evt) {
-  gui::SpectrumView::paintEvent(evt);
-
+  // The traces are drawn instead of the plain spectrum, they are already in dB
   QPainter painter(this);
   painter.setRenderHint(QPainter::Antialiasing);
   painter.save();
 
   // Clip region to update
   painter.setClipRect(evt->rect());
-  // Clip plot area
+  painter.fillRect(rect(), Qt::white);
+
+  const SpectrumTraces &traces = _demodulator->traces();
+  _plotArea = rect().adjusted(40, 5, -5, -5);
+
+  // Determine dB range from the traces, in steps of 10 dB
+  float maxdB = -100, mindB = 0;
+  if (traces.size()) {
+    maxdB = *std::max_element(traces.peak().begin(), traces.peak().end());
+    mindB = *std::min_element(traces.average().begin(), traces.average().end());
+  }
+  maxdB = 10*std::ceil(maxdB/10); mindB = std::min(10*std::floor(mindB/10), maxdB-10);
+  double dydB = _plotArea.height()/(maxdB-mindB);
+
+  // Draw grid & labels
+  painter.setPen(QPen(Qt::lightGray, 1));
+  for (float dB=mindB; dB<=maxdB; dB+=10) {
+    double y = _plotArea.bottom()-(dB-mindB)*dydB;
+    painter.drawLine(_plotArea.left(), y, _plotArea.right(), y);
+    painter.drawText(QRect(0, y-8, 36, 16), Qt::AlignRight|Qt::AlignVCenter, QString::number(dB));
+  }
+
+  // Draw min-hold, average and peak-hold traces
   painter.setClipRect(_plotArea);
+  size_t N = traces.size(), M = _demodulator->isInputReal() ? N/2 : N;
+  if (M > 1) {
+    const std::vector<float> *trace[] = { &traces.minimum(), &traces.average(), &traces.peak() };
+    QColor colors[] = { QColor(160,160,160), QColor(0,0,0), QColor(255,0,0) };
+    double dxdi = double(_plotArea.width())/(M-1);
+    QPolygonF line(M);
+    for (size_t t=0; t<3; t++) {
+      for (size_t i=0; i<M; i++) {
+        // Complex input: Negative frequencies are stored in the upper half
+        size_t bin = _demodulator->isInputReal() ? i : ((i+N/2) % N);
+        line[i] = QPointF(_plotArea.left()+i*dxdi,
+                          _plotArea.bottom()-((*trace[t])[bin]-mindB)*dydB);
+      }
+      painter.setPen(QPen(colors[t], 1));
+      painter.drawPolyline(line);
+    }
+  }
 
   // Draw a thin line at the center frequency
   QPen pen(QBrush(Qt::black), 1);
@@ -291,9 +536,18 @@ DemodulatorSpectrumView::paintEvent(QPaintEvent *evt) {
  * Implementation of DemodulatorWaterFallView
  * ******************************************************************************************** */
 DemodulatorWaterFallView::DemodulatorWaterFallView(DemodulatorCtrl *demodulator)
-  : gui::WaterFallView(demodulator, 200, BOTTOM_UP), _demodulator(demodulator)
+  : gui::WaterFallView(demodulator, 200, BOTTOM_UP), _demodulator(demodulator), _level(0),
+    _scrollback(0), _colors(256)
 {
   setMinimumWidth(640);
+  // Color table of the history: black - blue - cyan - yellow - red
+  for (int i=0; i<256; i++) {
+    double v = i/255.;
+    int r = int(255*std::max(0.0, std::min(1.0, 4*v-2)));
+    int g = int(255*std::max(0.0, std::min(1.0, (v < 0.75) ? (4*v-1) : (4-4*v))));
+    int b = int(255*std::max(0.0, std::min(1.0, (v < 0.5) ? (4*v) : (3-4*v))));
+    _colors[i] = qRgb(r, g, b);
+  }
   QObject::connect(demodulator, SIGNAL(filterChanged()), this, SLOT(update()));
 }
 
@@ -304,7 +558,9 @@ DemodulatorWaterFallView::~DemodulatorWaterFallView() {
 
 void
 DemodulatorWaterFallView::paintEvent(QPaintEvent *evt) {
-  gui::WaterFallView::paintEvent(evt);
+  if ((0 == _level) && (0 == _scrollback)) {
+    gui::WaterFallView::paintEvent(evt);
+  }
 
   QPainter painter(this);
   painter.setRenderHint(QPainter::Antialiasing);
@@ -312,6 +568,10 @@ DemodulatorWaterFallView::paintEvent(QPaintEvent *evt) {
   // Clip region to update
   painter.setClipRect(evt->rect());
 
+  if (_level || _scrollback) {
+    _paintHistory(painter);
+  }
+
   painter.save();
 
   // Draw a thin line at the center frequency
@@ -351,6 +611,56 @@ DemodulatorWaterFallView::paintEvent(QPaintEvent *evt) {
   painter.restore();
 }
 
+void
+DemodulatorWaterFallView::wheelEvent(QWheelEvent *evt) {
+  const WaterfallHistory &history = _demodulator->history();
+  int steps = evt->angleDelta().y()/120;
+  if (evt->modifiers() & Qt::ControlModifier) {
+    // Zoom out (up) or in (down), keep the time position
+    int level = std::max(0, std::min(int(WaterfallHistory::NumLevels)-1, int(_level)+steps));
+    if (size_t(level) > _level) { _scrollback >>= (level-_level); }
+    else { _scrollback <<= (_level-level); }
+    _level = level;
+  } else {
+    // Scroll back (up) or forward (down) by 10 rows per step
+    int rows = int(_scrollback) + 10*steps;
+    int maxRows = std::max(0, int(history.rows(_level))-height());
+    _scrollback = size_t(std::max(0, std::min(maxRows, rows)));
+  }
+  evt->accept();
+  update();
+}
+
+void
+DemodulatorWaterFallView::_paintHistory(QPainter &painter) {
+  const WaterfallHistory &history = _demodulator->history();
+  size_t W = history.width(_level), N = history.rows(_level);
+  size_t H = std::min(size_t(height()), (N > _scrollback) ? (N-_scrollback) : 0);
+  bool real = _demodulator->isInputReal();
+  size_t M = real ? W/2 : W;
+  painter.fillRect(rect(), Qt::black);
+  if ((0 == H) || (0 == M)) { return; }
+
+  // Assemble the image from the stored rows, the most recent row at the bottom
+  QImage image(M, H, QImage::Format_Indexed8);
+  image.setColorTable(_colors);
+  for (size_t y=0; y<H; y++) {
+    const uint8_t *row = history.row(_level, _scrollback+y);
+    uchar *line = image.scanLine(H-1-y);
+    for (size_t i=0; i<M; i++) {
+      // Complex input: Negative frequencies are stored in the upper half
+      line[i] = row[real ? i : ((i+W/2) % W)];
+    }
+  }
+  painter.drawImage(QRect(0, height()-H, width(), H), image);
+
+  // Label: time of the most recent row shown and time span per row
+  qint64 age = QDateTime::currentMSecsSinceEpoch() - history.time(_level, _scrollback);
+  QString label = QString("-%1 s, %2 spectra per row").arg(age/1000.0, 0, 'f', 1).arg(1 << _level);
+  painter.setPen(Qt::white);
+  painter.drawText(QPoint(5, height()-5), label);
+}
+
 
 /* ******************************************************************************************** *
  * Implementation of DemodulatorCtrlView
@@ -385,6 +695,31 @@ DemodulatorCtrlView::DemodulatorCtrlView(DemodulatorCtrl *demodulator, QWidget *
   tau_val->setBottom(0); _agc_tau->setValidator(tau_val);
   _agc_tau->setText(QString("%1").arg(_demodulator->agcTime()));
 
+  _agc_mode = new QComboBox();
+  _agc_mode->addItem("Wideband", DemodulatorCtrl::AGC_WIDEBAND);
+  _agc_mode->addItem("Channel", DemodulatorCtrl::AGC_CHANNEL);
+  _agc_mode->setCurrentIndex(
+        (DemodulatorCtrl::AGC_CHANNEL == _demodulator->agcMode()) ? 1 : 0);
+  _agc_attack = new QLineEdit();
+  QDoubleValidator *attack_val = new QDoubleValidator();
+  attack_val->setBottom(0); _agc_attack->setValidator(attack_val);
+  _agc_attack->setText(QString("%1").arg(_demodulator->agcAttack()));
+  _agc_hang = new QLineEdit();
+  QDoubleValidator *hang_val = new QDoubleValidator();
+  hang_val->setBottom(0); _agc_hang->setValidator(hang_val);
+  _agc_hang->setText(QString("%1").arg(_demodulator->agcHang()));
+  // Attack and hang apply to the channel AGC only
+  _agc_attack->setEnabled(DemodulatorCtrl::AGC_CHANNEL == _demodulator->agcMode());
+  _agc_hang->setEnabled(DemodulatorCtrl::AGC_CHANNEL == _demodulator->agcMode());
+
+  _nb = new QCheckBox("Noise blanker");
+  _nb->setChecked(_demodulator->isNoiseBlankerEnabled());
+  _nb_threshold = new QLineEdit();
+  QDoubleValidator *nb_val = new QDoubleValidator();
+  nb_val->setBottom(1); _nb_threshold->setValidator(nb_val);
+  _nb_threshold->setText(QString("%1").arg(_demodulator->noiseBlankerThreshold()));
+  _nb_threshold->setEnabled(_demodulator->isNoiseBlankerEnabled());
+
   _centerFreq = new QLineEdit();
   QDoubleValidator *fc_val = new QDoubleValidator();
   if (_demodulator->isInputReal()) { fc_val->setBottom(0); fc_val->setTop(_demodulator->sampleRate()/2); }
@@ -400,7 +735,12 @@ DemodulatorCtrlView::DemodulatorCtrlView(DemodulatorCtrl *demodulator, QWidget *
   QObject::connect(_demodList, SIGNAL(activated(int)), this, SLOT(onDemodSelected(int)));
   QObject::connect(_agc, SIGNAL(toggled(bool)), SLOT(onAGCToggled(bool)));
   QObject::connect(_agc_tau, SIGNAL(textEdited(QString)), this, SLOT(onAGCTauChanged(QString)));
+  QObject::connect(_agc_mode, SIGNAL(activated(int)), this, SLOT(onAGCModeSelected(int)));
+  QObject::connect(_agc_attack, SIGNAL(textEdited(QString)), this, SLOT(onAGCAttackChanged(QString)));
+  QObject::connect(_agc_hang, SIGNAL(textEdited(QString)), this, SLOT(onAGCHangChanged(QString)));
   QObject::connect(_gain, SIGNAL(textEdited(QString)), SLOT(onGainChanged(QString)));
+  QObject::connect(_nb, SIGNAL(toggled(bool)), this, SLOT(onNBToggled(bool)));
+  QObject::connect(_nb_threshold, SIGNAL(textEdited(QString)), this, SLOT(onNBThresholdChanged(QString)));
   QObject::connect(gainUpdate, SIGNAL(timeout()), SLOT(onUpdateGain()));
   QObject::connect(_centerFreq, SIGNAL(textEdited(QString)), this, SLOT(onCenterFreqChanged(QString)));
   QObject::connect(_demodulator, SIGNAL(filterChanged()), this, SLOT(onFilterChanged()));
@@ -409,7 +749,12 @@ DemodulatorCtrlView::DemodulatorCtrlView(DemodulatorCtrl *demodulator, QWidget *
   side->addRow("Modulation", _demodList);
   side->addRow("Gain", _gain);
   side->addWidget(_agc);
+  side->addRow("AGC mode", _agc_mode);
   side->addRow("AGC time", _agc_tau);
+  side->addRow("AGC attack", _agc_attack);
+  side->addRow("AGC hang", _agc_hang);
+  side->addWidget(_nb);
+  side->addRow("NB threshold", _nb_threshold);
   side->addRow("Center freq.", _centerFreq);
 
   _layout = new QVBoxLayout();
@@ -455,6 +800,26 @@ DemodulatorCtrlView::onAGCTauChanged(QString value) {
   if (ok) { _demodulator->setAGCTime(tau); }
 }
 
+void
+DemodulatorCtrlView::onAGCModeSelected(int idx) {
+  DemodulatorCtrl::AGCMode mode = DemodulatorCtrl::AGCMode(_agc_mode->itemData(idx).toInt());
+  _demodulator->setAGCMode(mode);
+  _agc_attack->setEnabled(DemodulatorCtrl::AGC_CHANNEL == mode);
+  _agc_hang->setEnabled(DemodulatorCtrl::AGC_CHANNEL == mode);
+}
+
+void
+DemodulatorCtrlView::onAGCAttackChanged(QString value) {
+  bool ok; double attack = value.toDouble(&ok);
+  if (ok) { _demodulator->setAGCAttack(attack); }
+}
+
+void
+DemodulatorCtrlView::onAGCHangChanged(QString value) {
+  bool ok; double hang = value.toDouble(&ok);
+  if (ok) { _demodulator->setAGCHang(hang); }
+}
+
 void
 DemodulatorCtrlView::onGainChanged(QString value) {
   if (! _gain->isEnabled()) { return; }
@@ -463,6 +828,18 @@ DemodulatorCtrlView::onGainChanged(QString value) {
   if (ok) { _demodulator->setGain(gain); }
 }
 
+void
+DemodulatorCtrlView::onNBToggled(bool enabled) {
+  _demodulator->enableNoiseBlanker(enabled);
+  _nb_threshold->setEnabled(enabled);
+}
+
+void
+DemodulatorCtrlView::onNBThresholdChanged(QString value) {
+  bool ok; double threshold = value.toDouble(&ok);
+  if (ok) { _demodulator->setNoiseBlankerThreshold(threshold); }
+}
+
 
 void
 DemodulatorCtrlView::onUpdateGain() {
@@ -632,8 +1009,12 @@ FMDemodulator::_onViewDeleted() {
 }
 
 WFMDemodulator::WFMDemodulator(DemodulatorCtrl *demod)
-  : FMDemodulator(demod)
+  : FMDemodulator(demod), _stereo()
 {
+  // The stereo decoder replaces the mono de-emphasis
+  _demod.disconnect(&_deemph);
+  _demod.connect(&_stereo, true);
+
   // Configure BaseBand for WFM RX:
   _ctrl->setFilterFrequency(0.0);
   _ctrl->setFilterWidth(200000.0);
@@ -643,6 +1024,60 @@ WFMDemodulator::~WFMDemodulator() {
   // pass...
 }
 
+bool
+WFMDemodulator::deemphEnabled() const {
+  return _stereo.deemphEnabled();
+}
+
+void
+WFMDemodulator::enableDeemph(bool enable) {
+  _stereo.enableDeemph(enable);
+}
+
+bool
+WFMDemodulator::stereoEnabled() const {
+  return _stereo.stereoEnabled();
+}
+
+void
+WFMDemodulator::enableStereo(bool enable) {
+  _stereo.enableStereo(enable);
+}
+
+bool
+WFMDemodulator::isPilotLocked() const {
+  return _stereo.isPilotLocked();
+}
+
+bool
+WFMDemodulator::rdsSynchronized() const {
+  return _stereo.rds().isSynchronized();
+}
+
+QString
+WFMDemodulator::rdsProgramService() const {
+  return QString::fromStdString(_stereo.rds().programService());
+}
+
+QString
+WFMDemodulator::rdsRadioText() const {
+  return QString::fromStdString(_stereo.rds().radioText()).trimmed();
+}
+
+sdr::Source *
+WFMDemodulator::audioSource() {
+  return &_stereo;
+}
+
+QWidget *
+WFMDemodulator::createView() {
+  if (0 == _view) {
+    _view = new WFMDemodulatorView(this);
+    QObject::connect(_view, SIGNAL(destroyed()), this, SLOT(_onViewDeleted()));
+  }
+  return _view;
+}
+
 NFMDemodulator::NFMDemodulator(DemodulatorCtrl *demod)
   : FMDemodulator(demod)
 {
@@ -692,6 +1127,51 @@ FMDemodulatorView::_onDeemphToggled(bool enabled) {
 }
 
 
+WFMDemodulatorView::WFMDemodulatorView(WFMDemodulator *demod, QWidget *parent)
+  : FMDemodulatorView(demod, parent), _wfm(demod)
+{
+  setTitle("WFM Demodulator");
+
+  QCheckBox *stereo = new QCheckBox();
+  stereo->setChecked(_wfm->stereoEnabled());
+  _pilot = new QLabel("-");
+  _station = new QLabel("-");
+  _text = new QLabel("-");
+  _text->setWordWrap(true);
+
+  QFormLayout *layout = qobject_cast<QFormLayout *>(this->layout());
+  layout->addRow("Stereo", stereo);
+  layout->addRow("Pilot", _pilot);
+  layout->addRow("Station", _station);
+  layout->addRow("Text", _text);
+
+  QObject::connect(stereo, SIGNAL(toggled(bool)), this, SLOT(_onStereoToggled(bool)));
+  QObject::connect(&_update, SIGNAL(timeout()), this, SLOT(_onUpdate()));
+
+  _update.setInterval(500);
+  _update.setSingleShot(false);
+  _update.start();
+}
+
+WFMDemodulatorView::~WFMDemodulatorView() {
+  // pass...
+}
+
+void
+WFMDemodulatorView::_onStereoToggled(bool enabled) {
+  _wfm->enableStereo(enabled);
+}
+
+void
+WFMDemodulatorView::_onUpdate() {
+  _pilot->setText(_wfm->isPilotLocked() ? "locked" : "-");
+  if (_wfm->rdsSynchronized()) {
+    _station->setText(_wfm->rdsProgramService());
+    _text->setText(_wfm->rdsRadioText());
+  }
+}
+
+
 /* ******************************************************************************************** *
  * Implementation of SSBDemodulator and view
  * ******************************************************************************************** */
@@ -825,7 +1305,7 @@ SSBDemodulatorView::_onFilterWidthChanged(QString value) {
 BPSK31Demodulator::BPSK31Demodulator(DemodulatorCtrl *ctrl, QObject *parent)
   : QObject(parent), sdr::Sink<uint8_t>(),
     _ctrl(ctrl), _input_proxy(), _freq_shift(700.0), _audio_demod(), _bpsk_filter(31, 200), _bpsk(),
-    _decode(), _text_buffer(""), _view(0)
+    _decode(), _text_buffer(4096), _view(0)
 {
   // Configure BaseBand to RX BPSK31 stuff
   _ctrl->setFilterFrequency(0);
@@ -852,7 +1332,7 @@ BPSK31Demodulator::filterWidth() const {
 void
 BPSK31Demodulator::setFilterWidth(double width) {
   _ctrl->setFilterWidth(width);
-  _bpsk_filter.setFreq(width/2);
+  if ((width/2) != _bpsk_filter.freq()) { _bpsk_filter.setFreq(width/2); }
 }
 
 sdr::SinkBase *
@@ -881,20 +1361,23 @@ BPSK31Demodulator::config(const Config &src_cfg) {
 
 void
 BPSK31Demodulator::process(const sdr::Buffer<uint8_t> &buffer, bool allow_overwrite) {
-  for (size_t i=0; i<buffer.size(); i++) {
-    _text_buffer.append(char(buffer[i]));
-  }
-  emit textReceived();
+  // Just store the decoded chars, the view polls them at its own pace. If nobody takes the text,
+  // the ring overflows and further chars get dropped.
+  _text_buffer.put((const char *)buffer.data(), buffer.size());
 }
 
-const QString &
-BPSK31Demodulator::text() const {
-  return _text_buffer;
+size_t
+BPSK31Demodulator::takeText(QString &text) {
+  char chunk[256]; size_t n=0, count=0;
+  while (0 < (n = _text_buffer.take(chunk, sizeof(chunk)))) {
+    text.append(QString::fromLatin1(chunk, int(n))); count += n;
+  }
+  return count;
 }
 
 void
 BPSK31Demodulator::clearText() {
-  _text_buffer = "";
+  _text_buffer.clear();
 }
 
 void
@@ -913,6 +1396,8 @@ BPSK31DemodulatorView::BPSK31DemodulatorView(BPSK31Demodulator *demod, QWidget *
 
   _text = new QPlainTextEdit();
   _text->setReadOnly(true);
+  // Limit history to keep memory and layout costs constant
+  _text->setMaximumBlockCount(500);
   _text->setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::MinimumExpanding);
 
   QVBoxLayout *layout = new QVBoxLayout();
@@ -926,7 +1411,12 @@ BPSK31DemodulatorView::BPSK31DemodulatorView(BPSK31Demodulator *demod, QWidget *
 
   QObject::connect(_filterWidth, SIGNAL(textEdited(QString)),
                    this, SLOT(_onFilterWidthChanged(QString)));
-  QObject::connect(_demod, SIGNAL(textReceived()), this, SLOT(_onTextReceived()));
+  QObject::connect(&_refresh, SIGNAL(timeout()), this, SLOT(_onTextReceived()));
+
+  // Collect received text at 10Hz
+  _refresh.setInterval(100);
+  _refresh.setSingleShot(false);
+  _refresh.start();
 }
 
 BPSK31DemodulatorView::~BPSK31DemodulatorView() {
@@ -935,8 +1425,20 @@ BPSK31DemodulatorView::~BPSK31DemodulatorView() {
 
 void
 BPSK31DemodulatorView::_onTextReceived() {
-  QString text = _demod->text(); _demod->clearText();
-  _text->insertPlainText(text);
+  QString text;
+  if (0 == _demod->takeText(text)) { return; }
+  // Append text at the end of the document
+  QTextCursor cursor = _text->textCursor();
+  cursor.movePosition(QTextCursor::End);
+  cursor.insertText(text);
+  // Text without line-breaks is not limited by the max. block count, hence limit number of chars
+  if (_text->document()->characterCount() > 20000) {
+    cursor.movePosition(QTextCursor::Start);
+    cursor.movePosition(QTextCursor::NextCharacter, QTextCursor::KeepAnchor,
+                        _text->document()->characterCount()-20000);
+    cursor.removeSelectedText();
+  }
+  _text->moveCursor(QTextCursor::End);
   _text->ensureCursorVisible();
 }
 
@@ -8,6 +8,8 @@
 #include <QVBoxLayout>
 #include <QComboBox>
 #include <QGroupBox>
+#include <QLabel>
+#include <QTimer>
 
 #include "gui/spectrum.hh"
 #include "gui/spectrumview.hh"
@@ -17,6 +19,16 @@
 #include "demod.hh"
 #include "firfilter.hh"
 #include "configuration.hh"
+#include "lockfreering.hh"
+#include "wfmstereo.hh"
+#include "fmdemod.hh"
+#include "noiseblanker.hh"
+#include "channelagc.hh"
+#include "spectrumtraces.hh"
+#include "waterfallhistory.hh"
+#include "latency.hh"
+#include "nco.hh"
+#include "channelfilter.hh"
 
 
 // Forward declaration
@@ -43,9 +55,29 @@ public:
   double agcTau() const;
   void storeAgcTau(double tau);
 
+  /** AGC mode, see @c DemodulatorCtrl::AGCMode. */
+  int agcMode() const;
+  void storeAgcMode(int mode);
+
+  /** Attack and hang time of the channel AGC in seconds. */
+  double agcAttack() const;
+  void storeAgcAttack(double attack);
+  double agcHang() const;
+  void storeAgcHang(double hang);
+
   double gain() const;
   void storeGain(double gain);
 
+  bool noiseBlankerEnabled() const;
+  void storeNoiseBlankerEnabled(bool enabled);
+
+  double noiseBlankerThreshold() const;
+  void storeNoiseBlankerThreshold(double threshold);
+
+  /** Memory budget of the waterfall history in MB. */
+  unsigned int historyBudget() const;
+  void storeHistoryBudget(unsigned int mb);
+
 protected:
   Configuration &_config;
 };
@@ -67,6 +99,14 @@ public:
     DEMOD_BPSK31
   } Demod;
 
+  /** Where the AGC operates. */
+  typedef enum {
+    /** Ahead of the mixer on the full input rate, controlled by a single time constant. */
+    AGC_WIDEBAND,
+    /** After the filter node on the channel rate, with separate attack, decay and hang. */
+    AGC_CHANNEL
+  } AGCMode;
+
 public:
   explicit DemodulatorCtrl(Receiver *receiver = 0);
   virtual ~DemodulatorCtrl();
@@ -76,19 +116,49 @@ public:
 
   bool isAGCEnabled() const;
   double gain() const;
+  /** Returns the AGC time constant, the decay time in channel mode. */
   double agcTime() const;
+  inline AGCMode agcMode() const { return _agcMode; }
+  double agcAttack() const;
+  double agcHang() const;
+
+  bool isNoiseBlankerEnabled() const;
+  double noiseBlankerThreshold() const;
 
   inline double centerFreq() const { return _filter_node->centerFrequency(); }
-  inline double filterFrequency() const { return _filter_node->filterFrequency()-_filter_node->centerFrequency(); }
-  inline double filterLower() const { return _filter_node->filterFrequency()-_filter_node->filterWidth()/2; }
-  inline double filterUpper() const { return _filter_node->filterFrequency()+_filter_node->filterWidth()/2; }
+  inline double filterFrequency() const { return _filter_node->filterFrequency(); }
+  inline double filterLower() const { return centerFreq()+filterFrequency()-_filter_node->filterWidth()/2; }
+  inline double filterUpper() const { return centerFreq()+filterFrequency()+_filter_node->filterWidth()/2; }
   inline double filterWidth() const { return _filter_node->filterWidth(); }
 
   inline DemodInterface *demod() const { return _demodObj; }
+  /** Returns the type of the currently selected demodulator. */
+  inline Demod demodType() const { return _demodType; }
+
+  /** Returns the signal level at the input in dBFS. */
+  double signalLevel() const;
+  /** Returns the number of samples blanked by the noise blanker. */
+  size_t blankedSamples() const;
 
-  inline sdr::SinkBase *in() const { return _agc; }
+  /** Retunes the center frequency without storing it in the configuration. In contrast to
+   * @c setCenterFreq, this method may be called from the processing thread between buffers. */
+  void tuneCenterFreq(double f);
+
+  inline sdr::SinkBase *in() const { return _blanker; }
+  /** Connects latency probes to the AGC, baseband and demodulator outputs. */
+  void connectLatencyProbes(LatencyMonitor *monitor);
   inline sdr::Source *audioSource() const { return _audio_source; }
 
+  /** Returns the averaged, peak-hold and min-hold traces of the input spectrum. */
+  inline const SpectrumTraces &traces() const { return _traces; }
+  /** Returns the history of the input spectrum. */
+  inline const WaterfallHistory &history() const { return _history; }
+  /** Sets the memory budget of the history in MB, clears the history. */
+  void setHistoryBudget(unsigned int mb);
+  /** Returns the spectrum of the channel around the center frequency, computed from the output
+   * of the filter node at its reduced sample rate. */
+  inline sdr::gui::Spectrum *zoomSpectrum() const { return _zoom; }
+
   QWidget *createCtrlView();
   QWidget *createSpectrumView();
 
@@ -99,25 +169,52 @@ public slots:
   void enableAGC(bool enable);
   void setGain(double gain);
   void setAGCTime(double tau);
+  void setAGCMode(AGCMode mode);
+  void setAGCAttack(double attack);
+  void setAGCHang(double hang);
+
+  void enableNoiseBlanker(bool enable);
+  void setNoiseBlankerThreshold(double threshold);
 
   void setCenterFreq(double f);
   void setFilterFrequency(double f);
   void setFilterWidth(double w);
 
   void setDemod(Demod demod);
+  /** Restarts the averaging and the peak- and min-hold traces. */
+  void resetTraces();
+
+protected slots:
+  /** Updates the traces from the new spectrum. */
+  void _onSpectrumUpdated();
 
 protected:
   Receiver *_receiver;
 
   /** The currently selected demodulator. */
   DemodInterface *_demodObj;
+  Demod _demodType;
 
+  // The impulse noise blanker
+  NoiseBlanker *_blanker;
   // A AGC
   sdr::AGC< std::complex<int16_t> > *_agc;
-  // The filter node
-  sdr::IQBaseBand<int16_t> *_filter_node;
+  /** The AGC after the filter node. */
+  ChannelAGC *_channel_agc;
+  /** Selects the AGC. */
+  AGCMode _agcMode;
+  // The filter node, shifts the center frequency to 0
+  ChannelFilter *_filter_node;
+  /** Output sample rate of the filter node. */
+  double _outputRate;
   /** Audio source. */
   sdr::Proxy *_audio_source;
+  /** Traces of the input spectrum. */
+  SpectrumTraces _traces;
+  /** History of the input spectrum. */
+  WaterfallHistory _history;
+  /** Spectrum of the filter node output. */
+  sdr::gui::Spectrum *_zoom;
   /** Configuration. */
   DemodulatorCtrlConfig _config;
 };
@@ -135,8 +232,14 @@ protected slots:
 
   void onAGCToggled(bool enabled);
   void onAGCTauChanged(QString value);
+  void onAGCModeSelected(int idx);
+  void onAGCAttackChanged(QString value);
+  void onAGCHangChanged(QString value);
   void onGainChanged(QString value);
 
+  void onNBToggled(bool enabled);
+  void onNBThresholdChanged(QString value);
+
   void onUpdateGain();
 
   void onCenterFreqChanged(QString value);
@@ -148,6 +251,11 @@ protected:
   QLineEdit *_gain;
   QCheckBox *_agc;
   QLineEdit *_agc_tau;
+  QComboBox *_agc_mode;
+  QLineEdit *_agc_attack;
+  QLineEdit *_agc_hang;
+  QCheckBox *_nb;
+  QLineEdit *_nb_threshold;
   QLineEdit *_centerFreq;
 
   QVBoxLayout *_layout;
@@ -164,6 +272,8 @@ public:
 
 protected:
   virtual void paintEvent(QPaintEvent *evt);
+  /** Resets the traces. */
+  virtual void mouseDoubleClickEvent(QMouseEvent *evt);
 
 protected:
   DemodulatorCtrl *_demodulator;
@@ -180,9 +290,19 @@ public:
 
 protected:
   virtual void paintEvent(QPaintEvent *evt);
+  /** Scrolls back in time, zooms out with the control key pressed. */
+  virtual void wheelEvent(QWheelEvent *evt);
+  /** Draws the history at the current level and position. */
+  void _paintHistory(QPainter &painter);
 
 protected:
   DemodulatorCtrl *_demodulator;
+  /** The displayed level of the history, 0 is full resolution. */
+  size_t _level;
+  /** Number of rows scrolled back, the live waterfall is shown if 0 at level 0. */
+  size_t _scrollback;
+  /** Color table of the history. */
+  QVector<QRgb> _colors;
 };
 
 
@@ -259,8 +379,8 @@ public:
   double filterWidth() const;
   void setFilterWidth(double width);
 
-  bool deemphEnabled() const;
-  void enableDeemph(bool enable);
+  virtual bool deemphEnabled() const;
+  virtual void enableDeemph(bool enable);
 
   virtual sdr::SinkBase *sink();
   virtual sdr::Source *audioSource();
@@ -272,11 +392,12 @@ protected slots:
 
 protected:
   DemodulatorCtrl *_ctrl;
-  sdr::FMDemod<int16_t> _demod;
+  FastFMDemod _demod;
   sdr::FMDeemph<int16_t> _deemph;
   FMDemodulatorView *_view;
 };
 
+/** WFM demodulator, passes the composite signal to the stereo & RDS decoder. */
 class WFMDemodulator: public FMDemodulator
 {
   Q_OBJECT
@@ -284,6 +405,23 @@ class WFMDemodulator: public FMDemodulator
 public:
   WFMDemodulator(DemodulatorCtrl *demod);
   virtual ~WFMDemodulator();
+
+  virtual bool deemphEnabled() const;
+  virtual void enableDeemph(bool enable);
+
+  bool stereoEnabled() const;
+  void enableStereo(bool enable);
+  bool isPilotLocked() const;
+
+  bool rdsSynchronized() const;
+  QString rdsProgramService() const;
+  QString rdsRadioText() const;
+
+  virtual sdr::Source *audioSource();
+  virtual QWidget *createView();
+
+protected:
+  WFMStereoDecoder _stereo;
 };
 
 class NFMDemodulator: public FMDemodulator
@@ -314,6 +452,27 @@ protected:
 };
 
 
+class WFMDemodulatorView: public FMDemodulatorView
+{
+  Q_OBJECT
+
+public:
+  WFMDemodulatorView(WFMDemodulator *demod, QWidget *parent=0);
+  virtual ~WFMDemodulatorView();
+
+protected slots:
+  void _onStereoToggled(bool enabled);
+  void _onUpdate();
+
+protected:
+  WFMDemodulator *_wfm;
+  QLabel *_pilot;
+  QLabel *_station;
+  QLabel *_text;
+  QTimer _update;
+};
+
+
 class SSBDemodulatorView;
 class SSBDemodulator: public QObject, public DemodInterface
 {
@@ -413,24 +572,25 @@ public:
   virtual void config(const sdr::Config &src_cfg);
   virtual void process(const sdr::Buffer<uint8_t> &buffer, bool allow_overwrite);
 
-  const QString & text() const;
+  /** Moves all decoded characters received so far into @c text. This method is called from
+   * the GUI thread and returns the number of characters taken. */
+  size_t takeText(QString &text);
+  /** Drops all decoded characters not yet taken. */
   void clearText();
 
-signals:
-  void textReceived();
-
 protected slots:
   void _onViewDeleted();
 
 protected:
   DemodulatorCtrl *_ctrl;
   sdr::Proxy _input_proxy;
-  sdr::FreqShift<int16_t> _freq_shift;
+  NCOMixer _freq_shift;
   sdr::USBDemod<int16_t> _audio_demod;
   sdr::FIRLowPass< std::complex<int16_t> > _bpsk_filter;
   sdr::BPSK31<int16_t>   _bpsk;
   sdr::Varicode          _decode;
-  QString _text_buffer;
+  /** Bounded buffer of decoded characters, filled by the queue thread. */
+  LockFreeRing<char> _text_buffer;
   BPSK31DemodulatorView *_view;
 };
 
@@ -451,6 +611,8 @@ protected:
   BPSK31Demodulator *_demod;
   QLineEdit *_filterWidth;
   QPlainTextEdit *_text;
+  /** Polls the demodulator for new text at a fixed rate. */
+  QTimer _refresh;
 };
 
 #endif // __SDR_RX_DEMODULATOR_HH__
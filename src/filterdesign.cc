@@ -0,0 +1,79 @@
+#include "filterdesign.hh"
+#include <cmath>
+#include <algorithm>
+
+
+/* ******************************************************************************************** *
+ * Implementation of FilterDesign
+ * ******************************************************************************************** */
+std::mutex FilterDesign::_lock;
+std::list<FilterDesign::Entry> FilterDesign::_entries;
+std::map<FilterDesign::Key, std::list<FilterDesign::Entry>::iterator> FilterDesign::_index;
+size_t FilterDesign::_capacity = 64;
+size_t FilterDesign::_hits = 0;
+size_t FilterDesign::_misses = 0;
+
+bool
+FilterDesign::Key::operator<(const struct Key &other) const {
+  if (type != other.type) { return type < other.type; }
+  if (order != other.order) { return order < other.order; }
+  if (cutoff != other.cutoff) { return cutoff < other.cutoff; }
+  return rate < other.rate;
+}
+
+void
+FilterDesign::lowPass(std::vector<float> &taps, size_t N, double fc, double Fs) {
+  Key key; key.type = LOWPASS; key.order = N; key.cutoff = fc; key.rate = Fs;
+  if (_lookup(key, taps)) { return; }
+
+  taps.resize(N); double sum = 0;
+  for (size_t i=0; i<N; i++) {
+    double n = double(i) - double(N-1)/2;
+    double h = (0 == n) ? 2*fc/Fs : std::sin(2*M_PI*fc*n/Fs)/(M_PI*n);
+    if (N > 1) { h *= 0.54 - 0.46*std::cos(2*M_PI*i/(N-1)); }
+    taps[i] = h; sum += h;
+  }
+  for (size_t i=0; i<N; i++) { taps[i] /= sum; }
+
+  _store(key, taps);
+}
+
+void
+FilterDesign::statistics(size_t &hits, size_t &misses) {
+  std::lock_guard<std::mutex> guard(_lock);
+  hits = _hits; misses = _misses;
+}
+
+void
+FilterDesign::setCapacity(size_t capacity) {
+  std::lock_guard<std::mutex> guard(_lock);
+  _capacity = std::max(size_t(1), capacity);
+  while (_entries.size() > _capacity) {
+    _index.erase(_entries.back().key); _entries.pop_back();
+  }
+}
+
+bool
+FilterDesign::_lookup(const Key &key, std::vector<float> &taps) {
+  std::lock_guard<std::mutex> guard(_lock);
+  std::map<Key, std::list<Entry>::iterator>::iterator item = _index.find(key);
+  if (_index.end() == item) { _misses++; return false; }
+  // Move to front
+  _entries.splice(_entries.begin(), _entries, item->second);
+  taps = item->second->taps;
+  _hits++;
+  return true;
+}
+
+void
+FilterDesign::_store(const Key &key, const std::vector<float> &taps) {
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_index.count(key)) { return; }
+  Entry entry; entry.key = key; entry.taps = taps;
+  _entries.push_front(entry);
+  _index[key] = _entries.begin();
+  // Evict least recently used designs
+  while (_entries.size() > _capacity) {
+    _index.erase(_entries.back().key); _entries.pop_back();
+  }
+}
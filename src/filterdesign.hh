@@ -0,0 +1,68 @@
+#ifndef __SDR_RX_FILTERDESIGN_HH__
+#define __SDR_RX_FILTERDESIGN_HH__
+
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+
+
+/** A process-wide cache of FIR filter designs.
+ *
+ * The designs are keyed by the filter type, order, cutoff frequency and sample rate. The cache
+ * holds the most recently used designs, the least recently used design gets evicted once the
+ * cache is full. Hence switching back and forth between demodulators or filter settings reuses
+ * the taps instead of redesigning them. The cache is thread safe. */
+class FilterDesign
+{
+public:
+  /** Possible filter types. */
+  typedef enum {
+    LOWPASS  ///< Hamming windowed-sinc low-pass with unit DC gain.
+  } Type;
+
+protected:
+  /** Key of a design. */
+  typedef struct Key {
+    Type type;
+    size_t order;
+    double cutoff, rate;
+    bool operator<(const struct Key &other) const;
+  } Key;
+
+  /** A cached design. */
+  typedef struct {
+    Key key;
+    std::vector<float> taps;
+  } Entry;
+
+public:
+  /** Returns the taps of a low-pass of @c order taps with the cutoff frequency @c fc at the
+   * sample rate @c Fs. */
+  static void lowPass(std::vector<float> &taps, size_t order, double fc, double Fs);
+
+  /** Returns the number of cache hits and misses. */
+  static void statistics(size_t &hits, size_t &misses);
+  /** Sets the maximum number of cached designs. */
+  static void setCapacity(size_t capacity);
+
+protected:
+  /** Looks up a design and moves it to the front, returns @c false if not found. */
+  static bool _lookup(const Key &key, std::vector<float> &taps);
+  /** Stores a design, evicts the least recently used one if full. */
+  static void _store(const Key &key, const std::vector<float> &taps);
+
+protected:
+  /** Serializes access to the cache. */
+  static std::mutex _lock;
+  /** Designs, most recently used first. */
+  static std::list<Entry> _entries;
+  /** Index of the designs. */
+  static std::map<Key, std::list<Entry>::iterator> _index;
+  /** Maximum number of designs. */
+  static size_t _capacity;
+  static size_t _hits, _misses;
+};
+
+#endif // __SDR_RX_FILTERDESIGN_HH__
@@ -0,0 +1,114 @@
+#include "fmdemod.hh"
+#include "bufferpool.hh"
+#include "logger.hh"
+#include <cmath>
+
+using namespace sdr;
+
+
+FastFMDemod::FastFMDemod()
+  : Sink< std::complex<int16_t> >(), Source(), _last(0,0), _buffer()
+{
+  // pass...
+}
+
+FastFMDemod::~FastFMDemod() {
+  BufferPool::get().release(_buffer);
+}
+
+void
+FastFMDemod::config(const Config &src_cfg) {
+  // Requires type, sample rate & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+  // Check buffer type
+  if (Config::typeId< std::complex<int16_t> >() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure FastFMDemod: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId< std::complex<int16_t> >();
+    throw err;
+  }
+
+  _re.resize(src_cfg.bufferSize());
+  _im.resize(src_cfg.bufferSize());
+  BufferPool::get().release(_buffer);
+  _buffer = BufferPool::get().acquire<int16_t>(src_cfg.bufferSize());
+  _last = std::complex<int16_t>(0,0);
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Configured FastFMDemod node: " << this << std::endl
+      << " sample-rate: " << src_cfg.sampleRate() << std::endl
+      << " buffer-size: " << src_cfg.bufferSize();
+  Logger::get().log(msg);
+
+  this->setConfig(Config(Config::typeId<int16_t>(), src_cfg.sampleRate(), src_cfg.bufferSize(), 1));
+}
+
+void
+FastFMDemod::process(const Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite) {
+  if (0 == buffer.size()) { return; }
+
+  Buffer<int16_t> out;
+  if (allow_overwrite) {
+    // Demodulate in-place, the output is half the size of the input
+    out = Buffer<int16_t>(buffer);
+  } else if (_buffer.isUnused()) {
+    out = _buffer;
+  } else {
+#ifdef SDR_DEBUG
+    LogMessage msg(LOG_WARNING);
+    msg << "FastFMDemod: Drop buffer: Output buffer still in use.";
+    Logger::get().log(msg);
+#endif
+    return;
+  }
+
+  size_t N = buffer.size();
+  // A buffer larger than configured gets processed completely, grow the scratch and output
+  // buffers instead of truncating it
+  if (N > _re.size()) { _re.resize(N); _im.resize(N); }
+  if ((! allow_overwrite) && (N > out.size())) {
+    LogMessage msg(LOG_DEBUG);
+    msg << "FastFMDemod: Buffer of " << N << " samples exceeds configured size " << out.size()
+        << ", grow output buffer.";
+    Logger::get().log(msg);
+    BufferPool::get().release(_buffer);
+    _buffer = BufferPool::get().acquire<int16_t>(N);
+    out = _buffer;
+  }
+  const std::complex<int16_t> *in = reinterpret_cast<const std::complex<int16_t> *>(buffer.data());
+  std::complex<int16_t> last = in[N-1];
+  demodulate(in, _last, reinterpret_cast<int16_t *>(out.data()), &_re[0], &_im[0], N);
+  _last = last;
+
+  this->send(out.head(N), true);
+}
+
+
+void
+FastFMDemod::demodulate(const std::complex<int16_t> *in, std::complex<int16_t> last,
+                        int16_t *out, float *re, float *im, size_t N)
+{
+  // Conjugate product of consecutive samples
+  re[0] = float(in[0].real())*last.real() + float(in[0].imag())*last.imag();
+  im[0] = float(in[0].imag())*last.real() - float(in[0].real())*last.imag();
+  for (size_t i=1; i<N; i++) {
+    float ar = in[i].real(), ai = in[i].imag(), br = in[i-1].real(), bi = in[i-1].imag();
+    re[i] = ar*br + ai*bi;
+    im[i] = ai*br - ar*bi;
+  }
+
+  // Polynomial atan2, all branches are selects
+  const float scale = 32767/M_PI;
+  for (size_t i=0; i<N; i++) {
+    float x = std::abs(re[i]), y = std::abs(im[i]);
+    float mx = std::max(x, y), mn = std::min(x, y);
+    float a = mn/(mx + 1e-20f), s = a*a;
+    float r = ((-0.0464964749f*s + 0.15931422f)*s - 0.327622764f)*s*a + a;
+    r = (y > x) ? float(M_PI/2) - r : r;
+    r = (re[i] < 0) ? float(M_PI) - r : r;
+    r = (im[i] < 0) ? -r : r;
+    // Round to nearest
+    float v = r*scale;
+    out[i] = int16_t(v + ((v < 0) ? -0.5f : 0.5f));
+  }
+}
@@ -0,0 +1,47 @@
+#ifndef __SDR_RX_FMDEMOD_HH__
+#define __SDR_RX_FMDEMOD_HH__
+
+#include "node.hh"
+#include <vector>
+
+
+/** Fast FM demodulator (discriminator) for @c std::complex<int16_t> input.
+ *
+ * The demodulator computes the phase difference of consecutive samples as the argument of the
+ * conjugate product @f$z_n\bar{z}_{n-1}@f$. The argument is evaluated by a branch-free polynomial
+ * approximation of atan2. Both steps are performed block-wise over plain float arrays, such that
+ * the compiler can vectorize the loops.
+ *
+ * The absolute error of the polynomial atan2 is below 2.1e-4 rad. Including the rounding to
+ * @c int16_t, the output deviates by at most 3 LSB from an exact atan2 discriminator. The output is
+ * scaled such that a phase difference of pi maps to 32767. Buffers larger than the configured
+ * buffer size are processed completely, see test/fmdemodtest.cc. */
+class FastFMDemod: public sdr::Sink< std::complex<int16_t> >, public sdr::Source
+{
+public:
+  /** Constructor. */
+  FastFMDemod();
+  /** Destructor. */
+  virtual ~FastFMDemod();
+
+  /** Configures the demodulator. */
+  virtual void config(const sdr::Config &src_cfg);
+  /** Performs the demodulation. */
+  virtual void process(const sdr::Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite);
+
+  /** Computes the phase differences of the @c N samples in @c in, @c last is the sample preceding
+   * the first one. The result is stored in @c out, scaled to [-32767, 32767]. @c re and @c im are
+   * scratch arrays of at least @c N elements. */
+  static void demodulate(const std::complex<int16_t> *in, std::complex<int16_t> last,
+                         int16_t *out, float *re, float *im, size_t N);
+
+protected:
+  /** The last sample of the previous buffer. */
+  std::complex<int16_t> _last;
+  /** Scratch buffers for the conjugate product. */
+  std::vector<float> _re, _im;
+  /** The output buffer. */
+  sdr::Buffer<int16_t> _buffer;
+};
+
+#endif // __SDR_RX_FMDEMOD_HH__
@@ -0,0 +1,447 @@
+#include "generatorsource.hh"
+#include "queue.hh"
+#include "logger.hh"
+
+#include <QFormLayout>
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace sdr;
+
+
+/** Names of the signal types, indexed by @c SignalGenerator::Type. */
+static const char *generator_type_names[] = {
+  "tone", "am", "fm", "usb", "lsb", "psk31", "noise", "impulse"
+};
+static const size_t generator_num_types =
+    sizeof(generator_type_names)/sizeof(generator_type_names[0]);
+
+/** Default test signal. */
+static const char *generator_default_spec =
+    "tone:100e3:-30,am:-200e3:-30,fm:300e3:-30,usb:-350e3:-30,psk31:50e3:-30,noise:-50";
+
+/** Returns the current time in us. */
+static inline int64_t
+now_us() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/** The voice-like modulation signal: Four tones with a syllabic envelope, as an analytic signal.
+ * The real part is the modulation signal, the imaginary part its Hilbert transform. All
+ * components are complex exponentials rotated sample by sample. */
+class VoiceSignal
+{
+public:
+  /** Constructor, @c period is the length of the table in samples, @c T its duration. */
+  VoiceSignal(size_t period, double T) {
+    static const double freqs[] = { 300, 700, 1100, 2300 };
+    static const double amps[] = { 1.0, 0.6, 0.4, 0.2 };
+    // Envelope 0.5+0.5*sin(we*t), hence env*cos(wk*t) = 0.5*cos(wk*t)
+    //   + 0.25*sin((wk+we)*t) - 0.25*sin((wk-we)*t)
+    double env = std::round(4*T), norm = 2.2;
+    for (size_t k=0; k<4; k++) {
+      double cycles = std::round(freqs[k]*T);
+      _add(amps[k]*0.5/norm, 0, cycles, period);
+      _add(0, -amps[k]*0.25/norm, cycles+env, period);
+      _add(0, amps[k]*0.25/norm, cycles-env, period);
+    }
+  }
+
+  /** Returns the next sample. */
+  inline std::complex<double> next() {
+    std::complex<double> z = 0;
+    for (size_t i=0; i<_phasors.size(); i++) {
+      z += _phasors[i]; _phasors[i] *= _steps[i];
+    }
+    return z;
+  }
+
+protected:
+  void _add(double re, double im, double cycles, size_t period) {
+    _phasors.push_back(std::complex<double>(re, im));
+    _steps.push_back(std::polar(1.0, 2*M_PI*cycles/period));
+  }
+
+protected:
+  std::vector< std::complex<double> > _phasors, _steps;
+};
+
+
+/* ******************************************************************************************** *
+ * Implementation of SignalGenerator
+ * ******************************************************************************************** */
+const double SignalGenerator::TablePeriod = 1.024;
+const double SignalGenerator::MaxBurstRate = 10e3;
+
+SignalGenerator::SignalGenerator(double sampleRate, bool paced)
+  : Source(), _sample_rate(sampleRate), _paced(paced), _components(), _buffer_size(0),
+    _period(0), _table(), _pos(0), _start(0), _samples(0)
+{
+  _build();
+}
+
+SignalGenerator::~SignalGenerator() {
+  if (_table.bytesLen()) { _table.unref(); }
+}
+
+void
+SignalGenerator::setSampleRate(double rate) {
+  _sample_rate = rate;
+  _build();
+}
+
+void
+SignalGenerator::setPaced(bool paced) {
+  _paced = paced;
+  reset();
+}
+
+void
+SignalGenerator::setComponents(const std::vector<Component> &components) {
+  _components = components;
+  _build();
+}
+
+void
+SignalGenerator::reset() {
+  _start = now_us(); _samples = 0;
+}
+
+void
+SignalGenerator::next() {
+  if (_paced) {
+    // Wait until the last sample of the buffer is due
+    int64_t due = _start + int64_t(1e6*(_samples+_buffer_size)/_sample_rate);
+    int64_t now = now_us();
+    if (due > now) { std::this_thread::sleep_for(std::chrono::microseconds(due-now)); }
+  }
+  this->send(_table.sub(_pos, _buffer_size));
+  _pos = (_pos + _buffer_size) % _period;
+  _samples += _buffer_size;
+}
+
+void
+SignalGenerator::_build() {
+  // About 10ms per buffer
+  _buffer_size = std::max(size_t(256), size_t(_sample_rate/100));
+  _period = std::max(_buffer_size, size_t(std::round(_sample_rate*TablePeriod)));
+  double T = _period/_sample_rate;
+
+  std::vector< std::complex<float> > signal(_period, 0);
+  std::mt19937 rng(1);
+  std::normal_distribution<float> normal;
+  std::uniform_real_distribution<float> uniform(0, 2*M_PI);
+
+  for (size_t i=0; i<_components.size(); i++) {
+    const Component &s = _components[i];
+    double A = 32767*std::pow(10., s.level/20);
+    // Integer number of cycles per table, exact phase of the carrier
+    int64_t cycles = int64_t(std::round(s.frequency*T)), period = _period;
+    VoiceSignal voice(_period, T);
+    double theta = 0, deviation = 2*M_PI*5e3/_sample_rate;
+    // At least one burst per table, at most one per sample
+    size_t bursts = size_t(std::min(double(_period), std::max(1.0, std::round(s.frequency*T))));
+    size_t burst_len = std::max(size_t(1), size_t(std::round(20e-6*_sample_rate)));
+
+    for (size_t n=0; n<_period; n++) {
+      int64_t k = (cycles*int64_t(n)) % period;
+      std::complex<double> carrier = std::polar(1.0, 2*M_PI*double(k)/period);
+      std::complex<double> v;
+      switch (s.type) {
+      case TONE: signal[n] += std::complex<float>(A*carrier); break;
+      case AM:
+        signal[n] += std::complex<float>(A*(0.5+0.5*voice.next().real())*carrier);
+        break;
+      case FM:
+        theta = std::fmod(theta + deviation*voice.next().real(), 2*M_PI);
+        signal[n] += std::complex<float>(A*carrier*std::polar(1.0, theta));
+        break;
+      case USB: signal[n] += std::complex<float>(A*voice.next()*carrier); break;
+      case LSB: signal[n] += std::complex<float>(A*std::conj(voice.next())*carrier); break;
+      case PSK31:
+        // Idle sequence: Phase reversal every symbol with cosine shaping, 32 symbols per table
+        v = A*std::cos(2*M_PI*double((16*n) % _period)/_period)*carrier;
+        signal[n] += std::complex<float>(v);
+        break;
+      case NOISE:
+        signal[n] += float(A/M_SQRT2)*std::complex<float>(normal(rng), normal(rng));
+        break;
+      case IMPULSE:
+        if ((n % (_period/bursts)) < burst_len) {
+          signal[n] += std::polar(float(A), uniform(rng));
+        }
+        break;
+      }
+    }
+  }
+
+  // Quantize, the extra buffer at the end repeats the beginning of the table
+  if (_table.bytesLen()) { _table.unref(); }
+  _table = Buffer< std::complex<int16_t> >(_period+_buffer_size);
+  std::complex<int16_t> *table = reinterpret_cast< std::complex<int16_t> *>(_table.data());
+  for (size_t n=0; n<(_period+_buffer_size); n++) {
+    const std::complex<float> &x = signal[n % _period];
+    table[n] = std::complex<int16_t>(
+          int16_t(std::max(-32768.f, std::min(32767.f, std::round(x.real())))),
+          int16_t(std::max(-32768.f, std::min(32767.f, std::round(x.imag())))));
+  }
+  _pos = 0;
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Signal generator: Table of " << _period << " samples, "
+      << _components.size() << " components at " << _sample_rate << " Hz.";
+  Logger::get().log(msg);
+
+  this->setConfig(Config(Config::typeId< std::complex<int16_t> >(), _sample_rate,
+                         _buffer_size, 1));
+}
+
+bool
+SignalGenerator::parse(const std::string &spec, std::vector<Component> &components) {
+  components.clear();
+  std::istringstream stream(spec);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    // Split item into fields
+    std::vector<std::string> fields;
+    std::istringstream istream(item);
+    std::string field;
+    while (std::getline(istream, field, ':')) { fields.push_back(field); }
+    if ((0 == fields.size()) || (fields.size() > 3)) { return false; }
+
+    Component component; size_t i=0;
+    std::string name = fields[0];
+    name.erase(0, name.find_first_not_of(" \t"));
+    while ((i<generator_num_types) && (name != generator_type_names[i])) { i++; }
+    if (generator_num_types == i) { return false; }
+    component.type = Type(i);
+    component.frequency = 0; component.level = -30;
+    // Noise has no frequency
+    if ((NOISE == component.type) && (2 == fields.size())) { fields.insert(fields.begin()+1, "0"); }
+    char *end = 0;
+    if (fields.size() > 1) {
+      component.frequency = strtod(fields[1].c_str(), &end);
+      if (*end) { return false; }
+    }
+    if (fields.size() > 2) {
+      component.level = strtod(fields[2].c_str(), &end);
+      if (*end) { return false; }
+    }
+    if ((IMPULSE == component.type) &&
+        ((! (component.frequency > 0)) || (component.frequency > MaxBurstRate))) {
+      return false;
+    }
+    components.push_back(component);
+  }
+  return true;
+}
+
+std::string
+SignalGenerator::serialize(const std::vector<Component> &components) {
+  std::ostringstream stream;
+  for (size_t i=0; i<components.size(); i++) {
+    if (i) { stream << ","; }
+    stream << generator_type_names[components[i].type];
+    if (NOISE != components[i].type) { stream << ":" << components[i].frequency; }
+    stream << ":" << components[i].level;
+  }
+  return stream.str();
+}
+
+
+
+/* ******************************************************************************************** *
+ * Implementation of GeneratorSourceConfig
+ * ******************************************************************************************** */
+GeneratorSourceConfig::GeneratorSourceConfig()
+  : _config(Configuration::get())
+{
+  // pass...
+}
+
+GeneratorSourceConfig::~GeneratorSourceConfig() {
+  // pass...
+}
+
+double
+GeneratorSourceConfig::sampleRate() const {
+  return _config.value("GeneratorSource/sampleRate", 2.4e6).toDouble();
+}
+
+void
+GeneratorSourceConfig::storeSampleRate(double rate) {
+  _config.setValue("GeneratorSource/sampleRate", rate);
+}
+
+bool
+GeneratorSourceConfig::paced() const {
+  return _config.value("GeneratorSource/paced", true).toBool();
+}
+
+void
+GeneratorSourceConfig::storePaced(bool paced) {
+  _config.setValue("GeneratorSource/paced", paced);
+}
+
+QString
+GeneratorSourceConfig::spec() const {
+  return _config.value("GeneratorSource/signals", generator_default_spec).toString();
+}
+
+void
+GeneratorSourceConfig::storeSpec(const QString &spec) {
+  _config.setValue("GeneratorSource/signals", spec);
+}
+
+
+
+/* ******************************************************************************************** *
+ * Implementation of GeneratorSource
+ * ******************************************************************************************** */
+GeneratorSource::GeneratorSource(QObject *parent)
+  : DataSource(parent), _generator(GeneratorSourceConfig().sampleRate(),
+                                   GeneratorSourceConfig().paced()),
+    _config()
+{
+  std::vector<SignalGenerator::Component> components;
+  if (! SignalGenerator::parse(_config.spec().toStdString(), components)) {
+    SignalGenerator::parse(generator_default_spec, components);
+  }
+  _generator.setComponents(components);
+}
+
+GeneratorSource::~GeneratorSource() {
+  // pass...
+}
+
+QWidget *
+GeneratorSource::createCtrlView() {
+  return new GeneratorCtrlView(this);
+}
+
+Source *
+GeneratorSource::source() {
+  return &_generator;
+}
+
+void
+GeneratorSource::triggerNext() {
+  _generator.next();
+}
+
+void
+GeneratorSource::queueStarted() {
+  _generator.reset();
+}
+
+double
+GeneratorSource::sampleRate() const {
+  return _generator.sampleRate();
+}
+
+void
+GeneratorSource::setSampleRate(double rate) {
+  bool is_running = sdr::Queue::get().isRunning();
+  if (is_running) { sdr::Queue::get().stop(); sdr::Queue::get().wait(); }
+  _generator.setSampleRate(rate);
+  _config.storeSampleRate(rate);
+  if (is_running) { sdr::Queue::get().start(); }
+}
+
+bool
+GeneratorSource::isPaced() const {
+  return _generator.isPaced();
+}
+
+void
+GeneratorSource::setPaced(bool paced) {
+  _generator.setPaced(paced);
+  _config.storePaced(paced);
+}
+
+QString
+GeneratorSource::spec() const {
+  return QString::fromStdString(SignalGenerator::serialize(_generator.components()));
+}
+
+bool
+GeneratorSource::setSpec(const QString &spec) {
+  std::vector<SignalGenerator::Component> components;
+  if (! SignalGenerator::parse(spec.toStdString(), components)) { return false; }
+  bool is_running = sdr::Queue::get().isRunning();
+  if (is_running) { sdr::Queue::get().stop(); sdr::Queue::get().wait(); }
+  _generator.setComponents(components);
+  _config.storeSpec(spec);
+  if (is_running) { sdr::Queue::get().start(); }
+  return true;
+}
+
+
+
+/* ******************************************************************************************** *
+ * Implementation of GeneratorCtrlView
+ * ******************************************************************************************** */
+GeneratorCtrlView::GeneratorCtrlView(GeneratorSource *source, QWidget *parent)
+  : QWidget(parent), _source(source)
+{
+  _sampleRates = new QComboBox();
+  _sampleRates->addItem("3.2 MS/s", 3.2e6);
+  _sampleRates->addItem("2.4 MS/s", 2.4e6);
+  _sampleRates->addItem("2 MS/s", 2e6);
+  _sampleRates->addItem("1 MS/s", 1e6);
+  _sampleRates->addItem("300 kS/s", 300e3);
+  _sampleRates->addItem("48 kS/s", 48e3);
+  int idx = _sampleRates->findData(_source->sampleRate());
+  if (0 > idx) {
+    _sampleRates->addItem(QString("%1 S/s").arg(_source->sampleRate()), _source->sampleRate());
+    idx = _sampleRates->count()-1;
+  }
+  _sampleRates->setCurrentIndex(idx);
+
+  _paced = new QCheckBox("real time");
+  _paced->setChecked(_source->isPaced());
+
+  _spec = new QLineEdit(_source->spec());
+  _spec->setToolTip("Comma separated list of type:frequency:level, with type one of tone, am, "
+                       "fm, usb, lsb, psk31, noise or impulse.");
+  _error = new QLabel("<b>Invalid signal specification.</b>");
+  _error->setVisible(false);
+
+  QFormLayout *layout = new QFormLayout();
+  layout->addRow("Sample rate", _sampleRates);
+  layout->addRow("Pacing", _paced);
+  layout->addRow("Signals", _spec);
+  layout->addWidget(_error);
+  setLayout(layout);
+
+  QObject::connect(_sampleRates, SIGNAL(currentIndexChanged(int)), this, SLOT(onSampleRateSelected(int)));
+  QObject::connect(_paced, SIGNAL(toggled(bool)), this, SLOT(onPacedToggled(bool)));
+  QObject::connect(_spec, SIGNAL(returnPressed()), this, SLOT(onSpecChanged()));
+}
+
+GeneratorCtrlView::~GeneratorCtrlView() {
+  // pass...
+}
+
+void
+GeneratorCtrlView::onSampleRateSelected(int idx) {
+  _source->setSampleRate(_sampleRates->itemData(idx).toDouble());
+}
+
+void
+GeneratorCtrlView::onPacedToggled(bool paced) {
+  _source->setPaced(paced);
+}
+
+void
+GeneratorCtrlView::onSpecChanged() {
+  _error->setVisible(! _source->setSpec(_spec->text()));
+}
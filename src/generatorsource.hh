@@ -0,0 +1,188 @@
+#ifndef __SDR_RX_GENERATORSOURCE_HH__
+#define __SDR_RX_GENERATORSOURCE_HH__
+
+#include "source.hh"
+#include "configuration.hh"
+
+#include <string>
+#include <vector>
+
+#include <QLabel>
+#include <QLineEdit>
+#include <QComboBox>
+#include <QCheckBox>
+
+
+/** A source node generating a composite I/Q test signal.
+ *
+ * The signal is a sum of tones, AM, FM & SSB modulated voice-like signals, BPSK31 carriers (idle
+ * sequence), noise and impulse bursts. It is precomputed once into a table covering
+ * @c TablePeriod seconds, the frequencies of all components are rounded to an integer number of
+ * cycles per table, hence the table repeats seamlessly. The table holds one extra buffer copied
+ * from its beginning, so every output buffer is a contiguous slice of the table and gets sent
+ * without copying. Hence generating the signal is nearly free.
+ *
+ * A buffer is sent on every call to @c next, from the idle callback of the queue. In paced mode,
+ * @c next waits until the buffer is due in real time, otherwise the buffers are generated as fast
+ * as they get processed. */
+class SignalGenerator: public sdr::Source
+{
+public:
+  /** Possible signal components. */
+  typedef enum {
+    TONE,     ///< Unmodulated carrier.
+    AM,       ///< AM modulated voice-like signal.
+    FM,       ///< FM modulated voice-like signal, 5 kHz deviation.
+    USB,      ///< Upper side band voice-like signal.
+    LSB,      ///< Lower side band voice-like signal.
+    PSK31,    ///< BPSK31 carrier sending the idle sequence.
+    NOISE,    ///< White gaussian noise, the frequency is ignored.
+    IMPULSE   ///< Impulse bursts, the frequency specifies the bursts per second.
+  } Type;
+
+  /** A signal component. */
+  typedef struct {
+    Type type;
+    /** Frequency offset in Hz. */
+    double frequency;
+    /** Level in dBFS. */
+    double level;
+  } Component;
+
+  /** Duration of the table in seconds, a multiple of the BPSK31 symbol duration. */
+  static const double TablePeriod;
+  /** Maximum rate of impulse bursts per second. */
+  static const double MaxBurstRate;
+
+public:
+  /** Constructor.
+   * @param sampleRate Specifies the sample rate.
+   * @param paced If @c true, the buffers are generated in real time. */
+  SignalGenerator(double sampleRate, bool paced=true);
+  /** Destructor. */
+  virtual ~SignalGenerator();
+
+  inline double sampleRate() const { return _sample_rate; }
+  /** Sets the sample rate and rebuilds the table. Must not be called while the queue is running. */
+  void setSampleRate(double rate);
+
+  inline bool isPaced() const { return _paced; }
+  void setPaced(bool paced);
+
+  inline const std::vector<Component> &components() const { return _components; }
+  /** Sets the signal components and rebuilds the table. Must not be called while the queue is
+   * running. */
+  void setComponents(const std::vector<Component> &components);
+
+  /** Restarts the real time reference, call before the queue gets started. */
+  void reset();
+  /** Sends the next buffer. */
+  void next();
+
+  /** Parses a comma separated list of components of the form "type:frequency:level" (e.g.
+   * "am:-100e3:-30,noise:-50"), the frequency may be omitted for noise. The burst rate of
+   * impulses must be positive and must not exceed @c MaxBurstRate. Returns @c false on error. */
+  static bool parse(const std::string &spec, std::vector<Component> &components);
+  /** Serializes the given components into the form accepted by @c parse. */
+  static std::string serialize(const std::vector<Component> &components);
+
+protected:
+  /** Computes the table. */
+  void _build();
+
+protected:
+  double _sample_rate;
+  bool _paced;
+  std::vector<Component> _components;
+  /** Number of samples per buffer (about 10ms). */
+  size_t _buffer_size;
+  /** Number of samples of one period of the table. */
+  size_t _period;
+  /** The table, holds one extra buffer at the end. */
+  sdr::Buffer< std::complex<int16_t> > _table;
+  /** Position of the next buffer in the table. */
+  size_t _pos;
+  /** Time of the last reset in us and number of samples sent since. */
+  int64_t _start;
+  uint64_t _samples;
+};
+
+
+/** Persistent configuration of the signal generator. */
+class GeneratorSourceConfig
+{
+public:
+  GeneratorSourceConfig();
+  virtual ~GeneratorSourceConfig();
+
+  double sampleRate() const;
+  void storeSampleRate(double rate);
+
+  bool paced() const;
+  void storePaced(bool paced);
+
+  QString spec() const;
+  void storeSpec(const QString &spec);
+
+protected:
+  /** The global config instance. */
+  Configuration &_config;
+};
+
+
+/** A data source producing a synthetic test signal, allows to test the receiver without any
+ * hardware. */
+class GeneratorSource: public DataSource
+{
+  Q_OBJECT
+
+public:
+  explicit GeneratorSource(QObject *parent=0);
+  virtual ~GeneratorSource();
+
+  virtual QWidget *createCtrlView();
+  virtual sdr::Source *source();
+
+  virtual void triggerNext();
+  virtual void queueStarted();
+
+  double sampleRate() const;
+  void setSampleRate(double rate);
+
+  bool isPaced() const;
+  void setPaced(bool paced);
+
+  /** Returns the signal components, see @c SignalGenerator::parse. */
+  QString spec() const;
+  /** Sets the signal components, see @c SignalGenerator::parse. Returns @c false if the
+   * specification is invalid. */
+  bool setSpec(const QString &spec);
+
+protected:
+  SignalGenerator _generator;
+  GeneratorSourceConfig _config;
+};
+
+
+class GeneratorCtrlView: public QWidget
+{
+  Q_OBJECT
+
+public:
+  GeneratorCtrlView(GeneratorSource *source, QWidget *parent=0);
+  virtual ~GeneratorCtrlView();
+
+protected slots:
+  void onSampleRateSelected(int idx);
+  void onPacedToggled(bool paced);
+  void onSpecChanged();
+
+protected:
+  GeneratorSource *_source;
+  QComboBox *_sampleRates;
+  QCheckBox *_paced;
+  QLineEdit *_spec;
+  QLabel *_error;
+};
+
+#endif // __SDR_RX_GENERATORSOURCE_HH__
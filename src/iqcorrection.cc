@@ -0,0 +1,123 @@
+#include "iqcorrection.hh"
+#include "bufferpool.hh"
+#include "logger.hh"
+#include <algorithm>
+
+using namespace sdr;
+
+
+/* ******************************************************************************************** *
+ * Implementation of IQCorrection
+ * ******************************************************************************************** */
+IQCorrection::IQCorrection(double tau)
+  : Sink< std::complex<int16_t> >(), Source(), _enabled(true), _tau(tau), _rate(0), _reset(true),
+    _meanI(0), _meanQ(0), _II(0), _QQ(0), _IQ(0), _dc(0), _gain(1), _sinPhi(0), _c1(0), _c2(1),
+    _buffer()
+{
+  // pass...
+}
+
+IQCorrection::~IQCorrection() {
+  BufferPool::get().release(_buffer);
+}
+
+void
+IQCorrection::reset() {
+  _reset = true;
+}
+
+void
+IQCorrection::config(const Config &src_cfg) {
+  // Requires type, sample rate & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+  // Check buffer type
+  if (Config::typeId< std::complex<int16_t> >() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure IQCorrection: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId< std::complex<int16_t> >();
+    throw err;
+  }
+
+  // The imbalance depends on the tuner settings, keep the estimates unless the rate changed
+  if (_rate != src_cfg.sampleRate()) { _reset = true; }
+  _rate = src_cfg.sampleRate();
+
+  BufferPool::get().release(_buffer);
+  _buffer = BufferPool::get().acquire< std::complex<int16_t> >(src_cfg.bufferSize());
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Configured IQCorrection node: " << this << std::endl
+      << " sample-rate: " << _rate << std::endl
+      << " time constant: " << _tau << "s";
+  Logger::get().log(msg);
+
+  this->setConfig(Config(Config::typeId< std::complex<int16_t> >(), src_cfg.sampleRate(),
+                         src_cfg.bufferSize(), 1));
+}
+
+void
+IQCorrection::process(const Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite) {
+  if (! _enabled) {
+    this->send(buffer, allow_overwrite);
+    return;
+  }
+
+  Buffer< std::complex<int16_t> > out;
+  if (allow_overwrite) {
+    out = buffer;
+  } else if (_buffer.isUnused()) {
+    out = _buffer;
+  } else {
+#ifdef SDR_DEBUG
+    LogMessage msg(LOG_WARNING);
+    msg << "IQCorrection: Drop buffer: Output buffer still in use.";
+    Logger::get().log(msg);
+#endif
+    return;
+  }
+
+  // Correct with the current estimates and collect the moments of the input in one pass
+  const int16_t *in = reinterpret_cast<const int16_t *>(buffer.data());
+  int16_t *res = reinterpret_cast<int16_t *>(out.data());
+  const float dcI = _dc.real(), dcQ = _dc.imag(), c1 = _c1, c2 = _c2;
+  double sumI = 0, sumQ = 0, sumII = 0, sumQQ = 0, sumIQ = 0;
+  size_t N = buffer.size();
+  for (size_t i=0; i<N; i++) {
+    float I = in[2*i], Q = in[2*i+1];
+    sumI += I; sumQ += Q;
+    sumII += double(I)*I; sumQQ += double(Q)*Q; sumIQ += double(I)*Q;
+    float x = I-dcI, y = c1*x + c2*(Q-dcQ);
+    res[2*i]   = int16_t(std::max(-32768.0f, std::min(32767.0f, x)));
+    res[2*i+1] = int16_t(std::max(-32768.0f, std::min(32767.0f, y)));
+  }
+
+  _update(sumI, sumQ, sumII, sumQQ, sumIQ, N);
+
+  this->send(out.head(N), true);
+}
+
+void
+IQCorrection::_update(double sumI, double sumQ, double sumII, double sumQQ, double sumIQ,
+                      size_t N)
+{
+  if (0 == N) { return; }
+  // Weight of this buffer
+  double w = _reset ? 1 : (1-std::exp(-double(N)/(_tau*_rate)));
+  _reset = false;
+  _meanI += w*(sumI/N - _meanI);
+  _meanQ += w*(sumQ/N - _meanQ);
+  _II += w*(sumII/N - _II);
+  _QQ += w*(sumQQ/N - _QQ);
+  _IQ += w*(sumIQ/N - _IQ);
+
+  // Central moments
+  double vI = _II - _meanI*_meanI, vQ = _QQ - _meanQ*_meanQ, cIQ = _IQ - _meanI*_meanQ;
+  _dc = std::complex<double>(_meanI, _meanQ);
+  // Keep the previous coefficients without signal
+  if ((vI < 1) || (vQ < 1)) { return; }
+  _gain = std::sqrt(vQ/vI);
+  _sinPhi = std::max(-0.5, std::min(0.5, cIQ/std::sqrt(vI*vQ)));
+  double cosPhi = std::sqrt(1-_sinPhi*_sinPhi);
+  _c1 = -_sinPhi/cosPhi;
+  _c2 = 1/(_gain*cosPhi);
+}
@@ -0,0 +1,70 @@
+#ifndef __SDR_RX_IQCORRECTION_HH__
+#define __SDR_RX_IQCORRECTION_HH__
+
+#include "node.hh"
+#include <cmath>
+
+
+/** Blind adaptive correction of the DC offset and the gain and phase imbalance of an I/Q signal.
+ *
+ * The correction relies on the signal being circular on average, as the mix of signals and noise
+ * received over the full bandwidth of a SDR is. Hence the DC offset is the mean of I and Q and,
+ * for the zero-mean signal, E[Q^2]/E[I^2] yields the gain imbalance @c g and
+ * E[IQ]/sqrt(E[I^2]E[Q^2]) the sine of the phase imbalance @c phi. These moments are summed
+ * per input buffer and averaged over buffers with a slow time constant, the correction
+ * coefficients get updated once per buffer. The correction itself is a single pass
+ *   I' = I - dcI, Q' = c1*I' + c2*(Q - dcQ), with c1 = -tan(phi) and c2 = 1/(g cos(phi)),
+ * which also accumulates the moments for the next update. */
+class IQCorrection: public sdr::Sink< std::complex<int16_t> >, public sdr::Source
+{
+public:
+  /** Constructor.
+   * @param tau Specifies the time constant of the estimation in seconds. */
+  IQCorrection(double tau=0.5);
+  /** Destructor. */
+  virtual ~IQCorrection();
+
+  /** Returns @c true if the correction is enabled. */
+  inline bool enabled() const { return _enabled; }
+  /** Enables or disables the correction. If disabled, the input is passed through. */
+  inline void enable(bool enable) { _enabled = enable; }
+
+  /** Returns the estimated gain imbalance (Q w.r.t. I) in dB. */
+  inline double gainImbalance() const { return 20*std::log10(_gain); }
+  /** Returns the estimated phase imbalance in degree. */
+  inline double phaseImbalance() const { return std::asin(_sinPhi)*180/M_PI; }
+  /** Returns the estimated DC offset relative to full scale. */
+  inline std::complex<double> dcOffset() const { return _dc/32768.; }
+
+  /** Restarts the estimation. */
+  void reset();
+
+  /** Configures the correction. */
+  virtual void config(const sdr::Config &src_cfg);
+  /** Performs the correction. */
+  virtual void process(const sdr::Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite);
+
+protected:
+  /** Updates the estimates from the moments of a buffer of @c N samples. */
+  void _update(double sumI, double sumQ, double sumII, double sumQQ, double sumIQ, size_t N);
+
+protected:
+  /** If @c true, the correction is enabled. */
+  bool _enabled;
+  /** Time constant and the resulting weight of a buffer of the given size. */
+  double _tau;
+  double _rate;
+  /** If @c true, the next buffer initializes the estimates. */
+  bool _reset;
+  /** Averaged moments (of the DC corrected signal). */
+  double _meanI, _meanQ, _II, _QQ, _IQ;
+  /** Current estimates. */
+  std::complex<double> _dc;
+  double _gain, _sinPhi;
+  /** Correction coefficients. */
+  float _c1, _c2;
+  /** The output buffer. */
+  sdr::Buffer< std::complex<int16_t> > _buffer;
+};
+
+#endif // __SDR_RX_IQCORRECTION_HH__
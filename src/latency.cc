@@ -0,0 +1,208 @@
+#include "latency.hh"
+#include "logger.hh"
+
+#include <chrono>
+#include <algorithm>
+#include <iomanip>
+#include <time.h>
+
+using namespace sdr;
+
+
+/* ******************************************************************************************** *
+ * Implementation of LatencyProbe
+ * ******************************************************************************************** */
+LatencyProbe::LatencyProbe(LatencyMonitor *monitor, const std::string &name)
+  : SinkBase(), _monitor(monitor), _name(name), _rate(0), _sample_size(0), _samples(0),
+    _cpu_time(true)
+{
+  reset();
+}
+
+LatencyProbe::~LatencyProbe() {
+  // pass...
+}
+
+void
+LatencyProbe::reset() {
+  _samples = 0;
+  for (size_t i=0; i<NumBins; i++) { _bins[i] = 0; }
+  _count = 0; _sum = 0; _max = 0;
+}
+
+double
+LatencyProbe::mean() const {
+  size_t n = _count;
+  return n ? 1e-3*double(_sum)/n : 0;
+}
+
+double
+LatencyProbe::max() const {
+  return 1e-3*_max;
+}
+
+double
+LatencyProbe::quantile(double q) const {
+  size_t n = _count, target = size_t(q*n), sum = 0;
+  for (size_t i=0; i<NumBins; i++) {
+    sum += _bins[i];
+    if (sum > target) { return 1e-3*(uint64_t(1) << i); }
+  }
+  return 1e-3*(uint64_t(1) << (NumBins-1));
+}
+
+void
+LatencyProbe::histogram(std::vector<size_t> &bins) const {
+  bins.resize(NumBins);
+  for (size_t i=0; i<NumBins; i++) { bins[i] = _bins[i]; }
+}
+
+void
+LatencyProbe::config(const Config &src_cfg) {
+  // Requires type & sample rate
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate()) { return; }
+  _rate = src_cfg.sampleRate();
+  _sample_size = LatencyMonitor::sampleSize(src_cfg.type());
+  _samples = 0;
+}
+
+void
+LatencyProbe::handleBuffer(const RawBuffer &buffer, bool allow_overwrite) {
+  if ((0 == _sample_size) || (0 == _rate) || (0 == _monitor->sampleRate())) { return; }
+  if (_cpu_time) { _monitor->updateCPUTime(); }
+  _samples += buffer.bytesLen()/_sample_size;
+  // Index of the source sample corresponding to the last sample of this buffer
+  uint64_t index = uint64_t(_samples*(_monitor->sampleRate()/_rate));
+  int64_t captured;
+  if ((0 == index) || (! _monitor->captureTime(index-1, captured))) { return; }
+
+  uint64_t dt = std::max(int64_t(0), LatencyMonitor::now()-captured);
+  size_t bin = 0;
+  while ((bin < (NumBins-1)) && ((uint64_t(1) << bin) <= dt)) { bin++; }
+  _bins[bin]++; _count++; _sum += dt;
+  if (dt > _max) { _max = dt; }
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of LatencyMonitor
+ * ******************************************************************************************** */
+LatencyMonitor::LatencyMonitor()
+  : SinkBase(), _rate(0), _sample_size(0), _samples(0), _reset(false), _cpu_start(-1),
+    _cpu_time(0), _num_marks(0), _probes()
+{
+  // pass...
+}
+
+LatencyMonitor::~LatencyMonitor() {
+  for (size_t i=0; i<_probes.size(); i++) { delete _probes[i]; }
+}
+
+LatencyProbe *
+LatencyMonitor::probe(const std::string &name) {
+  LatencyProbe *probe = new LatencyProbe(this, name);
+  _probes.push_back(probe);
+  return probe;
+}
+
+bool
+LatencyMonitor::captureTime(uint64_t index, int64_t &time) const {
+  if (0 == _num_marks) { return false; }
+  // If the stage is ahead of the source (rounding), use the last buffer
+  const Mark &last = _marks[(_num_marks-1) % NumMarks];
+  if (index >= last.end) { time = last.time; return true; }
+  // Search the buffer containing the sample
+  size_t first = (_num_marks > NumMarks) ? (_num_marks-NumMarks) : 0;
+  for (size_t k=_num_marks-1; k>first; k--) {
+    if (_marks[(k-1) % NumMarks].end <= index) { time = _marks[k % NumMarks].time; return true; }
+  }
+  // Sample is in the first buffer or too old
+  if (0 == first) { time = _marks[0].time; return true; }
+  return false;
+}
+
+double
+LatencyMonitor::cpuLoad() const {
+  uint64_t samples = _samples;
+  if ((0 == samples) || (0 == _rate)) { return 0; }
+  return 1e-6*double(_cpu_time)/(samples/_rate);
+}
+
+void
+LatencyMonitor::updateCPUTime() {
+  int64_t now = threadCPUTime();
+  if (0 > _cpu_start) { _cpu_start = now; }
+  _cpu_time = now - _cpu_start;
+}
+
+void
+LatencyMonitor::reset() {
+  _reset = true; _cpu_start = -1; _cpu_time = 0;
+  for (size_t i=0; i<_probes.size(); i++) { _probes[i]->reset(); }
+}
+
+void
+LatencyMonitor::report(std::ostream &stream) const {
+  for (size_t i=0; i<_probes.size(); i++) {
+    const LatencyProbe *probe = _probes[i];
+    stream << " " << std::setw(10) << std::left << probe->name() << std::right
+           << " n=" << probe->count() << std::fixed << std::setprecision(2)
+           << ", mean=" << probe->mean() << "ms, p50=" << probe->quantile(0.5)
+           << "ms, p99=" << probe->quantile(0.99) << "ms, max=" << probe->max() << "ms"
+           << std::endl;
+  }
+  stream << " " << std::setw(10) << std::left << "cpu" << std::right << " "
+         << std::fixed << std::setprecision(2) << cpuLoad() << "ms per s of input";
+}
+
+void
+LatencyMonitor::config(const Config &src_cfg) {
+  // Requires type & sample rate
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate()) { return; }
+  _rate = src_cfg.sampleRate();
+  _sample_size = sampleSize(src_cfg.type());
+  reset();
+}
+
+void
+LatencyMonitor::handleBuffer(const RawBuffer &buffer, bool allow_overwrite) {
+  if (0 == _sample_size) { return; }
+  if (_reset.exchange(false)) { _samples = 0; _num_marks = 0; }
+  uint64_t samples = (_samples += buffer.bytesLen()/_sample_size);
+  Mark &mark = _marks[_num_marks % NumMarks];
+  mark.end = samples; mark.time = now();
+  _num_marks++;
+}
+
+int64_t
+LatencyMonitor::now() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t
+LatencyMonitor::threadCPUTime() {
+  struct timespec ts;
+  if (0 != clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) { return 0; }
+  return int64_t(ts.tv_sec)*1000000000 + ts.tv_nsec;
+}
+
+size_t
+LatencyMonitor::sampleSize(Config::Type type) {
+  switch (type) {
+  case Config::Type_u8:
+  case Config::Type_s8: return 1;
+  case Config::Type_u16:
+  case Config::Type_s16:
+  case Config::Type_cu8:
+  case Config::Type_cs8: return 2;
+  case Config::Type_f32:
+  case Config::Type_cu16:
+  case Config::Type_cs16: return 4;
+  case Config::Type_f64:
+  case Config::Type_cf32: return 8;
+  case Config::Type_cf64: return 16;
+  default: break;
+  }
+  return 0;
+}
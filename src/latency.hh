@@ -0,0 +1,157 @@
+#ifndef __SDR_RX_LATENCY_HH__
+#define __SDR_RX_LATENCY_HH__
+
+#include "node.hh"
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <ostream>
+
+// Forward declaration
+class LatencyMonitor;
+
+
+/** Measures the latency of a processing stage.
+ *
+ * The probe gets connected to the output of a stage and counts the samples passing. The sample
+ * count is scaled by the ratio of the source and stage sample rates, which yields the index of
+ * the corresponding source sample. The latency is then the time elapsed since that sample was
+ * captured, as recorded by the @c LatencyMonitor at the source. The latencies are collected in a
+ * histogram with logarithmically spaced bins (powers of two microseconds). */
+class LatencyProbe: public sdr::SinkBase
+{
+public:
+  /** Number of histogram bins, the last bin collects all latencies >= 2^(NumBins-1) us. */
+  static const size_t NumBins = 24;
+
+public:
+  /** Constructor, use @c LatencyMonitor::probe to create a probe. */
+  LatencyProbe(LatencyMonitor *monitor, const std::string &name);
+  /** Destructor. */
+  virtual ~LatencyProbe();
+
+  /** Returns the name of the stage. */
+  inline const std::string &name() const { return _name; }
+
+  /** Resets the sample counter and the statistics. */
+  void reset();
+  /** Enables or disables updating the CPU time of the monitor. Only probes called from the
+   * processing thread may update it, see @c LatencyMonitor::cpuLoad. Enabled by default. */
+  inline void enableCPUTime(bool enable) { _cpu_time = enable; }
+
+  /** Returns the number of measurements. */
+  inline size_t count() const { return _count; }
+  /** Returns the mean latency in ms. */
+  double mean() const;
+  /** Returns the maximum latency in ms. */
+  double max() const;
+  /** Returns the (upper bin boundary of the) given quantile of the latency in ms. */
+  double quantile(double q) const;
+  /** Returns the histogram, bin @c i counts latencies in [2^(i-1), 2^i) us. */
+  void histogram(std::vector<size_t> &bins) const;
+
+  virtual void config(const sdr::Config &src_cfg);
+  virtual void handleBuffer(const sdr::RawBuffer &buffer, bool allow_overwrite);
+
+protected:
+  /** The monitor holding the capture times. */
+  LatencyMonitor *_monitor;
+  /** The name of the stage. */
+  std::string _name;
+  /** Sample rate and sample size of the stage. */
+  double _rate;
+  size_t _sample_size;
+  /** Number of samples passed since the last reset. */
+  uint64_t _samples;
+  /** If @c true, the probe updates the CPU time of the monitor. */
+  bool _cpu_time;
+  /** The histogram. */
+  std::atomic<size_t> _bins[NumBins];
+  /** Number of measurements, sum and maximum of the latencies in us. */
+  std::atomic<size_t> _count;
+  std::atomic<uint64_t> _sum, _max;
+};
+
+
+/** Records the capture times of the source samples and owns the probes of all stages.
+ *
+ * The monitor gets connected directly to the output of the data source, it keeps the index of the
+ * last sample and the arrival time of the recent buffers. All probes get reset when the queue is
+ * started. As buffers carry no time stamps, the measurement relies on counting samples; dropped
+ * buffers let the stages lag behind the source and show up as increased latency. */
+class LatencyMonitor: public sdr::SinkBase
+{
+protected:
+  /** Number of source buffers remembered. */
+  static const size_t NumMarks = 256;
+
+  /** Index of the last sample of a source buffer and its arrival time. */
+  typedef struct {
+    uint64_t end;
+    int64_t time;
+  } Mark;
+
+public:
+  /** Constructor. */
+  LatencyMonitor();
+  /** Destructor, deletes all probes. */
+  virtual ~LatencyMonitor();
+
+  /** Creates a probe for the given stage. The probe is owned by the monitor. */
+  LatencyProbe *probe(const std::string &name);
+  /** Returns all probes. */
+  inline const std::vector<LatencyProbe *> &probes() const { return _probes; }
+
+  /** Returns the sample rate of the source. */
+  inline double sampleRate() const { return _rate; }
+  /** Returns the capture time (in us) of the specified source sample. Returns @c false if the
+   * sample is too old. */
+  bool captureTime(uint64_t index, int64_t &time) const;
+
+  /** Returns the number of source samples since the last reset. */
+  inline uint64_t samples() const { return _samples; }
+  /** Returns the CPU time in ms spent by the processing thread per second of source samples
+   * since the last reset, i.e. the processing cost of the chain behind the source. The processing
+   * thread is the one passing buffers to the probes, the capture threads and the GUI are not
+   * included. Returns 0 if no samples passed. */
+  double cpuLoad() const;
+  /** Updates the CPU time of the processing thread, called by the probes. */
+  void updateCPUTime();
+
+  /** Resets the monitor and all probes. The sample counter and the capture times get reset by
+   * the thread feeding the monitor, once it passes the next buffer. Hence the monitor can be reset
+   * while samples arrive. */
+  void reset();
+  /** Writes a summary of all stages to the given stream. */
+  void report(std::ostream &stream) const;
+
+  virtual void config(const sdr::Config &src_cfg);
+  virtual void handleBuffer(const sdr::RawBuffer &buffer, bool allow_overwrite);
+
+  /** Returns the current time in us. */
+  static int64_t now();
+  /** Returns the CPU time of the calling thread in ns. */
+  static int64_t threadCPUTime();
+  /** Returns the size of a sample of the given type in bytes. */
+  static size_t sampleSize(sdr::Config::Type type);
+
+protected:
+  /** Sample rate and sample size of the source. */
+  double _rate;
+  size_t _sample_size;
+  /** Number of source samples since the last reset, read by other threads as capture clock. */
+  std::atomic<uint64_t> _samples;
+  /** A reset of the sample counter and capture times is pending. */
+  std::atomic<bool> _reset;
+  /** CPU time of the processing thread at its first buffer after the last reset (or -1) and
+   * the CPU time spent since, in ns. */
+  std::atomic<int64_t> _cpu_start, _cpu_time;
+  /** The recent source buffers. */
+  Mark _marks[NumMarks];
+  size_t _num_marks;
+  /** The probes. */
+  std::vector<LatencyProbe *> _probes;
+};
+
+#endif // __SDR_RX_LATENCY_HH__
@@ -0,0 +1,84 @@
+#ifndef __SDR_RX_LOCKFREERING_HH__
+#define __SDR_RX_LOCKFREERING_HH__
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+
+/** A bounded, lock-free single-producer/single-consumer ring buffer.
+ * The producer (usually the queue thread) calls @c put, the consumer (e.g. the GUI thread or a
+ * writer thread) calls @c take. The capacity gets rounded up to the next power of two. If the
+ * ring is full, @c put stores only as many elements as there is space and returns that number,
+ * hence the producer never blocks. */
+template <class Scalar>
+class LockFreeRing
+{
+public:
+  /** Constructs a ring buffer able to hold at least @c capacity elements. */
+  explicit LockFreeRing(size_t capacity=1024)
+    : _head(0), _tail(0), _dropped(0)
+  {
+    size_t N = 1; while (N < capacity) { N <<= 1; }
+    _data.resize(N); _mask = N-1;
+  }
+
+  /** Returns the capacity of the ring. */
+  inline size_t capacity() const { return _data.size(); }
+
+  /** Returns the number of elements currently stored. */
+  inline size_t stored() const {
+    return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+  }
+  /** Returns the number of free slots. */
+  inline size_t free() const { return capacity() - stored(); }
+
+  /** Returns the number of elements dropped by @c put since the last call to
+   * @c resetDropped. */
+  inline size_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+  inline void resetDropped() { _dropped.store(0, std::memory_order_relaxed); }
+
+  /** Stores up to @c N elements (producer side). Returns the number of elements stored. */
+  size_t put(const Scalar *data, size_t N) {
+    size_t head = _head.load(std::memory_order_relaxed);
+    size_t tail = _tail.load(std::memory_order_acquire);
+    size_t n = std::min(N, capacity()-(head-tail));
+    for (size_t i=0; i<n; i++) { _data[(head+i) & _mask] = data[i]; }
+    _head.store(head+n, std::memory_order_release);
+    if (n < N) { _dropped.fetch_add(N-n, std::memory_order_relaxed); }
+    return n;
+  }
+
+  /** Stores a single element (producer side). Returns @c false if the ring is full. */
+  inline bool put(const Scalar &value) { return 1 == put(&value, 1); }
+
+  /** Takes up to @c N elements (consumer side). Returns the number of elements taken. */
+  size_t take(Scalar *data, size_t N) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    size_t head = _head.load(std::memory_order_acquire);
+    size_t n = std::min(N, head-tail);
+    for (size_t i=0; i<n; i++) { data[i] = _data[(tail+i) & _mask]; }
+    _tail.store(tail+n, std::memory_order_release);
+    return n;
+  }
+
+  /** Drops all stored elements (consumer side). */
+  inline void clear() {
+    _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+protected:
+  /** The ring storage. */
+  std::vector<Scalar> _data;
+  /** Index mask (capacity-1). */
+  size_t _mask;
+  /** Write index, only modified by the producer. */
+  std::atomic<size_t> _head;
+  /** Read index, only modified by the consumer. */
+  std::atomic<size_t> _tail;
+  /** Counts the elements dropped due to overflow. */
+  std::atomic<size_t> _dropped;
+};
+
+#endif // __SDR_RX_LOCKFREERING_HH__
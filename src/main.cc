@@ -1,6 +1,7 @@
 #include "libsdr/gui/gui.hh"
 
 #include <QApplication>
+#include <QStringList>
 
 #include "receiver.hh"
 #include "mainwindow.hh"
@@ -17,6 +18,12 @@ int main(int argc, char *argv[]) {
 
   // Instantiate Receiver
   Receiver receiver;
+  // Start control interface if requested by "--control <socket path>"
+  QStringList args = application.arguments();
+  int idx = args.indexOf("--control");
+  if ((0 < idx) && (idx+1 < args.size())) {
+    receiver.startControlServer(args.at(idx+1));
+  }
   // Receiver view
   MainWindow win(&receiver);
   win.show();
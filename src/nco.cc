@@ -0,0 +1,134 @@
+#include "nco.hh"
+#include "bufferpool.hh"
+#include "logger.hh"
+#include <cmath>
+
+using namespace sdr;
+
+
+/* ******************************************************************************************** *
+ * Implementation of NCO
+ * ******************************************************************************************** */
+std::vector<int16_t> NCO::_cos;
+std::vector<int16_t> NCO::_sin;
+
+NCO::NCO(double frequency, double sampleRate)
+  : _frequency(frequency), _sample_rate(sampleRate), _phase(0), _increment(0)
+{
+  // Compute shared tables once
+  if (0 == _cos.size()) {
+    size_t N = size_t(1) << TableBits;
+    _cos.resize(N); _sin.resize(N);
+    for (size_t i=0; i<N; i++) {
+      _cos[i] = int16_t(std::round(32767*std::cos(2*M_PI*i/N)));
+      _sin[i] = int16_t(std::round(32767*std::sin(2*M_PI*i/N)));
+    }
+  }
+  _update();
+}
+
+void
+NCO::setFrequency(double frequency) {
+  _frequency = frequency;
+  _update();
+}
+
+void
+NCO::setSampleRate(double rate) {
+  _sample_rate = rate;
+  _update();
+}
+
+void
+NCO::_update() {
+  // Phase increment modulo 2^32, negative frequencies wrap around
+  double inc = std::fmod(_frequency/_sample_rate, 1.0);
+  if (inc < 0) { inc += 1; }
+  _increment = uint32_t(int64_t(std::round(inc*4294967296.0)));
+}
+
+void
+NCO::mix(const std::complex<int16_t> *in, std::complex<int16_t> *out, size_t N) {
+  const int16_t *x = reinterpret_cast<const int16_t *>(in);
+  int16_t *y = reinterpret_cast<int16_t *>(out);
+  int16_t c[BlockSize], s[BlockSize];
+  uint32_t inc = _increment, phase = _phase;
+  const int shift = 32-TableBits;
+
+  for (size_t offset=0; offset<N; offset+=BlockSize) {
+    size_t n = std::min(BlockSize, N-offset);
+    // Look up oscillator values
+    for (size_t i=0; i<n; i++, phase+=inc) {
+      c[i] = _cos[phase >> shift]; s[i] = _sin[phase >> shift];
+    }
+    // Complex multiplication, no dependencies between iterations
+    const int16_t *xb = x + 2*offset; int16_t *yb = y + 2*offset;
+    for (size_t i=0; i<n; i++) {
+      int32_t re = xb[2*i], im = xb[2*i+1];
+      yb[2*i]   = int16_t((re*c[i] - im*s[i]) >> 15);
+      yb[2*i+1] = int16_t((re*s[i] + im*c[i]) >> 15);
+    }
+  }
+  _phase = phase;
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of NCOMixer
+ * ******************************************************************************************** */
+NCOMixer::NCOMixer(double frequency)
+  : Sink< std::complex<int16_t> >(), Source(), _nco(frequency), _buffer()
+{
+  // pass...
+}
+
+NCOMixer::~NCOMixer() {
+  BufferPool::get().release(_buffer);
+}
+
+void
+NCOMixer::config(const Config &src_cfg) {
+  // Requires type, sample rate & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+  // Check buffer type
+  if (Config::typeId< std::complex<int16_t> >() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure NCOMixer: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId< std::complex<int16_t> >();
+    throw err;
+  }
+
+  _nco.setSampleRate(src_cfg.sampleRate());
+  BufferPool::get().release(_buffer);
+  _buffer = BufferPool::get().acquire< std::complex<int16_t> >(src_cfg.bufferSize());
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Configured NCOMixer node: " << this << std::endl
+      << " sample-rate: " << src_cfg.sampleRate() << std::endl
+      << " frequency: " << _nco.frequency();
+  Logger::get().log(msg);
+
+  this->setConfig(Config(Config::typeId< std::complex<int16_t> >(), src_cfg.sampleRate(),
+                         src_cfg.bufferSize(), 1));
+}
+
+void
+NCOMixer::process(const Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite) {
+  Buffer< std::complex<int16_t> > out;
+  if (allow_overwrite) {
+    out = buffer;
+  } else if (_buffer.isUnused()) {
+    out = _buffer;
+  } else {
+#ifdef SDR_DEBUG
+    LogMessage msg(LOG_WARNING);
+    msg << "NCOMixer: Drop buffer: Output buffer still in use.";
+    Logger::get().log(msg);
+#endif
+    return;
+  }
+
+  _nco.mix(reinterpret_cast<const std::complex<int16_t> *>(buffer.data()),
+           reinterpret_cast<std::complex<int16_t> *>(out.data()), buffer.size());
+  this->send(out.head(buffer.size()), true);
+}
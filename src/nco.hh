@@ -0,0 +1,92 @@
+#ifndef __SDR_RX_NCO_HH__
+#define __SDR_RX_NCO_HH__
+
+#include "node.hh"
+
+#include <atomic>
+#include <vector>
+
+
+/** A table driven numerically controlled oscillator and complex mixer.
+ *
+ * The oscillator is a 32 bit phase accumulator, the upper @c TableBits bits of the phase index a
+ * precomputed table of cos & sin values (Q15), shared by all instances. Changing the frequency
+ * only changes the phase increment, hence retuning is cheap and the phase is continuous. The
+ * phase quantization limits the spurs to about -72 dBc.
+ *
+ * The mixing is performed in blocks: First the table values are looked up for a block of
+ * samples, then the complex multiplication is performed in a separate loop free of dependencies,
+ * which can be vectorized by the compiler. */
+class NCO
+{
+public:
+  /** Number of bits of the table index. */
+  static const size_t TableBits = 12;
+  /** Number of samples processed per block. */
+  static const size_t BlockSize = 256;
+
+public:
+  /** Constructor.
+   * @param frequency Specifies the frequency of the oscillator in Hz.
+   * @param sampleRate Specifies the sample rate in Hz. */
+  NCO(double frequency=0, double sampleRate=1);
+
+  /** Returns the frequency of the oscillator. */
+  inline double frequency() const { return _frequency; }
+  /** Sets the frequency of the oscillator, may be called from any thread. */
+  void setFrequency(double frequency);
+
+  /** Returns the sample rate. */
+  inline double sampleRate() const { return _sample_rate; }
+  /** Sets the sample rate. */
+  void setSampleRate(double rate);
+
+  /** Resets the phase to 0. */
+  inline void reset() { _phase = 0; }
+
+  /** Multiplies @c N samples of @c in with the oscillator signal, @c in and @c out may be the
+   * same. */
+  void mix(const std::complex<int16_t> *in, std::complex<int16_t> *out, size_t N);
+
+protected:
+  /** Updates the phase increment. */
+  void _update();
+
+protected:
+  /** Frequency and sample rate. */
+  double _frequency, _sample_rate;
+  /** Phase and phase increment. */
+  uint32_t _phase;
+  std::atomic<uint32_t> _increment;
+  /** The shared cos & sin tables. */
+  static std::vector<int16_t> _cos, _sin;
+};
+
+
+/** A node shifting the frequency of the complex input signal by the given frequency using a
+ * @c NCO, a drop-in replacement for @c sdr::FreqShift. */
+class NCOMixer: public sdr::Sink< std::complex<int16_t> >, public sdr::Source
+{
+public:
+  /** Constructor.
+   * @param frequency Specifies the frequency shift in Hz. */
+  NCOMixer(double frequency=0);
+  /** Destructor. */
+  virtual ~NCOMixer();
+
+  /** Returns the frequency shift. */
+  inline double frequency() const { return _nco.frequency(); }
+  /** Sets the frequency shift, may be called from any thread. */
+  inline void setFrequency(double frequency) { _nco.setFrequency(frequency); }
+
+  virtual void config(const sdr::Config &src_cfg);
+  virtual void process(const sdr::Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite);
+
+protected:
+  /** The oscillator. */
+  NCO _nco;
+  /** The output buffer. */
+  sdr::Buffer< std::complex<int16_t> > _buffer;
+};
+
+#endif // __SDR_RX_NCO_HH__
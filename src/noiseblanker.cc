@@ -0,0 +1,113 @@
+#include "noiseblanker.hh"
+#include "bufferpool.hh"
+#include "logger.hh"
+#include <cmath>
+#include <cstdlib>
+
+using namespace sdr;
+
+
+NoiseBlanker::NoiseBlanker(float threshold, size_t lookahead, size_t hold)
+  : Sink< std::complex<int16_t> >(), Source(), _enabled(false), _threshold(std::max(1.0f, threshold)),
+    _lookahead(std::max(size_t(1), lookahead)), _hold(hold), _hold_last(false), _avg(0), _alpha(0),
+    _delay_idx(0), _remaining(0), _last(0,0), _blanked(0), _level(0), _buffer()
+{
+  // pass...
+}
+
+NoiseBlanker::~NoiseBlanker() {
+  BufferPool::get().release(_buffer);
+}
+
+void
+NoiseBlanker::config(const Config &src_cfg) {
+  // Requires type, sample rate & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+  // Check buffer type
+  if (Config::typeId< std::complex<int16_t> >() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure NoiseBlanker: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId< std::complex<int16_t> >();
+    throw err;
+  }
+
+  // Average over about 10ms
+  _alpha = 1-std::exp(-1/(0.01*src_cfg.sampleRate()));
+  _avg = 0;
+  _delay.assign(_lookahead, std::complex<int16_t>(0,0));
+  _delay_idx = 0; _remaining = 0;
+  _last = std::complex<int16_t>(0,0);
+
+  BufferPool::get().release(_buffer);
+  _buffer = BufferPool::get().acquire< std::complex<int16_t> >(src_cfg.bufferSize());
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Configured NoiseBlanker node: " << this << std::endl
+      << " sample-rate: " << src_cfg.sampleRate() << std::endl
+      << " threshold: " << _threshold << std::endl
+      << " lookahead: " << _lookahead << ", hold: " << _hold;
+  Logger::get().log(msg);
+
+  this->setConfig(Config(Config::typeId< std::complex<int16_t> >(), src_cfg.sampleRate(),
+                         src_cfg.bufferSize(), 1));
+}
+
+void
+NoiseBlanker::process(const Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite) {
+  // Pass-through if disabled, measure the level on every 16th sample only
+  if (! _enabled) {
+    const int16_t *in = reinterpret_cast<const int16_t *>(buffer.data());
+    size_t N = 2*buffer.size(); int64_t sum = 0; size_t n = 0;
+    for (size_t i=0; i<N; i+=32, n++) { sum += std::abs(int(in[i])) + std::abs(int(in[i+1])); }
+    if (n) { _level = float(sum)/n; }
+    this->send(buffer, allow_overwrite);
+    return;
+  }
+
+  Buffer< std::complex<int16_t> > out;
+  if (allow_overwrite) {
+    out = buffer;
+  } else if (_buffer.isUnused()) {
+    out = _buffer;
+  } else {
+#ifdef SDR_DEBUG
+    LogMessage msg(LOG_WARNING);
+    msg << "NoiseBlanker: Drop buffer: Output buffer still in use.";
+    Logger::get().log(msg);
+#endif
+    return;
+  }
+
+  const std::complex<int16_t> *in = reinterpret_cast<const std::complex<int16_t> *>(buffer.data());
+  std::complex<int16_t> *res = reinterpret_cast< std::complex<int16_t> *>(out.data());
+  const std::complex<int16_t> zero(0,0);
+  float sum = 0;
+  for (size_t i=0; i<buffer.size(); i++) {
+    std::complex<int16_t> x = in[i];
+    float mag = std::abs(int(x.real())) + std::abs(int(x.imag()));
+    sum += mag;
+    float limit = _threshold*_avg;
+    if ((_avg > 0) && (mag > limit)) {
+      // Impulse: blank the samples in the delay line, the impulse and the hold period
+      _remaining = _lookahead + _hold + 1;
+      // Update average with the limit, this lets the average follow a step in signal level
+      // while impulses hardly affect it
+      mag = limit;
+    }
+    _avg += _alpha*(mag-_avg);
+    // Exchange sample with the delay line
+    std::complex<int16_t> y = _delay[_delay_idx];
+    _delay[_delay_idx] = x;
+    if (++_delay_idx == _lookahead) { _delay_idx = 0; }
+    if (_remaining) {
+      _remaining--; _blanked++;
+      res[i] = _hold_last ? _last : zero;
+    } else {
+      res[i] = _last = y;
+    }
+  }
+
+  if (buffer.size()) { _level = sum/buffer.size(); }
+
+  this->send(out.head(buffer.size()), true);
+}
@@ -0,0 +1,83 @@
+#ifndef __SDR_RX_NOISEBLANKER_HH__
+#define __SDR_RX_NOISEBLANKER_HH__
+
+#include "node.hh"
+#include <vector>
+#include <cmath>
+
+
+/** An impulse noise blanker operating on the full-rate I/Q signal.
+ *
+ * The blanker keeps a running average of the signal magnitude (|I|+|Q|). Any sample exceeding
+ * the average by the threshold ratio is considered an impulse. The output is delayed by a short
+ * delay line (lookahead), such that the samples preceding the detected impulse, the impulse itself
+ * and a few samples after it are blanked. Blanked samples are either set to zero or replaced by
+ * the last good sample. Impulse samples enter the average only clipped to the threshold, hence
+ * impulses hardly raise the detection threshold. All buffers are allocated in @c config. */
+class NoiseBlanker: public sdr::Sink< std::complex<int16_t> >, public sdr::Source
+{
+public:
+  /** Constructor.
+   * @param threshold Specifies the threshold ratio w.r.t. the average magnitude.
+   * @param lookahead Specifies the number of samples blanked before the detected impulse.
+   * @param hold Specifies the number of samples blanked after the detected impulse. */
+  NoiseBlanker(float threshold=8, size_t lookahead=8, size_t hold=8);
+  /** Destructor. */
+  virtual ~NoiseBlanker();
+
+  /** Returns @c true if the blanker is enabled. */
+  inline bool enabled() const { return _enabled; }
+  /** Enables or disables the blanker. If disabled, the input is passed through without delay. */
+  inline void enable(bool enable) { _enabled = enable; }
+
+  /** Returns the threshold ratio. */
+  inline float threshold() const { return _threshold; }
+  /** Sets the threshold ratio. */
+  inline void setThreshold(float threshold) { _threshold = std::max(1.0f, threshold); }
+
+  /** Returns @c true if blanked samples get replaced by the last good sample. */
+  inline bool holdEnabled() const { return _hold_last; }
+  /** If @c true, blanked samples get replaced by the last good sample instead of zero. */
+  inline void enableHold(bool enable) { _hold_last = enable; }
+
+  /** Returns the number of samples blanked since the last call to @c resetStatistics. */
+  inline size_t blankedSamples() const { return _blanked; }
+  /** Resets the blanking statistics. */
+  inline void resetStatistics() { _blanked = 0; }
+
+  /** Returns the mean magnitude of the last input buffer in dB w.r.t. full scale. The level is
+   * also measured if the blanker is disabled. */
+  inline float level() const { return 20*std::log10(std::max(_level, 1.0f)/32768); }
+
+  /** Configures the blanker. */
+  virtual void config(const sdr::Config &src_cfg);
+  /** Performs the blanking. */
+  virtual void process(const sdr::Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite);
+
+protected:
+  /** If @c true, the blanker is enabled. */
+  bool _enabled;
+  /** Threshold ratio. */
+  float _threshold;
+  /** Lookahead and hold samples. */
+  size_t _lookahead, _hold;
+  /** If @c true, blanked samples are replaced by the last good sample. */
+  bool _hold_last;
+  /** Running average of the magnitude and its time constant. */
+  float _avg, _alpha;
+  /** The delay line and current position. */
+  std::vector< std::complex<int16_t> > _delay;
+  size_t _delay_idx;
+  /** Number of output samples still to blank. */
+  size_t _remaining;
+  /** Last good output sample. */
+  std::complex<int16_t> _last;
+  /** Number of blanked samples. */
+  size_t _blanked;
+  /** Mean magnitude of the last buffer. */
+  float _level;
+  /** The output buffer. */
+  sdr::Buffer< std::complex<int16_t> > _buffer;
+};
+
+#endif // __SDR_RX_NOISEBLANKER_HH__
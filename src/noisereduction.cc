@@ -0,0 +1,173 @@
+#include "noisereduction.hh"
+#include "bufferpool.hh"
+#include "logger.hh"
+#include <cmath>
+#include <chrono>
+
+using namespace sdr;
+
+
+NoiseReduction::NoiseReduction(size_t frameSize, double strength)
+  : Sink<int16_t>(), Source(), _enabled(false), _frameSize(frameSize), _hopSize(frameSize/2),
+    _strength(std::max(0.0, std::min(1.0, strength))), _sampleRate(0), _pos(0),
+    _fft_time(0), _fft_freq(0), _forward(0), _backward(0), _block_time(0), _load(0), _buffer()
+{
+  // sqrt-Hann window, used for analysis & synthesis. With 50% overlap, the product of both sums
+  // up to 1.
+  _window.resize(_frameSize);
+  for (size_t i=0; i<_frameSize; i++) {
+    _window[i] = std::sqrt(0.5*(1-std::cos(2*M_PI*i/_frameSize)));
+  }
+}
+
+NoiseReduction::~NoiseReduction() {
+  _freePlans();
+  BufferPool::get().release(_buffer);
+}
+
+double
+NoiseReduction::strength() const {
+  return _strength;
+}
+
+void
+NoiseReduction::setStrength(double strength) {
+  _strength = std::max(0.0, std::min(1.0, strength));
+}
+
+double
+NoiseReduction::blockTime() const {
+  return _block_time;
+}
+
+double
+NoiseReduction::cpuLoad() const {
+  return _load;
+}
+
+void
+NoiseReduction::_freePlans() {
+  if (_forward) { fftwf_destroy_plan(_forward); _forward = 0; }
+  if (_backward) { fftwf_destroy_plan(_backward); _backward = 0; }
+  if (_fft_time) { fftwf_free(_fft_time); _fft_time = 0; }
+  if (_fft_freq) { fftwf_free(_fft_freq); _fft_freq = 0; }
+}
+
+void
+NoiseReduction::config(const Config &src_cfg) {
+  // Requires type, sample rate & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+  // Check buffer type
+  if (Config::typeId<int16_t>() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure NoiseReduction: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId<int16_t>();
+    throw err;
+  }
+
+  _sampleRate = src_cfg.sampleRate();
+
+  // (Re-) Create FFT plans, these get reused for every block
+  _freePlans();
+  size_t nBins = _frameSize/2+1;
+  _fft_time = (float *) fftwf_malloc(sizeof(float)*_frameSize);
+  _fft_freq = (fftwf_complex *) fftwf_malloc(sizeof(fftwf_complex)*nBins);
+  _forward  = fftwf_plan_dft_r2c_1d(_frameSize, _fft_time, _fft_freq, FFTW_MEASURE);
+  _backward = fftwf_plan_dft_c2r_1d(_frameSize, _fft_freq, _fft_time, FFTW_MEASURE);
+
+  // Reset state
+  _input.assign(_frameSize, 0);
+  _overlap.assign(_frameSize, 0);
+  _output.assign(_hopSize, 0);
+  _power.assign(nBins, 0);
+  _noise.assign(nBins, 1e30f);
+  _gain.assign(nBins, 1);
+  _pos = 0;
+
+  // Allocate output buffer
+  BufferPool::get().release(_buffer);
+  _buffer = BufferPool::get().acquire<int16_t>(src_cfg.bufferSize());
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Configured NoiseReduction node: " << this << std::endl
+      << " sample-rate: " << _sampleRate << std::endl
+      << " frame size: " << _frameSize << std::endl
+      << " delay: " << 1000*_frameSize/_sampleRate << "ms";
+  Logger::get().log(msg);
+
+  // Propergate config
+  this->setConfig(Config(Config::typeId<int16_t>(), _sampleRate, src_cfg.bufferSize(), 1));
+}
+
+void
+NoiseReduction::process(const Buffer<int16_t> &buffer, bool allow_overwrite) {
+  // Pass-through if disabled
+  if (! _enabled) { this->send(buffer, allow_overwrite); return; }
+
+  Buffer<int16_t> out;
+  if (allow_overwrite) {
+    out = buffer;
+  } else if (_buffer.isUnused()) {
+    out = _buffer;
+  } else {
+#ifdef SDR_DEBUG
+    LogMessage msg(LOG_WARNING);
+    msg << "NoiseReduction: Drop buffer: Output buffer still in use.";
+    Logger::get().log(msg);
+#endif
+    return;
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  size_t frames = 0;
+  for (size_t i=0; i<buffer.size(); i++) {
+    // Append new sample to the frame, return delayed output sample
+    _input[_frameSize-_hopSize+_pos] = buffer[i];
+    out[i] = int16_t(std::max(-32768.0f, std::min(32767.0f, _output[_pos])));
+    if (++_pos == _hopSize) { _processFrame(); _pos = 0; frames++; }
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+  // Update CPU time statistics
+  float dt = std::chrono::duration_cast< std::chrono::duration<float, std::micro> >(end-start).count();
+  if (frames) { _block_time = 0.9f*_block_time + 0.1f*dt/frames; }
+  _load = 0.9f*_load + 0.1f*dt*1e-6f*_sampleRate/buffer.size();
+
+  this->send(out.head(buffer.size()), true);
+}
+
+void
+NoiseReduction::_processFrame() {
+  size_t nBins = _frameSize/2+1;
+
+  // Analysis
+  for (size_t i=0; i<_frameSize; i++) { _fft_time[i] = _window[i]*_input[i]; }
+  fftwf_execute(_forward);
+
+  // Noise estimate and gain, an over-subtraction factor of up to 2 and a gain floor of up to
+  // -20dB depending on the strength.
+  float alpha = 2*_strength, gmin = std::pow(10.0f, -float(_strength));
+  for (size_t k=0; k<nBins; k++) {
+    float p = _fft_freq[k][0]*_fft_freq[k][0] + _fft_freq[k][1]*_fft_freq[k][1];
+    _power[k] = 0.7f*_power[k] + 0.3f*p;
+    // Minimum tracking with slow rise (about 1.4dB/s at 16kHz)
+    _noise[k] = std::min(_noise[k]*1.0025f, _power[k]);
+    float g = std::max(1 - alpha*_noise[k]/(_power[k]+1e-12f), gmin);
+    // Smooth gain to reduce musical noise
+    _gain[k] = 0.5f*_gain[k] + 0.5f*g;
+    _fft_freq[k][0] *= _gain[k]; _fft_freq[k][1] *= _gain[k];
+  }
+
+  // Synthesis & overlap-add
+  fftwf_execute(_backward);
+  for (size_t i=0; i<_frameSize; i++) {
+    _overlap[i] += _window[i]*_fft_time[i]/_frameSize;
+  }
+  // Emit first hop of the overlap buffer, shift buffers
+  for (size_t i=0; i<_hopSize; i++) { _output[i] = _overlap[i]; }
+  for (size_t i=0; i<_frameSize-_hopSize; i++) {
+    _overlap[i] = _overlap[i+_hopSize];
+    _input[i] = _input[i+_hopSize];
+  }
+  for (size_t i=_frameSize-_hopSize; i<_frameSize; i++) { _overlap[i] = 0; }
+}
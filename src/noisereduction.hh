@@ -0,0 +1,81 @@
+#ifndef __SDR_RX_NOISEREDUCTION_HH__
+#define __SDR_RX_NOISEREDUCTION_HH__
+
+#include "node.hh"
+#include <fftw3.h>
+#include <atomic>
+#include <vector>
+
+
+/** Spectral noise reduction for real (mono) audio.
+ *
+ * The signal is processed in overlapping blocks of @c frameSize samples (50% overlap, sqrt-Hann
+ * analysis and synthesis windows). For each block, the noise power spectrum is tracked by a
+ * minimum-statistics estimate and a Wiener-like gain @f$G=\max(1-\alpha N/P, G_{min})@f$ is
+ * applied. The FFTW plans and all buffers are allocated in @c config, hence the processing
+ * itself does not allocate any memory. The introduced delay is @c frameSize samples. */
+class NoiseReduction: public sdr::Sink<int16_t>, public sdr::Source
+{
+public:
+  /** Constructor.
+   * @param frameSize Specifies the FFT size.
+   * @param strength Specifies the strength of the noise reduction in [0,1]. */
+  NoiseReduction(size_t frameSize=256, double strength=0.5);
+  /** Destructor. */
+  virtual ~NoiseReduction();
+
+  /** Returns @c true if the noise reduction is enabled. */
+  inline bool enabled() const { return _enabled; }
+  /** Enables or disables the noise reduction. If disabled, the input is passed through. */
+  inline void enable(bool enable) { _enabled = enable; }
+
+  /** Returns the strength of the noise reduction. */
+  double strength() const;
+  /** Sets the strength of the noise reduction, a value in [0,1]. */
+  void setStrength(double strength);
+
+  /** Returns the average processing time per block in micro seconds. */
+  double blockTime() const;
+  /** Returns the average CPU load of the noise reduction, i.e. the processing time relative to
+   * the duration of the processed audio. */
+  double cpuLoad() const;
+
+  /** Configures the noise reduction. */
+  virtual void config(const sdr::Config &src_cfg);
+  /** Performs the noise reduction. */
+  virtual void process(const sdr::Buffer<int16_t> &buffer, bool allow_overwrite);
+
+protected:
+  /** Processes a complete frame. */
+  void _processFrame();
+  /** Frees the FFTW plans and buffers. */
+  void _freePlans();
+
+protected:
+  /** If @c true the noise reduction is enabled. */
+  bool _enabled;
+  /** FFT size and hop size. */
+  size_t _frameSize, _hopSize;
+  /** Current strength. */
+  std::atomic<float> _strength;
+  /** Sample rate. */
+  double _sampleRate;
+  /** Window function. */
+  std::vector<float> _window;
+  /** Input frame, overlap-add buffer and output samples of the last frame. */
+  std::vector<float> _input, _overlap, _output;
+  /** Number of samples since the last frame. */
+  size_t _pos;
+  /** Smoothed power spectrum, noise estimate and smoothed gain per bin. */
+  std::vector<float> _power, _noise, _gain;
+  /** FFTW buffers and plans. */
+  float *_fft_time;
+  fftwf_complex *_fft_freq;
+  fftwf_plan _forward, _backward;
+  /** Average processing time per block (us) and per sample of audio (us). */
+  std::atomic<float> _block_time, _load;
+  /** The output buffer. */
+  sdr::Buffer<int16_t> _buffer;
+};
+
+#endif // __SDR_RX_NOISEREDUCTION_HH__
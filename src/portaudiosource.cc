@@ -1,9 +1,34 @@
 #include "portaudiosource.hh"
+#include "configuration.hh"
+#include "audiooutput.hh"
 #include <QFormLayout>
 
 using namespace sdr;
 
 
+/** Probes the sample rates supported by the input device. Probing opens the device several
+ * times, hence the result is cached in the configuration under the given key and probing is
+ * performed only once. Remove the key to force probing. */
+template <class T>
+static void
+probeSampleRates(PortSource<T> *src, const QString &key, std::vector<double> &rates) {
+  Configuration &config = Configuration::get();
+  QList<QVariant> cached = config.value(key).toList();
+  if (cached.size()) {
+    for (int i=0; i<cached.size(); i++) { rates.push_back(cached[i].toDouble()); }
+    return;
+  }
+
+  static const double candidates[] = { 8000, 16000, 22050, 44100, 48000, 96000, 192000 };
+  for (size_t i=0; i<sizeof(candidates)/sizeof(double); i++) {
+    if (src->hasSampleRate(candidates[i])) {
+      rates.push_back(candidates[i]); cached.push_back(candidates[i]);
+    }
+  }
+  if (cached.size()) { config.setValue(key, cached); }
+}
+
+
 
 /* ********************************************************************************************* *
  * Implementation of PortAudioSource
@@ -11,17 +36,12 @@ using namespace sdr;
 PortAudioSource::PortAudioSource(QObject *parent)
   : ::DataSource(parent), sdr::Proxy(), _src(0), _to_complex(0)
 {
-  // Allocate and connect stuff:
+  // Allocate and connect stuff, the source opens the device:
+  initPortAudio();
   _src = new PortSource<int16_t>(8000, 1024);
 
-  // Probe possible sample rates:
-  if (_src->hasSampleRate(8000)) { _sampleRates.push_back(8000); }
-  if (_src->hasSampleRate(16000)) { _sampleRates.push_back(16000); }
-  if (_src->hasSampleRate(22050)) { _sampleRates.push_back(22050); }
-  if (_src->hasSampleRate(44100)) { _sampleRates.push_back(44100); }
-  if (_src->hasSampleRate(48000)) { _sampleRates.push_back(48000); }
-  if (_src->hasSampleRate(96000)) { _sampleRates.push_back(96000); }
-  if (_src->hasSampleRate(192000)) { _sampleRates.push_back(192000); }
+  // Probe possible sample rates (cached):
+  probeSampleRates(_src, "PortAudioSource/sampleRates", _sampleRates);
   if (0 < _sampleRates.size())
     _src->setSampleRate(_sampleRates[0]);
 
@@ -81,17 +101,12 @@ PortAudioSource::setSampleRate(double rate) {
 PortAudioIQSource::PortAudioIQSource(QObject *parent)
   : ::DataSource(parent), sdr::Proxy(), _src(0)
 {
-  // Allocate and connect stuff:
+  // Allocate and connect stuff, the source opens the device:
+  initPortAudio();
   _src = new PortSource< std::complex<int16_t> >(8000, 1024);
 
-  // Probe possible sample rates:
-  if (_src->hasSampleRate(8000)) { _sampleRates.push_back(8000); }
-  if (_src->hasSampleRate(16000)) { _sampleRates.push_back(16000); }
-  if (_src->hasSampleRate(22050)) { _sampleRates.push_back(22050); }
-  if (_src->hasSampleRate(44100)) { _sampleRates.push_back(44100); }
-  if (_src->hasSampleRate(48000)) { _sampleRates.push_back(48000); }
-  if (_src->hasSampleRate(96000)) { _sampleRates.push_back(96000); }
-  if (_src->hasSampleRate(192000)) { _sampleRates.push_back(192000); }
+  // Probe possible sample rates (cached):
+  probeSampleRates(_src, "PortAudioIQSource/sampleRates", _sampleRates);
   if (0 < _sampleRates.size())
     _src->setSampleRate(_sampleRates[0]);
 
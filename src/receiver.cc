@@ -1,5 +1,7 @@
 #include "receiver.hh"
 #include "source.hh"
+#include "bufferpool.hh"
+#include "logger.hh"
 
 using namespace sdr;
 
@@ -10,14 +12,24 @@ Receiver::Receiver(QObject *parent)
   _src   = new DataSourceCtrl(this);
   _demod = new DemodulatorCtrl(this);
   _audio = new AudioPostProc(this);
+  _control = new ControlServer(this, _src, _demod);
 
   // Connect data source to demodulator
   _src->Source::connect(_demod, true); // spectrum
-  _src->Source::connect(_demod->in(), true);
+  // Fast commands of the control server get applied between the buffers of the demodulator
+  _src->Source::connect(_control->boundary(), true);
+  _control->boundary()->connect(_demod->in(), true);
+  // Tune the demodulator to channels selected by the source
+  QObject::connect(_src, SIGNAL(channelSelected(double)), _demod, SLOT(setCenterFreq(double)));
 
   // Connect demodulator to audio sink
   _demod->audioSource()->connect(_audio, true);
 
+  // Measure latency from the source to the audio output
+  _src->Source::connect(&_latency, true);
+  _demod->connectLatencyProbes(&_latency);
+  _audio->connectLatencyProbe(_latency.probe("audio"));
+
   // Connect to start signal of queue
   _queue.addStart(this, &Receiver::_onQueueStarted);
   // Connect to stop signal of queue
@@ -26,6 +38,7 @@ Receiver::Receiver(QObject *parent)
 
 
 Receiver::~Receiver() {
+  _control->stop();
   stop();
 }
 
@@ -60,6 +73,11 @@ Receiver::tunerFrequency() const {
   return _src->tunerFrequency();
 }
 
+bool
+Receiver::startControlServer(const QString &path) {
+  return _control->start(path);
+}
+
 
 void
 Receiver::start() {
@@ -75,10 +93,22 @@ Receiver::stop() {
 
 void
 Receiver::_onQueueStarted() {
+  // All nodes are configured now, report memory use of the buffer pool
+  LogMessage msg(LOG_DEBUG);
+  msg << "Buffer pool usage:" << std::endl;
+  BufferPool::get().report(msg);
+  Logger::get().log(msg);
+
+  _latency.reset();
   emit started();
 }
 
 void
 Receiver::_onQueueStopped() {
+  LogMessage msg(LOG_INFO);
+  msg << "Latency w.r.t. source:" << std::endl;
+  _latency.report(msg);
+  Logger::get().log(msg);
+
   emit stopped();
 }
@@ -6,6 +6,8 @@
 #include "source.hh"
 #include "demodulator.hh"
 #include "audiopostproc.hh"
+#include "controlserver.hh"
+#include "latency.hh"
 
 
 class Receiver: public QObject
@@ -27,6 +29,12 @@ public:
   /** Returns the tuner frequency of the source or 0 if the source does not have a tuner. */
   double tunerFrequency() const;
 
+  /** Returns the latency monitor. */
+  inline const LatencyMonitor &latency() const { return _latency; }
+
+  /** Starts the control server listening on the given socket path. Returns @c false on error. */
+  bool startControlServer(const QString &path);
+
 signals:
   void started();
   void stopped();
@@ -45,6 +53,10 @@ protected:
   DataSourceCtrl  *_src;
   DemodulatorCtrl *_demod;
   AudioPostProc *_audio;
+  /** Local control interface. */
+  ControlServer *_control;
+  /** Measures the latency of the processing stages. */
+  LatencyMonitor _latency;
 };
 
 
@@ -0,0 +1,148 @@
+#include "rtlcontrol.hh"
+#include "latency.hh"
+
+#include <QObject>
+#include <QMetaObject>
+
+using namespace sdr;
+
+
+/* ******************************************************************************************** *
+ * Implementation of RTLControl
+ * ******************************************************************************************** */
+RTLControl::RTLControl(QObject *target)
+  : _target(target), _device(0), _clock(0), _frequency(0), _gain(0), _agc(false),
+    _frequencyPending(false), _gainPending(false), _agcPending(false), _busy(false),
+    _quit(false), _tag(0)
+{
+  _worker = std::thread(&RTLControl::_run, this);
+}
+
+RTLControl::~RTLControl() {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _quit = true;
+  }
+  _request.notify_all();
+  _worker.join();
+}
+
+void
+RTLControl::setDevice(RTLSource *device, const LatencyMonitor *clock) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  // Wait for the change in progress, the device must not get deleted while in use
+  while (_busy) { _idle.wait(lock); }
+  _frequencyPending = _gainPending = _agcPending = false;
+  _device = device; _clock = clock;
+  if (_device) {
+    _frequency = _device->frequency();
+    _gain = _device->gain();
+    _agc = _device->agcEnabled();
+  }
+}
+
+double
+RTLControl::frequency() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _frequency;
+}
+
+void
+RTLControl::setFrequency(double f) {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _frequency = f; _frequencyPending = true;
+  }
+  _request.notify_one();
+}
+
+double
+RTLControl::gain() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _gain;
+}
+
+void
+RTLControl::setGain(double gain) {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _gain = gain; _gainPending = true;
+  }
+  _request.notify_one();
+}
+
+bool
+RTLControl::agcEnabled() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _agc;
+}
+
+void
+RTLControl::enableAGC(bool enable) {
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _agc = enable; _agcPending = true;
+  }
+  _request.notify_one();
+}
+
+void
+RTLControl::setSampleRate(double rate) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (_busy) { _idle.wait(lock); }
+  if (! _device) { return; }
+  RTLSource *device = _device;
+  _busy = true;
+  lock.unlock();
+  device->setSampleRate(rate);
+  lock.lock();
+  _busy = false;
+  _idle.notify_all();
+  // Requests may have arrived meanwhile
+  _request.notify_one();
+}
+
+uint64_t
+RTLControl::lastTag() const {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _tag;
+}
+
+void
+RTLControl::_run() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    while ((! _quit) &&
+           (_busy || !(_device && (_frequencyPending || _gainPending || _agcPending)))) {
+      _request.wait(lock);
+    }
+    if (_quit) { return; }
+
+    // Take the latest requests, those arriving meanwhile get coalesced into the next round
+    RTLSource *device = _device;
+    const LatencyMonitor *clock = _clock;
+    bool setFreq = _frequencyPending, setGain = _gainPending, setAGC = _agcPending;
+    double frequency = _frequency, gain = _gain;
+    bool agc = _agc;
+    _frequencyPending = _gainPending = _agcPending = false;
+    _busy = true;
+    lock.unlock();
+
+    if (setAGC) { device->enableAGC(agc); }
+    if (setGain) { device->setGain(gain); }
+    uint64_t tag = 0;
+    if (setFreq) {
+      device->setFrequency(frequency);
+      tag = clock ? clock->samples() : 0;
+    }
+
+    lock.lock();
+    _busy = false;
+    if (setFreq) { _tag = tag; }
+    _idle.notify_all();
+    if (setFreq && _target) {
+      QMetaObject::invokeMethod(_target, "_onTuned", Qt::QueuedConnection,
+                                Q_ARG(double, frequency), Q_ARG(qulonglong, tag));
+    }
+  }
+}
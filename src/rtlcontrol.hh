@@ -0,0 +1,83 @@
+#ifndef __SDR_RX_RTLCONTROL_HH__
+#define __SDR_RX_RTLCONTROL_HH__
+
+#include "rtlsource.hh"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+class QObject;
+class LatencyMonitor;
+
+
+/** Applies tuner settings of a RTL device in a worker thread.
+ *
+ * Changing the frequency or gain of a RTL2832 device requires USB control transfers, each
+ * taking several ms. Hence, requests are only recorded by @c setFrequency and @c setGain and get
+ * applied by the worker thread. Requests arriving while the worker is busy are coalesced, only
+ * the latest frequency, gain and AGC setting get applied. A sample rate change is applied by
+ * @c setSampleRate in the calling thread, excluding the worker meanwhile. Hence, all control
+ * transfers are serialized and never interleave.
+ *
+ * Once a frequency change was applied, the number of samples recorded by the capture clock of
+ * the device is taken as a tag: All samples with an index >= tag were delivered after the change
+ * took effect. Note that samples already buffered by librtlsdr may still predate the change. The
+ * tag is passed together with the frequency to the slot @c _onTuned(double,qulonglong) of the
+ * target object through a queued call. */
+class RTLControl
+{
+public:
+  /** Constructor, starts the worker thread.
+   * @param target Specifies the object receiving the tags of applied frequency changes. */
+  RTLControl(QObject *target);
+  /** Destructor, stops the worker thread. */
+  virtual ~RTLControl();
+
+  /** Sets the device to control and its capture clock. Waits for a change in progress and drops
+   * all pending requests, hence the previous device may get deleted afterwards. */
+  void setDevice(sdr::RTLSource *device, const LatencyMonitor *clock);
+
+  /** Returns the latest requested (or current) frequency. */
+  double frequency() const;
+  /** Requests a frequency change, returns immediately. */
+  void setFrequency(double f);
+  /** Returns the latest requested (or current) gain. */
+  double gain() const;
+  /** Requests a gain change, returns immediately. */
+  void setGain(double gain);
+  /** Returns the latest requested (or current) AGC setting. */
+  bool agcEnabled() const;
+  /** Requests enabling or disabling the tuner AGC, returns immediately. */
+  void enableAGC(bool enable);
+  /** Sets the sample rate of the device. Waits for a change in progress and blocks the worker
+   * until done, as the chain behind the device gets reconfigured by the calling thread. */
+  void setSampleRate(double rate);
+
+  /** Returns the tag of the last applied frequency change. */
+  uint64_t lastTag() const;
+
+protected:
+  /** The worker thread. */
+  void _run();
+
+protected:
+  QObject *_target;
+  sdr::RTLSource *_device;
+  const LatencyMonitor *_clock;
+  /** Latest requested settings and whether they are pending. */
+  double _frequency, _gain;
+  bool _agc;
+  bool _frequencyPending, _gainPending, _agcPending;
+  /** If @c true, the worker applies a change. */
+  bool _busy;
+  bool _quit;
+  uint64_t _tag;
+  mutable std::mutex _mutex;
+  /** Signals new requests and the end of a change. */
+  std::condition_variable _request, _idle;
+  std::thread _worker;
+};
+
+#endif // __SDR_RX_RTLCONTROL_HH__
@@ -5,6 +5,12 @@
 #include <QFormLayout>
 #include <QToolButton>
 #include <QPushButton>
+#include <QStringList>
+#include <QDateTime>
+#include <QDir>
+
+#include <algorithm>
+#include <thread>
 
 using namespace sdr;
 
@@ -42,32 +48,88 @@ RTLDataSourceConfig::storeSampleRate(double f) {
   _config.setValue("RTLDataSource/sampleRate", f);
 }
 
+bool
+RTLDataSourceConfig::captureAllDevices() const {
+  return _config.value("RTLDataSource/captureAll", false).toBool();
+}
+
+void
+RTLDataSourceConfig::storeCaptureAllDevices(bool all) {
+  _config.setValue("RTLDataSource/captureAll", all);
+}
+
+bool
+RTLDataSourceConfig::iqCorrection() const {
+  return _config.value("RTLDataSource/iqCorrection", true).toBool();
+}
+
+void
+RTLDataSourceConfig::storeIQCorrection(bool enabled) {
+  _config.setValue("RTLDataSource/iqCorrection", enabled);
+}
+
+std::vector<ChannelScanner::Channel>
+RTLDataSourceConfig::channels() const {
+  QStringList items = _config.value("RTLDataSource/channels", QStringList()).toStringList();
+  std::vector<ChannelScanner::Channel> channels;
+  for (int i=0; i<items.size(); i++) {
+    QStringList parts = items[i].split(':');
+    ChannelScanner::Channel channel;
+    channel.frequency = parts[0].toDouble();
+    channel.squelch = (parts.size() > 1) ? parts[1].toDouble() : -40.0;
+    if (channel.frequency > 0) { channels.push_back(channel); }
+  }
+  return channels;
+}
+
+void
+RTLDataSourceConfig::storeChannels(const std::vector<ChannelScanner::Channel> &channels) {
+  QStringList items;
+  for (size_t i=0; i<channels.size(); i++) {
+    items.append(QString("%1:%2").arg(channels[i].frequency, 0, 'f', 0).arg(channels[i].squelch));
+  }
+  _config.setValue("RTLDataSource/channels", items);
+}
+
 
 
 /* ******************************************************************************************** *
  * Implementation of RTLDataSource
  * ******************************************************************************************** */
 RTLDataSource::RTLDataSource(QObject *parent)
-  : DataSource(parent), _device(0), _balance(), _config()
+  : DataSource(parent), _device(0), _selected(0), _routed(0), _captureAll(false),
+    _recordIQ(false), _recordIQTime(), _opened(),
+    _openLock(), _openerDone(), _openers(0), _opening(false), _generation(0), _correction(), _scanner(this), _scanFrequency(0),
+    _control(this), _config()
 {
-  try {
-    _device = new RTLSource(_config.frequency(), _config.sampleRate());
-  } catch (sdr::SDRError &err) {
-    sdr::LogMessage msg(sdr::LOG_WARNING);
-    msg << "Can not open RTL2832 device: " << err.what();
-    sdr::Logger::get().log(msg);
-  }
-
-  _to_int16 = new AutoCast< std::complex<int16_t> >();
-  if (0 != _device) {
-    _device->connect(_to_int16, true);
-  }
-  _to_int16->connect(&_balance, true);
+  _captureAll = _config.captureAllDevices();
+  _scanner.setChannels(_config.channels());
+  // The scanner measures the channels in the capture thread of the selected device
+  _correction.connect(&_scanner, true);
+  _correction.enable(_config.iqCorrection());
+  // Open first (or all) device(s) in the background
+  setDevice(0);
 }
 
 RTLDataSource::~RTLDataSource() {
-  if (_device) { delete _device; }
-  delete _to_int16;
+  // Wait for pending opens, their results are not taken over
+  std::unique_lock<std::mutex> lock(_openLock);
+  while (_openers) { _openerDone.wait(lock); }
+  lock.unlock();
+  // Release the selected device from the control worker before deleting it
+  _control.setDevice(0, 0);
+  for (std::map<int, Opened>::iterator item=_opened.begin(); item!=_opened.end(); item++) {
+    for (std::map<size_t, RTLSource *>::iterator dev=item->second.devices.begin();
+         dev!=item->second.devices.end(); dev++) {
+      delete dev->second;
+    }
+  }
+  for (std::map<size_t, Device>::iterator item=_devices.begin(); item!=_devices.end(); item++) {
+    delete item->second.source;
+    delete item->second.to_int16;
+    delete item->second.clock;
+    delete item->second.recorder;
+  }
 }
 
 QWidget *
@@ -77,7 +139,7 @@ RTLDataSource::createCtrlView() {
 
 Source *
 RTLDataSource::source() {
-  return &_balance;
+  return &_correction;
 }
 
 bool
@@ -85,21 +147,31 @@ RTLDataSource::isActive() const {
   return 0 != _device;
 }
 
+bool
+RTLDataSource::isOpening() const {
+  return _opening;
+}
+
 double
 RTLDataSource::frequency() const {
-  return _device->frequency();
+  // Latest requested frequency, the change may still be pending
+  return _control.frequency();
 }
 
 void
 RTLDataSource::setFrequency(double freq) {
-  // Set frequency of the device
-  _device->setFrequency(freq);
+  // Manual tuning ends the scan
+  stopScan();
+  // Set frequency of the device (asynchronously)
+  _control.setFrequency(freq);
   // and store it in the config
   _config.storeFrequency(freq);
 }
 
 double
 RTLDataSource::sampleRate() const {
+  // No device is selected while the devices get opened
+  if (! _device) { return _config.sampleRate(); }
   return _device->sampleRate();
 }
 
@@ -107,43 +179,48 @@ void
 RTLDataSource::setSampleRate(double rate) {
   bool is_running = sdr::Queue::get().isRunning();
   if (is_running) { sdr::Queue::get().stop(); }
-  _device->setSampleRate(rate);
+  _control.setSampleRate(rate);
+  _config.storeSampleRate(rate);
   if (is_running) { sdr::Queue::get().start(); }
 }
 
 bool
 RTLDataSource::agcEnabled() const {
-  return _device->agcEnabled();
+  return _control.agcEnabled();
 }
 
 void
 RTLDataSource::enableAGC(bool enable) {
-  _device->enableAGC(enable);
+  _control.enableAGC(enable);
 }
 
 double
 RTLDataSource::gain() const {
-  return _device->gain();
+  return _control.gain();
 }
 
 void
 RTLDataSource::setGain(double gain) {
-  return _device->setGain(gain);
+  _control.setGain(gain);
 }
 
 const std::vector<double> &
 RTLDataSource::gainFactors() const {
+  // The gains are unknown until a device is open
+  static const std::vector<double> none;
+  if (! _device) { return none; }
   return _device->gainFactors();
 }
 
-double
-RTLDataSource::IQBalance() const {
-  return _balance.balance();
+bool
+RTLDataSource::iqCorrectionEnabled() const {
+  return _correction.enabled();
 }
 
 void
-RTLDataSource::setIQBalance(double balance) {
-  _balance.setBalance(balance);
+RTLDataSource::enableIQCorrection(bool enable) {
+  _correction.enable(enable);
+  _config.storeIQCorrection(enable);
 }
 
 size_t
@@ -158,38 +235,306 @@ RTLDataSource::deviceName(size_t idx) {
 
 void
 RTLDataSource::setDevice(size_t idx) {
-  // Check for correct idx
-  if (idx >= numDevices()) { return; }
-  // Stop queue if running
+  _selected = idx;
+  if (! _captureAll) { _closeOthers(idx); }
+  _route();
+  if (_devices.count(idx)) {
+    // Device is already open, output got switched. A pending open gets discarded.
+    _generation++; _opening = false;
+    emit deviceChanged();
+    return;
+  }
+
+  std::vector<size_t> indices(1, idx);
+  if (_captureAll) {
+    // Open all devices, the opener skips those already open
+    indices.clear();
+    for (size_t i=0; i<std::max(_deviceNames.size(), idx+1); i++) { indices.push_back(i); }
+  }
+  _openAsync(indices);
+}
+
+size_t
+RTLDataSource::device() const {
+  return _selected;
+}
+
+const std::vector<std::string> &
+RTLDataSource::deviceNames() const {
+  return _deviceNames;
+}
+
+bool
+RTLDataSource::captureAllDevices() const {
+  return _captureAll;
+}
+
+void
+RTLDataSource::setCaptureAllDevices(bool all) {
+  if (all == _captureAll) { return; }
+  _captureAll = all;
+  _config.storeCaptureAllDevices(all);
+  if (! all) {
+    _closeOthers(_selected);
+    emit deviceChanged();
+    return;
+  }
+  // Open all devices, the device list may be outdated: the opener enumerates the devices again
+  std::vector<size_t> indices;
+  for (size_t i=0; i<std::max(_deviceNames.size(), _selected+1); i++) { indices.push_back(i); }
+  _openAsync(indices);
+}
+
+bool
+RTLDataSource::isDeviceOpen(size_t idx) const {
+  return 0 != _devices.count(idx);
+}
+
+bool
+RTLDataSource::isRecordingIQ() const {
+  return _recordIQ;
+}
+
+bool
+RTLDataSource::startIQRecording() {
+  stopIQRecording();
+  _recordIQ = true;
+  _recordIQTime = QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss");
+  bool ok = true;
+  for (std::map<size_t, Device>::iterator item=_devices.begin(); item!=_devices.end(); item++) {
+    ok &= _startIQRecording(item->first, item->second);
+  }
+  return ok;
+}
+
+void
+RTLDataSource::stopIQRecording() {
+  _recordIQ = false;
+  for (std::map<size_t, Device>::iterator item=_devices.begin(); item!=_devices.end(); item++) {
+    item->second.recorder->stop();
+  }
+}
+
+bool
+RTLDataSource::_startIQRecording(size_t idx, Device &device) {
+  QString dir = Configuration::get().value("AudioRecorder/directory", QDir::homePath()).toString();
+  QString name = QString("sdr-rx-iq%1-%2.wav").arg(idx).arg(_recordIQTime);
+  return device.recorder->start(QDir(dir).filePath(name).toStdString(), WavWriter::PCM16);
+}
+
+const std::vector<ChannelScanner::Channel> &
+RTLDataSource::channels() const {
+  return _scanner.channels();
+}
+
+void
+RTLDataSource::addChannel(double frequency, double squelch) {
+  stopScan();
+  std::vector<ChannelScanner::Channel> channels(_scanner.channels());
+  ChannelScanner::Channel channel; channel.frequency = frequency; channel.squelch = squelch;
+  channels.push_back(channel);
+  // The plan gets rebuilt by the scanner
+  _scanner.setChannels(channels);
+  _config.storeChannels(channels);
+}
+
+void
+RTLDataSource::removeChannel(size_t idx) {
+  if (idx >= _scanner.channels().size()) { return; }
+  stopScan();
+  std::vector<ChannelScanner::Channel> channels(_scanner.channels());
+  channels.erase(channels.begin()+idx);
+  _scanner.setChannels(channels);
+  _config.storeChannels(channels);
+}
+
+bool
+RTLDataSource::isScanning() const {
+  return _scanner.isScanning();
+}
+
+void
+RTLDataSource::startScan() {
+  if ((! isActive()) || (0 == _scanner.channels().size())) { return; }
+  _scanner.start();
+}
+
+void
+RTLDataSource::stopScan() {
+  _scanner.stop();
+}
+
+void
+RTLDataSource::_onScanRetune(double frequency) {
+  if ((! isActive()) || (! _scanner.isScanning())) { return; }
+  _scanFrequency = frequency;
+  _control.setFrequency(frequency);
+}
+
+void
+RTLDataSource::_onTuned(double frequency, qulonglong tag) {
+  // Resume the scan once its retune took effect
+  if (_scanner.isScanning() && (frequency == _scanFrequency)) { _scanner.retuned(tag); }
+}
+
+void
+RTLDataSource::_onScanChannel(int idx) {
+  if ((idx < 0) || (! isActive()) || (size_t(idx) >= _scanner.channels().size())) { return; }
+  emit channelSelected(_scanner.channels()[idx].frequency - frequency());
+}
+
+void
+RTLDataSource::_openAsync(const std::vector<size_t> &indices) {
+  // Skip devices already open
+  std::vector<size_t> missing;
+  for (size_t i=0; i<indices.size(); i++) {
+    if (! _devices.count(indices[i])) { missing.push_back(indices[i]); }
+  }
+  // Open devices in the background, opening may take a while. The opener thread is detached,
+  // results of earlier requests get discarded once they arrive.
+  _opening = true; _generation++;
+  std::unique_lock<std::mutex> lock(_openLock);
+  _openers++;
+  lock.unlock();
+  std::thread(&RTLDataSource::_open, this, missing, _config.frequency(), _config.sampleRate(),
+              _generation).detach();
+}
+
+void
+RTLDataSource::_open(std::vector<size_t> indices, double frequency, double sampleRate,
+                     int generation)
+{
+  Opened opened;
+  // Enumerate devices
+  for (size_t i=0; i<RTLSource::numDevices(); i++) {
+    opened.names.push_back(RTLSource::deviceName(i));
+  }
+  // Try to open devices
+  for (size_t i=0; i<indices.size(); i++) {
+    if (indices[i] >= opened.names.size()) { continue; }
+    try {
+      opened.devices[indices[i]] = new RTLSource(frequency, sampleRate, indices[i]);
+    } catch (sdr::SDRError &err) {
+      sdr::LogMessage msg(sdr::LOG_WARNING);
+      msg << "Can not open RTL2832 device #" << indices[i] << ": " << err.what();
+      sdr::Logger::get().log(msg);
+    }
+  }
+  // Pass devices to the GUI thread. The lock is held until this thread does not access the
+  // instance anymore, the destructor waits for it.
+  std::lock_guard<std::mutex> lock(_openLock);
+  _opened[generation] = opened;
+  QMetaObject::invokeMethod(this, "_onDeviceOpened", Qt::QueuedConnection, Q_ARG(int, generation));
+  _openers--;
+  _openerDone.notify_all();
+}
+
+void
+RTLDataSource::_onDeviceOpened(int generation) {
+  std::unique_lock<std::mutex> lock(_openLock);
+  Opened opened = _opened[generation];
+  _opened.erase(generation);
+  lock.unlock();
+  if (generation != _generation) {
+    // Result of an outdated request
+    for (std::map<size_t, RTLSource *>::iterator item=opened.devices.begin();
+         item!=opened.devices.end(); item++) {
+      delete item->second;
+    }
+    return;
+  }
+  _opening = false;
+  _deviceNames.swap(opened.names);
+  // Capturing all devices may have been disabled while they were opened
+  if (! _captureAll) {
+    std::map<size_t, RTLSource *>::iterator item = opened.devices.begin();
+    while (item != opened.devices.end()) {
+      if (_selected == item->first) { item++; continue; }
+      delete item->second;
+      opened.devices.erase(item++);
+    }
+  }
+
+  // Take over devices, the queue gets restarted to start them if it is running
   bool is_running = sdr::Queue::get().isRunning();
-  if (is_running) { sdr::Queue::get().stop(); }
-  // Delete device (if it exists)
-  if (_device) {
-    _device->disconnect(_to_int16);
-    delete _device; _device=0;
+  if (is_running) { sdr::Queue::get().stop(); sdr::Queue::get().wait(); }
+  for (std::map<size_t, RTLSource *>::iterator item=opened.devices.begin();
+       item!=opened.devices.end(); item++) {
+    Device device;
+    device.source = item->second;
+    device.to_int16 = new AutoCast< std::complex<int16_t> >();
+    device.clock = new LatencyMonitor();
+    // The ring holds 50s of 48kHz stereo, i.e. about 1s of I/Q at 2MS/s
+    device.recorder = new AudioRecorder(50.0);
+    // The chain of each device runs in the capture thread of that device
+    device.source->connect(device.to_int16, true);
+    device.to_int16->connect(device.clock, true);
+    device.to_int16->connect(device.recorder, true);
+    if (_recordIQ) { _startIQRecording(item->first, device); }
+    _devices[item->first] = device;
   }
-  // Try to start device
-  try {
-    _device = new RTLSource(100e6, 1e6, idx);
-    _device->connect(_to_int16, true);
-    // restart queue if it was running
-    if (is_running) { sdr::Queue::get().start(); }
-  } catch (sdr::SDRError &err) {
-    sdr::LogMessage msg(sdr::LOG_WARNING);
-    msg << "Can not open RTL2832 device: " << err.what();
-    sdr::Logger::get().log(msg);
+  _route();
+  if (is_running) { sdr::Queue::get().start(); }
+
+  emit deviceChanged();
+}
+
+void
+RTLDataSource::_closeOthers(size_t idx) {
+  if ((0 == _devices.size()) || ((1 == _devices.size()) && _devices.count(idx))) { return; }
+  // Devices get stopped with the queue
+  bool is_running = sdr::Queue::get().isRunning();
+  if (is_running) { sdr::Queue::get().stop(); sdr::Queue::get().wait(); }
+  std::map<size_t, Device>::iterator item = _devices.begin();
+  while (item != _devices.end()) {
+    if (idx == item->first) { item++; continue; }
+    if (_routed == item->second.to_int16) { _routed->disconnect(&_correction); _routed = 0; }
+    if (_device == item->second.source) { _device = 0; _control.setDevice(0, 0); }
+    delete item->second.source;
+    delete item->second.to_int16;
+    delete item->second.clock;
+    delete item->second.recorder;
+    _devices.erase(item++);
   }
+  if (is_running) { sdr::Queue::get().start(); }
 }
 
+void
+RTLDataSource::_route() {
+  std::map<size_t, Device>::iterator item = _devices.find(_selected);
+  AutoCast< std::complex<int16_t> > *cast = (_devices.end() == item) ? 0 : item->second.to_int16;
+  _device = (_devices.end() == item) ? 0 : item->second.source;
+  if (cast == _routed) { return; }
+
+  const LatencyMonitor *clock = (_devices.end() == item) ? 0 : item->second.clock;
+  _control.setDevice(_device, clock);
+  _scanner.setClock(clock);
+
+  // Reconnect output, the downstream nodes get reconfigured on restart
+  bool is_running = sdr::Queue::get().isRunning();
+  if (is_running) { sdr::Queue::get().stop(); sdr::Queue::get().wait(); }
+  if (_routed) { _routed->disconnect(&_correction); }
+  _routed = cast;
+  // The imbalance differs between devices
+  _correction.reset();
+  if (_routed) { _routed->connect(&_correction, true); }
+  if (is_running) { sdr::Queue::get().start(); }
+}
 
 void
 RTLDataSource::queueStarted() {
-  if (_device) { _device->start(); }
+  // Start all devices, their capture clocks share the same time base
+  for (std::map<size_t, Device>::iterator item=_devices.begin(); item!=_devices.end(); item++) {
+    item->second.clock->reset();
+    item->second.source->start();
+  }
 }
 
 void
 RTLDataSource::queueStopped() {
-  if (_device) { _device->stop(); }
+  for (std::map<size_t, Device>::iterator item=_devices.begin(); item!=_devices.end(); item++) {
+    item->second.source->stop();
+  }
 }
 
 double
@@ -200,6 +545,20 @@ RTLDataSource::tunerFrequency() const {
   return 0.0;
 }
 
+bool
+RTLDataSource::tune(double f) {
+  if (! isActive()) { return false; }
+  _control.setFrequency(f);
+  return true;
+}
+
+bool
+RTLDataSource::setTunerGain(double gain) {
+  if (! isActive()) { return false; }
+  setGain(gain);
+  return true;
+}
+
 
 /* ******************************************************************************************** *
  * Implementation of RTLDataSource
@@ -207,25 +566,23 @@ RTLDataSource::tunerFrequency() const {
 RTLCtrlView::RTLCtrlView(RTLDataSource *source, QWidget *parent)
   : QWidget(parent), _source(source)
 {
-  _errorMessage = new QLabel("Cannot open RTL2832 device.");
-  if (_source->isActive()) {
-    _errorMessage->setVisible(false);
-  }
+  _errorMessage = new QLabel();
 
-  // Populate device list:
+  // Device list gets populated once the device is opened
   _devices = new QComboBox();
-  for (size_t i=0; i<RTLDataSource::numDevices(); i++) {
-    _devices->addItem(RTLDataSource::deviceName(i).c_str());
-  }
+  _captureAll = new QCheckBox("Capture all devices");
+  _captureAll->setToolTip("Keeps all devices open for instant switching and I/Q recording, "
+                          "only the selected device is demodulated.");
+  _captureAll->setChecked(_source->captureAllDevices());
+  _recordIQ = new QCheckBox("Record I/Q of open devices");
+  _recordIQ->setToolTip("Records the I/Q stream of each open device into a separate WAV file.");
+  _recordIQ->setChecked(_source->isRecordingIQ());
+
   // Frequency
   _freq = new QLineEdit();
   QDoubleValidator *freq_val = new QDoubleValidator();
   freq_val->setBottom(0);
   _freq->setValidator(freq_val);
-  if(_source->isActive()) {
-    double f = _source->frequency();
-    _freq->setText(QString::number(f));
-  }
 
   // save frequencies
   QAction *saveFreqAction = new QAction(QIcon::fromTheme("document-save"), "Save",this);
@@ -239,6 +596,19 @@ RTLCtrlView::RTLCtrlView(RTLDataSource *source, QWidget *parent)
   QToolButton *loadFreqButton = new QToolButton();
   loadFreqButton->setDefaultAction(loadFreqAction);
   loadFreqButton->setMenu(_freqMenu);
+  loadFreqButton->setPopupMode(QToolButton::InstantPopup);
+  QObject::connect(_freqMenu, SIGNAL(triggered(QAction*)), this, SLOT(onChannelSelected(QAction*)));
+
+  // Squelch threshold of saved frequencies
+  _squelch = new QLineEdit("-40");
+  QDoubleValidator *squelch_val = new QDoubleValidator();
+  squelch_val->setRange(-200, 0);
+  _squelch->setValidator(squelch_val);
+  _squelch->setToolTip("Squelch threshold in dBFS of saved frequencies.");
+
+  // Scan saved frequencies
+  _scan = new QCheckBox("Scan saved frequencies");
+  _scan->setChecked(_source->isScanning());
 
   // Sample rate:
   _sampleRates = new QComboBox();
@@ -247,41 +617,22 @@ RTLCtrlView::RTLCtrlView(RTLDataSource *source, QWidget *parent)
   _sampleRates->addItem("900 kS/s", 900e3);
   _sampleRates->addItem("300 kS/s", 300e3);
   _sampleRates->setCurrentIndex(0);
-  this->onSampleRateSelected(0);
 
   _gain = new QComboBox();
-  if (_source->isActive()) {
-    for (size_t i=0; i<_source->gainFactors().size(); i++) {
-      _gain->addItem(QString("%1 dB").arg(_source->gainFactors()[i]/10), _source->gainFactors()[i]);
-    }
-  }
-
   _agc = new QCheckBox();
-  if (_source->isActive()) {
-    _agc->setChecked(_source->agcEnabled());
-    if (_source->agcEnabled()) { _gain->setEnabled(false); }
-  }
 
-  _balance = new QLineEdit();
-  QDoubleValidator *balance_val = new QDoubleValidator();
-  balance_val->setRange(-1., 1.);
-  _balance->setValidator(balance_val);
-  if (_source->isActive()) {
-    _balance->setText(QString::number(_source->IQBalance()));
-  }
+  _iqCorrection = new QCheckBox();
+  _iqCorrection->setToolTip("Estimates and corrects IQ imbalance and DC offset continuously.");
 
-  if (! _source->isActive()) {
-    _freq->setEnabled(false);
-    _sampleRates->setEnabled(false);
-    _gain->setEnabled(false);
-    _agc->setEnabled(false);
-    _balance->setEnabled(false);
-  }
+  // Update controls from device (if already open)
+  onDeviceChanged();
 
   QFormLayout *layout = new QFormLayout();
 
   QVBoxLayout *deviceLayout = new QVBoxLayout();
   deviceLayout->addWidget(_devices);
+  deviceLayout->addWidget(_captureAll);
+  deviceLayout->addWidget(_recordIQ);
   deviceLayout->addWidget(_errorMessage);
   layout->addRow("Device", deviceLayout);
 
@@ -289,42 +640,105 @@ RTLCtrlView::RTLCtrlView(RTLDataSource *source, QWidget *parent)
   freqLayout->addWidget(_freq, 1); freqLayout->addWidget(saveFreqButton, 0);
   freqLayout->addWidget(loadFreqButton, 0);
   layout->addRow("Frequency", freqLayout);
+  layout->addRow("Squelch (dB)", _squelch);
+  layout->addRow("", _scan);
 
   layout->addRow("Sample rate", _sampleRates);
   layout->addRow("Gain", _gain);
   layout->addRow("AGC", _agc);
-  layout->addRow("IQ Balance", _balance);
+  layout->addRow("IQ correction", _iqCorrection);
   setLayout(layout);
 
+  QObject::connect(_source, SIGNAL(deviceChanged()), this, SLOT(onDeviceChanged()));
   QObject::connect(_devices, SIGNAL(currentIndexChanged(int)), this, SLOT(onDeviceSelected(int)));
+  QObject::connect(_captureAll, SIGNAL(toggled(bool)), this, SLOT(onCaptureAllToggled(bool)));
+  QObject::connect(_recordIQ, SIGNAL(toggled(bool)), this, SLOT(onRecordIQToggled(bool)));
   QObject::connect(_freq, SIGNAL(returnPressed()), this, SLOT(onFrequencyChanged()));
   QObject::connect(_sampleRates, SIGNAL(currentIndexChanged(int)), this, SLOT(onSampleRateSelected(int)));
   QObject::connect(_gain, SIGNAL(currentIndexChanged(int)), this, SLOT(onGainChanged(int)));
   QObject::connect(_agc, SIGNAL(toggled(bool)), this, SLOT(onAGCToggled(bool)));
-  QObject::connect(_balance, SIGNAL(returnPressed()), this, SLOT(onBalanceChanged()));
+  QObject::connect(_iqCorrection, SIGNAL(toggled(bool)), this, SLOT(onIQCorrectionToggled(bool)));
+  QObject::connect(_scan, SIGNAL(toggled(bool)), this, SLOT(onScanToggled(bool)));
+
+  onChannelsChanged();
 }
 
 RTLCtrlView::~RTLCtrlView() {
   // pass...
 }
 
+void
+RTLCtrlView::onDeviceChanged() {
+  // Update device list without triggering onDeviceSelected
+  _devices->blockSignals(true);
+  int current = _source->device();
+  _devices->clear();
+  for (size_t i=0; i<_source->deviceNames().size(); i++) {
+    QString name = _source->deviceNames()[i].c_str();
+    // Mark devices captured in the background
+    if ((int(i) != current) && _source->isDeviceOpen(i)) { name += " (capturing)"; }
+    _devices->addItem(name);
+  }
+  if ((0 <= current) && (current < _devices->count())) { _devices->setCurrentIndex(current); }
+  _devices->blockSignals(false);
+
+  bool active = _source->isActive();
+  if (_source->isOpening()) {
+    _errorMessage->setText("Opening RTL2832 device...");
+  } else {
+    _errorMessage->setText("Cannot open RTL2832 device.");
+  }
+  _errorMessage->setVisible(! active);
+
+  if (active) {
+    _freq->setText(QString::number(_source->frequency()));
+    // Apply selected sample rate
+    this->onSampleRateSelected(_sampleRates->currentIndex());
+    _gain->blockSignals(true);
+    _gain->clear();
+    for (size_t i=0; i<_source->gainFactors().size(); i++) {
+      _gain->addItem(QString("%1 dB").arg(_source->gainFactors()[i]/10), _source->gainFactors()[i]);
+    }
+    _gain->blockSignals(false);
+    _agc->blockSignals(true);
+    _agc->setChecked(_source->agcEnabled());
+    _agc->blockSignals(false);
+    _iqCorrection->blockSignals(true);
+    _iqCorrection->setChecked(_source->iqCorrectionEnabled());
+    _iqCorrection->blockSignals(false);
+  }
+
+  _freq->setEnabled(active);
+  _scan->setEnabled(active);
+  _sampleRates->setEnabled(active);
+  _gain->setEnabled(active && !_source->agcEnabled());
+  _agc->setEnabled(active);
+  _iqCorrection->setEnabled(active);
+}
+
 void
 RTLCtrlView::onDeviceSelected(int idx) {
+  // Disable controls until the device is open
   _source->setDevice(idx);
-  if (_source->isActive()) {
-    // Enable all controlls:
-    _freq->setEnabled(true);
-    _sampleRates->setEnabled(true);
-    _gain->setEnabled(true);
-    _agc->setEnabled(true);
+  onDeviceChanged();
+}
+
+void
+RTLCtrlView::onCaptureAllToggled(bool all) {
+  _source->setCaptureAllDevices(all);
+  onDeviceChanged();
+}
+
+void
+RTLCtrlView::onRecordIQToggled(bool enabled) {
+  if (enabled) {
+    if (! _source->startIQRecording()) {
+      _errorMessage->setText("Cannot create I/Q recording.");
+      _errorMessage->setVisible(true);
+    }
   } else {
-    // Disable all controlls:
-    _freq->setEnabled(false);
-    _sampleRates->setEnabled(false);
-    _gain->setEnabled(false);
-    _agc->setEnabled(false);
+    _source->stopIQRecording();
   }
-
 }
 
 void
@@ -332,11 +746,51 @@ RTLCtrlView::onFrequencyChanged() {
   double freq = _freq->text().toDouble();
   if (! _source->isActive()) { return; }
   _source->setFrequency(freq);
+  _scan->setChecked(false);
 }
 
 void
 RTLCtrlView::onSaveFrequency() {
-  std::cerr << "Save frequency " << _freq->text().toDouble() << std::endl;
+  double freq = _freq->text().toDouble();
+  if (freq <= 0) { return; }
+  _source->addChannel(freq, _squelch->text().toDouble());
+  onChannelsChanged();
+}
+
+void
+RTLCtrlView::onChannelsChanged() {
+  _freqMenu->clear();
+  const std::vector<ChannelScanner::Channel> &channels = _source->channels();
+  for (size_t i=0; i<channels.size(); i++) {
+    QAction *action = _freqMenu->addAction(QString("%1 MHz (%2 dB)")
+                                           .arg(channels[i].frequency/1e6, 0, 'f', 4)
+                                           .arg(channels[i].squelch));
+    action->setData(channels[i].frequency);
+  }
+  _scan->blockSignals(true);
+  _scan->setChecked(_source->isScanning());
+  _scan->blockSignals(false);
+}
+
+void
+RTLCtrlView::onChannelSelected(QAction *action) {
+  if (! _source->isActive()) { return; }
+  double freq = action->data().toDouble();
+  _source->setFrequency(freq);
+  _freq->setText(QString::number(freq));
+  _scan->blockSignals(true);
+  _scan->setChecked(false);
+  _scan->blockSignals(false);
+}
+
+void
+RTLCtrlView::onScanToggled(bool enabled) {
+  if (enabled) { _source->startScan(); }
+  else { _source->stopScan(); }
+  // Scanning requires an active device and channels
+  _scan->blockSignals(true);
+  _scan->setChecked(_source->isScanning());
+  _scan->blockSignals(false);
 }
 
 void
@@ -368,9 +822,6 @@ RTLCtrlView::onAGCToggled(bool enabled) {
 }
 
 void
-RTLCtrlView::onBalanceChanged() {
-  double value = _balance->text().toDouble();
-  if ( _source->isActive()) {
-    _source->setIQBalance(value);
-  }
+RTLCtrlView::onIQCorrectionToggled(bool enabled) {
+  _source->enableIQCorrection(enabled);
 }
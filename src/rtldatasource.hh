@@ -6,12 +6,21 @@
 #include "utils.hh"
 #include "autocast.hh"
 #include "configuration.hh"
+#include "latency.hh"
+#include "scanner.hh"
+#include "rtlcontrol.hh"
+#include "iqcorrection.hh"
+#include "audiorecorder.hh"
 
 #include <QLabel>
 #include <QComboBox>
 #include <QCheckBox>
 #include <QMenu>
 
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
 /** Persistent configuration of the RTL device. */
 class RTLDataSourceConfig
 {
@@ -25,16 +34,63 @@ public:
   double sampleRate() const;
   void storeSampleRate(double rate);
 
+  bool captureAllDevices() const;
+  void storeCaptureAllDevices(bool all);
+
+  bool iqCorrection() const;
+  void storeIQCorrection(bool enabled);
+
+  /** Memory channels, stored as "frequency:squelch" pairs. */
+  std::vector<ChannelScanner::Channel> channels() const;
+  void storeChannels(const std::vector<ChannelScanner::Channel> &channels);
+
 protected:
   /** The global config instance. */
   Configuration &_config;
 };
 
 
+/** Data source for RTL2832 based devices.
+ *
+ * Several devices can be open at once. Each device runs its own capture thread (of
+ * @c sdr::RTLSource) and has its own chain, converting the samples to @c int16_t and recording
+ * their capture times w.r.t. a common time base. Only the selected device is routed to the output
+ * of the data source and hence to the (single) demodulator, the other devices keep capturing such
+ * that switching between open devices does not reopen them. Besides that, the streams of the other
+ * devices are only consumed by the I/Q recording, which records all open devices concurrently,
+ * see @c startIQRecording.
+ *
+ * The devices get enumerated and opened by a separate thread, hence the construction and device
+ * selection do not block the GUI. The @c deviceChanged signal is emitted once the devices were
+ * opened (or opening failed). Tuner settings apply to the selected device, frequency and gain
+ * changes get applied asynchronously by a @c RTLControl worker, hence they never block the caller.
+ *
+ * The memory channels can be scanned by the @c ChannelScanner attached to the output, see
+ * @c startScan. Once the scanner selects a channel, @c DataSource::channelSelected is emitted with
+ * the offset of the channel w.r.t. the tuner frequency. */
 class RTLDataSource : public DataSource
 {
   Q_OBJECT
 
+protected:
+  /** An open device and its chain. */
+  typedef struct {
+    /** The device. */
+    sdr::RTLSource *source;
+    /** Casts the device output to int16_t. */
+    sdr::AutoCast< std::complex<int16_t> > *to_int16;
+    /** Records the capture times of the samples. */
+    LatencyMonitor *clock;
+    /** Records the I/Q stream (as stereo WAV). */
+    AudioRecorder *recorder;
+  } Device;
+
+  /** Devices opened and device names found by an opener thread. */
+  typedef struct {
+    std::map<size_t, sdr::RTLSource *> devices;
+    std::vector<std::string> names;
+  } Opened;
+
 public:
   RTLDataSource(QObject *parent=0);
   virtual ~RTLDataSource();
@@ -46,8 +102,13 @@ public:
   virtual void queueStopped();
 
   virtual double tunerFrequency() const;
+  virtual bool tune(double f);
+  virtual bool setTunerGain(double gain);
 
+  /** Returns @c true if the selected device is open. */
   bool isActive() const;
+  /** Returns @c true while devices get opened. */
+  bool isOpening() const;
 
   double frequency() const;
   void setFrequency(double freq);
@@ -62,18 +123,116 @@ public:
   void setGain(double gain);
   const std::vector<double> &gainFactors() const;
 
-  double IQBalance() const;
-  void setIQBalance(double balance);
+  /** Returns @c true if the adaptive IQ imbalance and DC offset correction is enabled. */
+  bool iqCorrectionEnabled() const;
+  void enableIQCorrection(bool enable);
+  /** Returns the adaptive IQ correction. */
+  inline const IQCorrection &iqCorrection() const { return _correction; }
 
+  /** Selects the specified device, opens it asynchronously if needed. Unless all devices are
+   * captured, all other devices get closed. */
   void setDevice(size_t idx);
+  /** Returns the index of the selected device. */
+  size_t device() const;
+  /** Returns the names of the devices found when devices were opened last. */
+  const std::vector<std::string> &deviceNames() const;
+
+  /** Returns @c true if all devices are captured concurrently. */
+  bool captureAllDevices() const;
+  /** Opens all devices (asynchronously) or closes all but the selected one. */
+  void setCaptureAllDevices(bool all);
+  /** Returns @c true if the specified device is open. */
+  bool isDeviceOpen(size_t idx) const;
+
+  /** Returns @c true while the I/Q streams of the open devices get recorded. */
+  bool isRecordingIQ() const;
+  /** Starts recording the I/Q streams of all open devices (and those opened later) into separate
+   * WAV files in the recording directory. Returns @c false if a file can not be created. */
+  bool startIQRecording();
+  /** Stops recording the I/Q streams. */
+  void stopIQRecording();
 
   static size_t numDevices();
   static std::string deviceName(size_t idx);
 
+  /** Returns the memory channels. */
+  const std::vector<ChannelScanner::Channel> &channels() const;
+  /** Adds a memory channel with the given squelch threshold in dBFS, the scan gets stopped. */
+  void addChannel(double frequency, double squelch);
+  /** Removes a memory channel, the scan gets stopped. */
+  void removeChannel(size_t idx);
+  /** Returns the scanner of the memory channels. */
+  inline const ChannelScanner &scanner() const { return _scanner; }
+  /** Returns @c true while the memory channels get scanned. */
+  bool isScanning() const;
+  /** Starts scanning the memory channels of the selected device. */
+  void startScan();
+  /** Stops scanning, the tuner stays at the current frequency. */
+  void stopScan();
+
+signals:
+  /** Gets emitted once devices were opened or failed to open. */
+  void deviceChanged();
+
+protected slots:
+  /** Takes over the devices opened by the opener thread. */
+  void _onDeviceOpened(int generation);
+  /** Retunes the selected device on behalf of the scanner. */
+  void _onScanRetune(double frequency);
+  /** Gets called by the control worker once a frequency change was applied, @c tag is the index
+   * of the first sample delivered afterwards. */
+  void _onTuned(double frequency, qulonglong tag);
+  /** Gets called by the scanner once a channel was selected (or -1 if none). */
+  void _onScanChannel(int idx);
+
+protected:
+  /** Enumerates the devices and opens the specified ones, runs in a detached opener thread. */
+  void _open(std::vector<size_t> indices, double frequency, double sampleRate, int generation);
+  /** Opens the given devices asynchronously. */
+  void _openAsync(const std::vector<size_t> &indices);
+  /** Closes all devices except the given one. */
+  void _closeOthers(size_t idx);
+  /** Routes the selected device to the output. */
+  void _route();
+  /** Starts recording the I/Q stream of the given device. */
+  bool _startIQRecording(size_t idx, Device &device);
+
 protected:
+  /** The selected device or 0. */
   sdr::RTLSource *_device;
-  sdr::AutoCast< std::complex<int16_t> > *_to_int16;
-  sdr::IQBalance< std::complex<int16_t> > _balance;
+  /** Index of the selected device. */
+  size_t _selected;
+  /** The open devices by index. */
+  std::map<size_t, Device> _devices;
+  /** Device routed to the output. */
+  sdr::AutoCast< std::complex<int16_t> > *_routed;
+  /** If @c true, all devices get opened. */
+  bool _captureAll;
+  /** If @c true, the I/Q streams of all open devices get recorded. */
+  bool _recordIQ;
+  /** Time stamp of the I/Q recording, part of the file names. */
+  QString _recordIQTime;
+  /** Results of the opener threads by generation, not yet taken over. */
+  std::map<int, Opened> _opened;
+  /** Protects @c _opened and @c _openers. */
+  std::mutex _openLock;
+  /** Signals the termination of an opener thread. */
+  std::condition_variable _openerDone;
+  /** Number of running opener threads. */
+  size_t _openers;
+  bool _opening;
+  /** Counts the open requests, results of earlier requests get discarded. */
+  int _generation;
+  /** Cached device names. */
+  std::vector<std::string> _deviceNames;
+  /** Corrects the IQ imbalance and DC offset of the selected device. */
+  IQCorrection _correction;
+  /** Scans the memory channels. */
+  ChannelScanner _scanner;
+  /** Frequency requested by the scanner. */
+  double _scanFrequency;
+  /** Applies frequency and gain changes to the selected device. */
+  RTLControl _control;
   RTLDataSourceConfig _config;
 };
 
@@ -87,26 +246,36 @@ public:
   virtual ~RTLCtrlView();
 
 protected slots:
+  void onDeviceChanged();
   void onDeviceSelected(int idx);
+  void onCaptureAllToggled(bool all);
+  void onRecordIQToggled(bool enabled);
   void onFrequencyChanged();
   void onSaveFrequency();
   void onSampleRateSelected(int idx);
   void onGainChanged(int idx);
   void onAGCToggled(bool enabled);
-  void onBalanceChanged();
+  void onIQCorrectionToggled(bool enabled);
+  void onChannelsChanged();
+  void onChannelSelected(QAction *action);
+  void onScanToggled(bool enabled);
 
 protected:
   QLabel *_errorMessage;
   RTLDataSource *_source;
 
   QComboBox *_devices;
+  QCheckBox *_captureAll;
+  QCheckBox *_recordIQ;
   QLineEdit *_freq;
   QMenu     *_freqMenu;
   QAction   *_saveFreqAction;
+  QLineEdit *_squelch;
+  QCheckBox *_scan;
   QComboBox *_sampleRates;
   QComboBox *_gain;
   QCheckBox *_agc;
-  QLineEdit *_balance;
+  QCheckBox *_iqCorrection;
 };
 
 #endif // __SDR_RX_RTLDATASOURCE_HH__
@@ -0,0 +1,205 @@
+#include "rtltcpserver.hh"
+#include "logger.hh"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace sdr;
+
+
+/* ******************************************************************************************** *
+ * Implementation of RTLTCPServer::Client
+ * ******************************************************************************************** */
+RTLTCPServer::Client::Client(int sock, size_t queueSize)
+  : socket(sock), queue(queueSize), alive(true)
+{
+  // pass...
+}
+
+RTLTCPServer::Client::~Client() {
+  alive = false; cond.notify_one();
+  // Unblock a pending send
+  shutdown(socket, SHUT_RDWR);
+  if (thread.joinable()) { thread.join(); }
+  ::close(socket);
+}
+
+void
+RTLTCPServer::Client::run() {
+  // Send header: magic, tuner type (unknown) and number of gains (none)
+  char header[12]; memset(header, 0, sizeof(header));
+  memcpy(header, "RTL0", 4);
+  if (12 != ::send(socket, header, 12, MSG_NOSIGNAL)) { alive = false; return; }
+
+  uint8_t chunk[64*1024]; char cmds[256];
+  while (alive) {
+    size_t n = queue.take(chunk, sizeof(chunk));
+    if (0 == n) {
+      // Discard commands of the client, wait for data
+      while (0 < recv(socket, cmds, sizeof(cmds), MSG_DONTWAIT)) { }
+      std::unique_lock<std::mutex> guard(lock);
+      cond.wait_for(guard, std::chrono::milliseconds(10));
+      continue;
+    }
+    for (size_t sent=0; sent<n; ) {
+      ssize_t m = ::send(socket, chunk+sent, n-sent, MSG_NOSIGNAL);
+      if (0 >= m) { alive = false; break; }
+      sent += m;
+    }
+  }
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of RTLTCPServer
+ * ******************************************************************************************** */
+RTLTCPServer::RTLTCPServer(size_t queueSize)
+  : Sink< std::complex<int16_t> >(), _queue_size(queueSize), _socket(-1), _port(0),
+    _running(false), _num_clients(0), _dropped_clients(0)
+{
+  // pass...
+}
+
+RTLTCPServer::~RTLTCPServer() {
+  stop();
+}
+
+void
+RTLTCPServer::start(uint16_t port) {
+  stop();
+
+  int sock = socket(AF_INET6, SOCK_STREAM, 0);
+  if (0 > sock) {
+    RuntimeError err; err << "Can not create socket: " << strerror(errno); throw err;
+  }
+  // Accept IPv4 & IPv6 clients
+  int yes = 1, no = 0;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, &no, sizeof(no));
+
+  struct sockaddr_in6 addr; memset(&addr, 0, sizeof(addr));
+  addr.sin6_family = AF_INET6; addr.sin6_addr = in6addr_any; addr.sin6_port = htons(port);
+  if ((0 != bind(sock, (struct sockaddr *)&addr, sizeof(addr))) || (0 != listen(sock, 8))) {
+    ::close(sock);
+    RuntimeError err; err << "Can not listen on port " << port << ": " << strerror(errno); throw err;
+  }
+
+  _socket = sock; _port = port; _running = true;
+  _thread = std::thread(&RTLTCPServer::_listen, this);
+
+  LogMessage msg(LOG_INFO);
+  msg << "rtl_tcp server listening on port " << port;
+  Logger::get().log(msg);
+}
+
+void
+RTLTCPServer::stop() {
+  if (! _running) { return; }
+  _running = false;
+  if (_thread.joinable()) { _thread.join(); }
+  ::close(_socket); _socket = -1;
+
+  std::list<Client *> clients;
+  {
+    std::lock_guard<std::mutex> guard(_clients_lock);
+    clients.swap(_clients); _num_clients = 0;
+  }
+  // Join writer threads outside of the lock, this must not block the processing
+  for (std::list<Client *>::iterator client=clients.begin(); client!=clients.end(); client++) {
+    delete *client;
+  }
+}
+
+size_t
+RTLTCPServer::numClients() {
+  return _num_clients;
+}
+
+void
+RTLTCPServer::_listen() {
+  while (_running) {
+    struct pollfd pfd; pfd.fd = _socket; pfd.events = POLLIN;
+    int res = poll(&pfd, 1, 200);
+    _removeDeadClients();
+    if ((0 >= res) || (! (pfd.revents & POLLIN))) { continue; }
+
+    int sock = accept(_socket, 0, 0);
+    if (0 > sock) { continue; }
+    int sndbuf = 4*1024*1024;
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    // Allocate client queue here, not in the processing thread
+    Client *client = new Client(sock, _queue_size);
+    client->thread = std::thread(&Client::run, client);
+    std::lock_guard<std::mutex> guard(_clients_lock);
+    _clients.push_back(client); _num_clients = _clients.size();
+
+    LogMessage msg(LOG_INFO);
+    msg << "rtl_tcp server: Client connected (" << _clients.size() << " clients).";
+    Logger::get().log(msg);
+  }
+}
+
+void
+RTLTCPServer::_removeDeadClients() {
+  std::list<Client *> dead;
+  {
+    std::lock_guard<std::mutex> guard(_clients_lock);
+    std::list<Client *>::iterator client = _clients.begin();
+    while (client != _clients.end()) {
+      if ((*client)->alive) { client++; continue; }
+      dead.push_back(*client);
+      client = _clients.erase(client);
+    }
+    _num_clients = _clients.size();
+  }
+  // Join writer threads outside of the lock, this must not block the processing
+  for (std::list<Client *>::iterator client=dead.begin(); client!=dead.end(); client++) {
+    delete *client;
+  }
+}
+
+void
+RTLTCPServer::config(const Config &src_cfg) {
+  // Requires type & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasBufferSize()) { return; }
+  // Check buffer type
+  if (Config::typeId< std::complex<int16_t> >() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure RTLTCPServer: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId< std::complex<int16_t> >();
+    throw err;
+  }
+  std::lock_guard<std::mutex> guard(_clients_lock);
+  _data.resize(2*src_cfg.bufferSize());
+}
+
+void
+RTLTCPServer::process(const Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite) {
+  if (0 == _num_clients) { return; }
+
+  std::lock_guard<std::mutex> guard(_clients_lock);
+  // Convert once to 8bit offset binary
+  size_t N = std::min(2*buffer.size(), _data.size());
+  const int16_t *in = reinterpret_cast<const int16_t *>(buffer.data());
+  for (size_t i=0; i<N; i++) { _data[i] = uint8_t((in[i] >> 8) + 128); }
+
+  // Fan out, drop clients that can not keep up
+  for (std::list<Client *>::iterator client=_clients.begin(); client!=_clients.end(); client++) {
+    if (! (*client)->alive) { continue; }
+    if (N != (*client)->queue.put(&_data[0], N)) {
+      (*client)->alive = false; _dropped_clients++;
+      shutdown((*client)->socket, SHUT_RDWR);
+      LogMessage msg(LOG_WARNING);
+      msg << "rtl_tcp server: Drop client, queue overflow.";
+      Logger::get().log(msg);
+    }
+    (*client)->cond.notify_one();
+  }
+}
@@ -0,0 +1,91 @@
+#ifndef __SDR_RX_RTLTCPSERVER_HH__
+#define __SDR_RX_RTLTCPSERVER_HH__
+
+#include "node.hh"
+#include "lockfreering.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+
+
+/** Re-exports the I/Q stream of the receiver over the rtl_tcp protocol.
+ *
+ * The server accepts any number of clients. Each received buffer is converted once into the
+ * 8-bit offset-binary format of rtl_tcp and put into a bounded queue per client, which is emptied
+ * by a writer thread per client. If the queue of a client overflows, the client is too slow and
+ * gets disconnected, hence clients can never stall the processing chain. Tuning commands sent by
+ * the clients are ignored, as the device is shared. */
+class RTLTCPServer: public sdr::Sink< std::complex<int16_t> >
+{
+protected:
+  /** State of a connected client. */
+  class Client {
+  public:
+    Client(int socket, size_t queueSize);
+    ~Client();
+    /** The writer loop. */
+    void run();
+
+  public:
+    int socket;
+    /** Bounded queue of samples to send. */
+    LockFreeRing<uint8_t> queue;
+    /** Wakes the writer thread. */
+    std::mutex lock;
+    std::condition_variable cond;
+    /** Cleared if the client gets dropped or disconnected. */
+    std::atomic<bool> alive;
+    std::thread thread;
+  };
+
+public:
+  /** Constructor.
+   * @param queueSize Specifies the queue size per client in bytes. */
+  RTLTCPServer(size_t queueSize=8*1024*1024);
+  /** Destructor, stops the server. */
+  virtual ~RTLTCPServer();
+
+  /** Starts listening on the given port. Throws a @c sdr::RuntimeError on failure. */
+  void start(uint16_t port);
+  /** Stops the server and disconnects all clients. */
+  void stop();
+  /** Returns @c true if the server is listening. */
+  inline bool isRunning() const { return _running; }
+  /** Returns the port the server is listening on. */
+  inline uint16_t port() const { return _port; }
+
+  /** Returns the number of connected clients. */
+  size_t numClients();
+  /** Returns the number of clients dropped because they were too slow. */
+  inline size_t droppedClients() const { return _dropped_clients; }
+
+  virtual void config(const sdr::Config &src_cfg);
+  virtual void process(const sdr::Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite);
+
+protected:
+  /** The accept loop. */
+  void _listen();
+  /** Removes and deletes dead clients. */
+  void _removeDeadClients();
+
+protected:
+  /** Queue size per client. */
+  size_t _queue_size;
+  /** Listening socket. */
+  int _socket;
+  uint16_t _port;
+  std::atomic<bool> _running;
+  std::thread _thread;
+  /** Connected clients. */
+  std::mutex _clients_lock;
+  std::list<Client *> _clients;
+  std::atomic<size_t> _num_clients;
+  std::atomic<size_t> _dropped_clients;
+  /** Conversion buffer (8bit offset-binary I/Q). */
+  std::vector<uint8_t> _data;
+};
+
+#endif // __SDR_RX_RTLTCPSERVER_HH__
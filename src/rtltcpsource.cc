@@ -0,0 +1,567 @@
+#include "rtltcpsource.hh"
+#include "bufferpool.hh"
+#include "logger.hh"
+
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QTimer>
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace sdr;
+
+
+/** Names of the tuner types reported by rtl_tcp. */
+static const char *rtltcp_tuner_names[] = {
+  "unknown", "E4000", "FC0012", "FC0013", "FC2580", "R820T", "R828D"
+};
+
+
+/* ******************************************************************************************** *
+ * Implementation of RTLTCPSource
+ * ******************************************************************************************** */
+RTLTCPSource::RTLTCPSource(double frequency, double sampleRate, size_t bufferSize, size_t numBuffers)
+  : Source(), _socket(-1), _tuner_type(0), _num_gains(0), _frequency(frequency),
+    _sample_rate(sampleRate), _gain(0), _agc(true), _buffer_size(bufferSize),
+    _buffers(numBuffers), _filled(numBuffers), _free(numBuffers), _current(numBuffers),
+    _flush(false), _scratch(2*bufferSize), _dropped(0), _running(false), _failed(false)
+{
+  for (size_t i=0; i<_buffers.size(); i++) {
+    _buffers[i] = BufferPool::get().acquire< std::complex<uint8_t> >(_buffer_size);
+    _free.put(i);
+  }
+  this->setConfig(Config(Config::Type_cu8, _sample_rate, _buffer_size, _buffers.size()));
+}
+
+RTLTCPSource::~RTLTCPSource() {
+  close();
+  for (size_t i=0; i<_buffers.size(); i++) { BufferPool::get().release(_buffers[i]); }
+}
+
+void
+RTLTCPSource::open(const std::string &host, uint16_t port) {
+  close();
+
+  // Resolve host
+  struct addrinfo hints, *res=0;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC; hints.ai_socktype = SOCK_STREAM;
+  std::stringstream service; service << port;
+  if (0 != getaddrinfo(host.c_str(), service.str().c_str(), &hints, &res)) {
+    RuntimeError err; err << "Can not resolve host " << host; throw err;
+  }
+
+  // Connect
+  int sock = -1;
+  for (struct addrinfo *ai=res; ai; ai=ai->ai_next) {
+    if (0 > (sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol))) { continue; }
+    if (0 == ::connect(sock, ai->ai_addr, ai->ai_addrlen)) { break; }
+    ::close(sock); sock = -1;
+  }
+  freeaddrinfo(res);
+  if (0 > sock) {
+    RuntimeError err; err << "Can not connect to " << host << ":" << port; throw err;
+  }
+
+  // Large receive buffer, no delay for commands and a receive timeout to allow for stopping
+  // the receive thread
+  int rcvbuf = 4*1024*1024, nodelay = 1;
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  struct timeval timeout; timeout.tv_sec = 0; timeout.tv_usec = 100000;
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  // Read header: "RTL0", tuner type, number of gains
+  char header[12]; size_t got = 0; int retries = 50;
+  while ((got < 12) && (retries > 0)) {
+    ssize_t n = recv(sock, header+got, 12-got, 0);
+    if (n > 0) { got += n; }
+    else if ((n < 0) && ((EAGAIN == errno) || (EWOULDBLOCK == errno) || (EINTR == errno))) { retries--; }
+    else { break; }
+  }
+  if ((12 != got) || (0 != memcmp(header, "RTL0", 4))) {
+    ::close(sock);
+    RuntimeError err; err << "Invalid rtl_tcp header from " << host << ":" << port; throw err;
+  }
+  uint32_t value;
+  memcpy(&value, header+4, 4); _tuner_type = ntohl(value);
+  memcpy(&value, header+8, 4); _num_gains = ntohl(value);
+
+  _socket = sock; _failed = false;
+  _sendSettings();
+
+  LogMessage msg(LOG_INFO);
+  msg << "Connected to rtl_tcp server " << host << ":" << port << std::endl
+      << " tuner: " << rtltcp_tuner_names[_tuner_type < 7 ? _tuner_type : 0] << std::endl
+      << " gain steps: " << _num_gains;
+  Logger::get().log(msg);
+}
+
+void
+RTLTCPSource::close() {
+  stop();
+  if (0 <= _socket) { ::close(_socket); _socket = -1; }
+}
+
+void
+RTLTCPSource::setFrequency(double f) {
+  _frequency = f;
+  _sendCommand(RTLTCP_SET_FREQUENCY, uint32_t(f));
+}
+
+void
+RTLTCPSource::setSampleRate(double rate) {
+  _sample_rate = rate;
+  _sendCommand(RTLTCP_SET_SAMPLERATE, uint32_t(rate));
+  this->setConfig(Config(Config::Type_cu8, _sample_rate, _buffer_size, _buffers.size()));
+}
+
+void
+RTLTCPSource::enableAGC(bool enable) {
+  _agc = enable;
+  // Gain mode 0 is automatic gain, 1 is manual gain
+  _sendCommand(RTLTCP_SET_GAIN_MODE, enable ? 0 : 1);
+  if (! enable) { _sendCommand(RTLTCP_SET_GAIN, uint32_t(_gain)); }
+}
+
+void
+RTLTCPSource::setGain(double gain) {
+  _gain = gain;
+  if (! _agc) { _sendCommand(RTLTCP_SET_GAIN, uint32_t(gain)); }
+}
+
+void
+RTLTCPSource::_sendSettings() {
+  _sendCommand(RTLTCP_SET_SAMPLERATE, uint32_t(_sample_rate));
+  _sendCommand(RTLTCP_SET_FREQUENCY, uint32_t(_frequency));
+  enableAGC(_agc);
+}
+
+bool
+RTLTCPSource::_sendCommand(RTLTCPCommand cmd, uint32_t param) {
+  if (0 > _socket) { return false; }
+  char msg[5]; msg[0] = char(cmd);
+  uint32_t value = htonl(param); memcpy(msg+1, &value, 4);
+  std::lock_guard<std::mutex> guard(_command_lock);
+  return 5 == ::send(_socket, msg, 5, MSG_NOSIGNAL);
+}
+
+void
+RTLTCPSource::next() {
+  size_t idx;
+  // Return buffers received before the restart
+  if (_flush.exchange(false)) {
+    while (_filled.take(&idx, 1)) { _free.put(idx); }
+  }
+  // Wait a little for data while connected, the queue calls this method again when idle
+  if (isOpen()) {
+    std::unique_lock<std::mutex> lock(_ready_lock);
+    _ready.wait_for(lock, std::chrono::milliseconds(100),
+                    [this]() { return 0 < _filled.stored(); });
+  }
+  while (_filled.take(&idx, 1)) {
+    // All sinks are connected directly, the buffer is free again once send returns
+    this->send(_buffers[idx]);
+    _free.put(idx);
+  }
+}
+
+void
+RTLTCPSource::start() {
+  if ((! isOpen()) || _running) { return; }
+  _flush = true;
+  _running = true;
+  _thread = std::thread(&RTLTCPSource::_receive, this);
+}
+
+void
+RTLTCPSource::stop() {
+  _running = false;
+  if (_thread.joinable()) { _thread.join(); }
+}
+
+void
+RTLTCPSource::_receive() {
+  size_t want = 2*_buffer_size;
+  while (_running) {
+    // Receive directly into a free output buffer, drop the data if there is none
+    if (_buffers.size() == _current) { _free.take(&_current, 1); }
+    bool drop = (_buffers.size() == _current);
+    char *dst = drop ? &_scratch[0] : _buffers[_current].data();
+
+    size_t got = 0;
+    while (got < want) {
+      ssize_t n = recv(_socket, dst+got, want-got, 0);
+      if (n > 0) { got += n; continue; }
+      if ((n < 0) && ((EAGAIN == errno) || (EWOULDBLOCK == errno) || (EINTR == errno))) {
+        // Timeout, stop on request but keep I/Q pairs aligned
+        if ((! _running) && (0 == (got % 2))) { break; }
+        continue;
+      }
+      LogMessage msg(LOG_WARNING);
+      msg << "rtl_tcp connection closed: " << (n < 0 ? strerror(errno) : "by peer");
+      Logger::get().log(msg);
+      // The owner closes the socket, see RTLTCPCtrlView::onUpdateStatus
+      _failed = true; _running = false;
+      return;
+    }
+    if (got < want) { return; }
+
+    if (drop) { _dropped += want; continue; }
+    // Hand the buffer over to the queue thread
+    _filled.put(_current); _current = _buffers.size();
+    { std::lock_guard<std::mutex> guard(_ready_lock); }
+    _ready.notify_one();
+  }
+}
+
+
+
+/* ******************************************************************************************** *
+ * Implementation of RTLTCPDataSourceConfig
+ * ******************************************************************************************** */
+RTLTCPDataSourceConfig::RTLTCPDataSourceConfig()
+  : _config(Configuration::get())
+{
+  // pass...
+}
+
+RTLTCPDataSourceConfig::~RTLTCPDataSourceConfig() {
+  // pass...
+}
+
+QString
+RTLTCPDataSourceConfig::host() const {
+  return _config.value("RTLTCPDataSource/host", "localhost").toString();
+}
+
+void
+RTLTCPDataSourceConfig::storeHost(const QString &host) {
+  _config.setValue("RTLTCPDataSource/host", host);
+}
+
+uint16_t
+RTLTCPDataSourceConfig::port() const {
+  return _config.value("RTLTCPDataSource/port", 1234).toUInt();
+}
+
+void
+RTLTCPDataSourceConfig::storePort(uint16_t port) {
+  _config.setValue("RTLTCPDataSource/port", port);
+}
+
+double
+RTLTCPDataSourceConfig::frequency() const {
+  return _config.value("RTLTCPDataSource/frequency", 100.0e6).toDouble();
+}
+
+void
+RTLTCPDataSourceConfig::storeFrequency(double f) {
+  _config.setValue("RTLTCPDataSource/frequency", f);
+}
+
+double
+RTLTCPDataSourceConfig::sampleRate() const {
+  return _config.value("RTLTCPDataSource/sampleRate", 1.0e6).toDouble();
+}
+
+void
+RTLTCPDataSourceConfig::storeSampleRate(double rate) {
+  _config.setValue("RTLTCPDataSource/sampleRate", rate);
+}
+
+
+
+/* ******************************************************************************************** *
+ * Implementation of RTLTCPDataSource
+ * ******************************************************************************************** */
+RTLTCPDataSource::RTLTCPDataSource(QObject *parent)
+  : DataSource(parent), _device(RTLTCPDataSourceConfig().frequency(),
+                                RTLTCPDataSourceConfig().sampleRate()),
+    _to_int16(), _config()
+{
+  // The device sends from the queue thread and reuses its buffers once sent, hence direct
+  _device.connect(&_to_int16, true);
+}
+
+RTLTCPDataSource::~RTLTCPDataSource() {
+  _device.close();
+}
+
+QWidget *
+RTLTCPDataSource::createCtrlView() {
+  return new RTLTCPCtrlView(this);
+}
+
+Source *
+RTLTCPDataSource::source() {
+  return &_to_int16;
+}
+
+void
+RTLTCPDataSource::triggerNext() {
+  _device.next();
+}
+
+void
+RTLTCPDataSource::queueStarted() {
+  _device.start();
+}
+
+void
+RTLTCPDataSource::queueStopped() {
+  _device.stop();
+}
+
+double
+RTLTCPDataSource::tunerFrequency() const {
+  return _device.frequency();
+}
+
+bool
+RTLTCPDataSource::tune(double f) {
+  if (! _device.isOpen()) { return false; }
+  _device.setFrequency(f);
+  return true;
+}
+
+bool
+RTLTCPDataSource::setTunerGain(double gain) {
+  if (! _device.isOpen()) { return false; }
+  setGain(gain);
+  return true;
+}
+
+size_t
+RTLTCPDataSource::droppedSamples() const {
+  return _device.dropped()/2;
+}
+
+bool
+RTLTCPDataSource::isConnected() const {
+  return _device.isOpen();
+}
+
+bool
+RTLTCPDataSource::connectionLost() const {
+  return _device.hasFailed();
+}
+
+bool
+RTLTCPDataSource::connectTo(const QString &host, uint16_t port) {
+  bool is_running = sdr::Queue::get().isRunning();
+  try {
+    _device.open(host.toStdString(), port);
+  } catch (sdr::SDRError &err) {
+    sdr::LogMessage msg(sdr::LOG_WARNING);
+    msg << "Can not connect to rtl_tcp server: " << err.what();
+    sdr::Logger::get().log(msg);
+    return false;
+  }
+  _config.storeHost(host);
+  _config.storePort(port);
+  if (is_running) { _device.start(); }
+  return true;
+}
+
+void
+RTLTCPDataSource::disconnectFrom() {
+  _device.close();
+}
+
+QString
+RTLTCPDataSource::host() const {
+  return _config.host();
+}
+
+uint16_t
+RTLTCPDataSource::port() const {
+  return _config.port();
+}
+
+double
+RTLTCPDataSource::frequency() const {
+  return _device.frequency();
+}
+
+void
+RTLTCPDataSource::setFrequency(double freq) {
+  _device.setFrequency(freq);
+  _config.storeFrequency(freq);
+}
+
+double
+RTLTCPDataSource::sampleRate() const {
+  return _device.sampleRate();
+}
+
+void
+RTLTCPDataSource::setSampleRate(double rate) {
+  bool is_running = sdr::Queue::get().isRunning();
+  if (is_running) { sdr::Queue::get().stop(); sdr::Queue::get().wait(); }
+  _device.setSampleRate(rate);
+  _config.storeSampleRate(rate);
+  if (is_running) { sdr::Queue::get().start(); }
+}
+
+bool
+RTLTCPDataSource::agcEnabled() const {
+  return _device.agcEnabled();
+}
+
+void
+RTLTCPDataSource::enableAGC(bool enable) {
+  _device.enableAGC(enable);
+}
+
+double
+RTLTCPDataSource::gain() const {
+  return _device.gain();
+}
+
+void
+RTLTCPDataSource::setGain(double gain) {
+  _device.setGain(gain);
+}
+
+size_t
+RTLTCPDataSource::dropped() const {
+  return _device.dropped();
+}
+
+
+
+/* ******************************************************************************************** *
+ * Implementation of RTLTCPCtrlView
+ * ******************************************************************************************** */
+RTLTCPCtrlView::RTLTCPCtrlView(RTLTCPDataSource *source, QWidget *parent)
+  : QWidget(parent), _source(source)
+{
+  _host = new QLineEdit(_source->host());
+  _port = new QSpinBox();
+  _port->setRange(1, 65535); _port->setValue(_source->port());
+  _connect = new QCheckBox("connected");
+  _connect->setChecked(_source->isConnected());
+  _status = new QLabel("-");
+
+  _freq = new QLineEdit(QString::number(_source->frequency()));
+  QDoubleValidator *freq_val = new QDoubleValidator();
+  freq_val->setBottom(0);
+  _freq->setValidator(freq_val);
+
+  _sampleRates = new QComboBox();
+  _sampleRates->addItem("3.2 MS/s", 3.2e6);
+  _sampleRates->addItem("2.4 MS/s", 2.4e6);
+  _sampleRates->addItem("2 MS/s", 2e6);
+  _sampleRates->addItem("1 MS/s", 1e6);
+  _sampleRates->addItem("300 kS/s", 300e3);
+  int idx = _sampleRates->findData(_source->sampleRate());
+  _sampleRates->setCurrentIndex(idx >= 0 ? idx : 3);
+
+  _gain = new QLineEdit(QString::number(_source->gain()/10));
+  _gain->setValidator(new QDoubleValidator());
+  _agc = new QCheckBox();
+  _agc->setChecked(_source->agcEnabled());
+
+  QHBoxLayout *server = new QHBoxLayout();
+  server->addWidget(_host, 1); server->addWidget(_port, 0);
+
+  QFormLayout *layout = new QFormLayout();
+  layout->addRow("Server", server);
+  layout->addRow("", _connect);
+  layout->addRow("Status", _status);
+  layout->addRow("Frequency", _freq);
+  layout->addRow("Sample rate", _sampleRates);
+  layout->addRow("Gain (dB)", _gain);
+  layout->addRow("AGC", _agc);
+  setLayout(layout);
+
+  _updateControls();
+
+  QTimer *status = new QTimer(this);
+  status->setInterval(1000);
+  status->setSingleShot(false);
+  status->start();
+
+  QObject::connect(_connect, SIGNAL(toggled(bool)), this, SLOT(onConnectToggled(bool)));
+  QObject::connect(_freq, SIGNAL(returnPressed()), this, SLOT(onFrequencyChanged()));
+  QObject::connect(_sampleRates, SIGNAL(currentIndexChanged(int)), this, SLOT(onSampleRateSelected(int)));
+  QObject::connect(_gain, SIGNAL(returnPressed()), this, SLOT(onGainChanged()));
+  QObject::connect(_agc, SIGNAL(toggled(bool)), this, SLOT(onAGCToggled(bool)));
+  QObject::connect(status, SIGNAL(timeout()), this, SLOT(onUpdateStatus()));
+}
+
+RTLTCPCtrlView::~RTLTCPCtrlView() {
+  // pass...
+}
+
+void
+RTLTCPCtrlView::_updateControls() {
+  bool connected = _source->isConnected();
+  _host->setEnabled(! connected);
+  _port->setEnabled(! connected);
+  _freq->setEnabled(connected);
+  _sampleRates->setEnabled(connected);
+  _agc->setEnabled(connected);
+  _gain->setEnabled(connected && (! _source->agcEnabled()));
+  onUpdateStatus();
+}
+
+void
+RTLTCPCtrlView::onConnectToggled(bool connect) {
+  if (connect) {
+    if (! _source->connectTo(_host->text(), _port->value())) {
+      _connect->blockSignals(true); _connect->setChecked(false); _connect->blockSignals(false);
+      _status->setText("Cannot connect.");
+      return;
+    }
+  } else {
+    _source->disconnectFrom();
+  }
+  _updateControls();
+}
+
+void
+RTLTCPCtrlView::onFrequencyChanged() {
+  _source->setFrequency(_freq->text().toDouble());
+}
+
+void
+RTLTCPCtrlView::onSampleRateSelected(int idx) {
+  _source->setSampleRate(_sampleRates->itemData(idx).toDouble());
+}
+
+void
+RTLTCPCtrlView::onGainChanged() {
+  _source->setGain(10*_gain->text().toDouble());
+}
+
+void
+RTLTCPCtrlView::onAGCToggled(bool enabled) {
+  _source->enableAGC(enabled);
+  _gain->setEnabled(! enabled);
+}
+
+void
+RTLTCPCtrlView::onUpdateStatus() {
+  if (_source->connectionLost() && _connect->isChecked()) {
+    // The receive thread has ended, release the socket in the GUI thread
+    _source->disconnectFrom();
+    _connect->blockSignals(true); _connect->setChecked(false); _connect->blockSignals(false);
+    _updateControls();
+    return;
+  }
+  if (! _source->isConnected()) {
+    _status->setText(_source->connectionLost() ? "connection lost" : "not connected");
+    return;
+  }
+  _status->setText(QString("%1 kB dropped").arg(_source->dropped()/1024));
+}
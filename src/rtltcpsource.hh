@@ -0,0 +1,246 @@
+#ifndef __SDR_RX_RTLTCPSOURCE_HH__
+#define __SDR_RX_RTLTCPSOURCE_HH__
+
+#include "source.hh"
+#include "autocast.hh"
+#include "configuration.hh"
+#include "lockfreering.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <string>
+
+#include <QLabel>
+#include <QLineEdit>
+#include <QSpinBox>
+#include <QComboBox>
+#include <QCheckBox>
+
+
+/** Command IDs of the rtl_tcp protocol. */
+typedef enum {
+  RTLTCP_SET_FREQUENCY   = 0x01,
+  RTLTCP_SET_SAMPLERATE  = 0x02,
+  RTLTCP_SET_GAIN_MODE   = 0x03,
+  RTLTCP_SET_GAIN        = 0x04,
+  RTLTCP_SET_FREQ_CORR   = 0x05,
+  RTLTCP_SET_AGC_MODE    = 0x08,
+  RTLTCP_SET_GAIN_INDEX  = 0x0d
+} RTLTCPCommand;
+
+
+/** A source node receiving I/Q data from a rtl_tcp server. The data is received by a dedicated
+ * thread directly into a fixed set of output buffers. The buffers are handed over to the queue
+ * thread by index through lock-free rings, the reference count of the buffers is never inspected
+ * by the receive thread. @c next sends the received buffers from the queue thread and returns
+ * them to the receive thread once sent, hence all sinks must be connected directly. If no buffer
+ * is free, the received data is dropped. Tuner settings are forwarded to the server via the
+ * command channel of the protocol. */
+class RTLTCPSource: public sdr::Source
+{
+public:
+  /** Constructor.
+   * @param frequency Specifies the tuner frequency.
+   * @param sampleRate Specifies the sample rate.
+   * @param bufferSize Specifies the number of I/Q samples per buffer.
+   * @param numBuffers Specifies the number of output buffers. */
+  RTLTCPSource(double frequency, double sampleRate, size_t bufferSize=128*1024, size_t numBuffers=16);
+  /** Destructor, disconnects from the server. */
+  virtual ~RTLTCPSource();
+
+  /** Connects to the given server, reads the protocol header and sends the current tuner settings.
+   * Throws a @c sdr::RuntimeError on failure. */
+  void open(const std::string &host, uint16_t port);
+  /** Disconnects from the server. */
+  void close();
+  /** Returns @c true if connected to a server and the connection was not lost. */
+  inline bool isOpen() const { return (_socket >= 0) && (! _failed); }
+  /** Returns @c true if the server closed the connection or receiving failed. The socket remains
+   * open until @c close is called by the owner. */
+  inline bool hasFailed() const { return _failed; }
+
+  /** Returns the tuner type reported by the server. */
+  inline uint32_t tunerType() const { return _tuner_type; }
+  /** Returns the number of gain steps reported by the server. */
+  inline uint32_t numGains() const { return _num_gains; }
+
+  inline double frequency() const { return _frequency; }
+  void setFrequency(double f);
+
+  inline double sampleRate() const { return _sample_rate; }
+  void setSampleRate(double rate);
+
+  inline bool agcEnabled() const { return _agc; }
+  void enableAGC(bool enable);
+
+  /** Returns the gain in tenth of dB. */
+  inline double gain() const { return _gain; }
+  /** Sets the gain in tenth of dB. */
+  void setGain(double gain);
+
+  /** Returns the number of bytes dropped since the start. */
+  inline size_t dropped() const { return _dropped; }
+
+  /** Sends the received buffers, waits briefly if there are none. Must be called from the queue
+   * thread (idle). */
+  void next();
+
+  /** Starts the receive thread. */
+  void start();
+  /** Stops the receive thread. */
+  void stop();
+
+protected:
+  /** Sends a command to the server. */
+  bool _sendCommand(RTLTCPCommand cmd, uint32_t param);
+  /** Sends all tuner settings. */
+  void _sendSettings();
+  /** The receive loop. */
+  void _receive();
+
+protected:
+  /** The socket or -1 if not connected. */
+  int _socket;
+  /** Tuner information from the protocol header. */
+  uint32_t _tuner_type, _num_gains;
+  /** Current settings. */
+  double _frequency, _sample_rate, _gain;
+  bool _agc;
+  /** Output buffers. */
+  size_t _buffer_size;
+  std::vector< sdr::Buffer< std::complex<uint8_t> > > _buffers;
+  /** Indices of the received buffers (receive thread -> queue thread) and of the free buffers
+   * (queue thread -> receive thread). */
+  LockFreeRing<size_t> _filled, _free;
+  /** Index of the buffer being received into or the number of buffers if none. It is kept
+   * across restarts of the receive thread. */
+  size_t _current;
+  /** Signals received buffers to @c next. */
+  std::mutex _ready_lock;
+  std::condition_variable _ready;
+  /** If set, @c next discards the buffers received before the last start. */
+  std::atomic<bool> _flush;
+  /** Scratch space to read dropped data into. */
+  std::vector<char> _scratch;
+  /** Number of dropped bytes. */
+  std::atomic<size_t> _dropped;
+  /** Receive thread and its run flag. */
+  std::thread _thread;
+  std::atomic<bool> _running;
+  /** Set by the receive thread if the connection was lost, reset by @c open. */
+  std::atomic<bool> _failed;
+  /** Serializes writes to the command channel. */
+  std::mutex _command_lock;
+};
+
+
+/** Persistent configuration of the rtl_tcp source. */
+class RTLTCPDataSourceConfig
+{
+public:
+  RTLTCPDataSourceConfig();
+  virtual ~RTLTCPDataSourceConfig();
+
+  QString host() const;
+  void storeHost(const QString &host);
+
+  uint16_t port() const;
+  void storePort(uint16_t port);
+
+  double frequency() const;
+  void storeFrequency(double f);
+
+  double sampleRate() const;
+  void storeSampleRate(double rate);
+
+protected:
+  /** The global config instance. */
+  Configuration &_config;
+};
+
+
+class RTLTCPDataSource: public DataSource
+{
+  Q_OBJECT
+
+public:
+  explicit RTLTCPDataSource(QObject *parent=0);
+  virtual ~RTLTCPDataSource();
+
+  virtual QWidget *createCtrlView();
+  virtual sdr::Source *source();
+
+  virtual void triggerNext();
+  virtual void queueStarted();
+  virtual void queueStopped();
+
+  virtual double tunerFrequency() const;
+  virtual bool tune(double f);
+  virtual bool setTunerGain(double gain);
+  virtual size_t droppedSamples() const;
+
+  bool isConnected() const;
+  /** Returns @c true if the connection to the server was lost. */
+  bool connectionLost() const;
+  /** Connects to the given rtl_tcp server. Returns @c false on error. */
+  bool connectTo(const QString &host, uint16_t port);
+  void disconnectFrom();
+
+  QString host() const;
+  uint16_t port() const;
+
+  double frequency() const;
+  void setFrequency(double freq);
+
+  double sampleRate() const;
+  void setSampleRate(double rate);
+
+  bool agcEnabled() const;
+  void enableAGC(bool enable);
+
+  double gain() const;
+  void setGain(double gain);
+
+  size_t dropped() const;
+
+protected:
+  RTLTCPSource _device;
+  sdr::AutoCast< std::complex<int16_t> > _to_int16;
+  RTLTCPDataSourceConfig _config;
+};
+
+
+class RTLTCPCtrlView: public QWidget
+{
+  Q_OBJECT
+
+public:
+  RTLTCPCtrlView(RTLTCPDataSource *source, QWidget *parent=0);
+  virtual ~RTLTCPCtrlView();
+
+protected slots:
+  void onConnectToggled(bool connect);
+  void onFrequencyChanged();
+  void onSampleRateSelected(int idx);
+  void onGainChanged();
+  void onAGCToggled(bool enabled);
+  void onUpdateStatus();
+
+protected:
+  void _updateControls();
+
+protected:
+  RTLTCPDataSource *_source;
+  QLineEdit *_host;
+  QSpinBox  *_port;
+  QCheckBox *_connect;
+  QLabel    *_status;
+  QLineEdit *_freq;
+  QComboBox *_sampleRates;
+  QLineEdit *_gain;
+  QCheckBox *_agc;
+};
+
+#endif // __SDR_RX_RTLTCPSOURCE_HH__
@@ -0,0 +1,260 @@
+#include "scanner.hh"
+#include "logger.hh"
+
+#include <QObject>
+#include <QMetaObject>
+
+#include <cmath>
+#include <algorithm>
+
+using namespace sdr;
+
+
+/** Hysteresis of the squelch in dB. */
+static const double scanner_hysteresis = 3.0;
+
+/** Sorts channel indices by frequency. */
+class ChannelOrder
+{
+public:
+  ChannelOrder(const std::vector<ChannelScanner::Channel> &channels) : _channels(channels) { }
+  inline bool operator()(size_t a, size_t b) const {
+    return _channels[a].frequency < _channels[b].frequency;
+  }
+protected:
+  const std::vector<ChannelScanner::Channel> &_channels;
+};
+
+
+/* ******************************************************************************************** *
+ * Implementation of ChannelScanner
+ * ******************************************************************************************** */
+ChannelScanner::ChannelScanner(QObject *target, double bandwidth, double dwell, double settle)
+  : Sink< std::complex<int16_t> >(), _target(target), _clock(0), _tag(0), _bandwidth(bandwidth), _dwell(dwell),
+    _settle(settle), _sample_rate(0), _channels(), _windows(), _window(0), _scanning(false),
+    _pending(false), _active(-1), _skip(0), _measured(0), _dwellSamples(0), _block(1),
+    _blockFill(0), _numBlocks(0)
+{
+  // pass...
+}
+
+ChannelScanner::~ChannelScanner() {
+  // pass...
+}
+
+void
+ChannelScanner::setChannels(const std::vector<Channel> &channels) {
+  std::lock_guard<std::mutex> guard(_lock);
+  _channels = channels;
+  _plan();
+}
+
+std::vector<ChannelScanner::Window>
+ChannelScanner::windows() const {
+  std::lock_guard<std::mutex> guard(_lock);
+  return _windows;
+}
+
+double
+ChannelScanner::level(size_t idx) const {
+  std::lock_guard<std::mutex> guard(_lock);
+  return (idx < _levels.size()) ? _levels[idx] : -200;
+}
+
+void
+ChannelScanner::_plan() {
+  _levels.assign(_channels.size(), -200);
+  _windows.clear();
+  if (_sample_rate > 0) {
+    plan(_channels, 0.8*_sample_rate-_bandwidth, _bandwidth, _windows);
+  }
+  // Allocate one NCO per channel of the largest window
+  size_t n = 0;
+  for (size_t i=0; i<_windows.size(); i++) { n = std::max(n, _windows[i].channels.size()); }
+  std::vector<NCO>(n).swap(_ncos);
+  _sums.assign(n, 0); _power.assign(n, 0);
+  _window = 0;
+}
+
+void
+ChannelScanner::start() {
+  std::lock_guard<std::mutex> guard(_lock);
+  _window = 0; _active = -1;
+  _scanning = true;
+  if (_windows.size()) { _retune(); }
+}
+
+void
+ChannelScanner::stop() {
+  std::lock_guard<std::mutex> guard(_lock);
+  _scanning = false;
+  _pending = false;
+  _active = -1;
+}
+
+void
+ChannelScanner::retuned(uint64_t tag) {
+  std::lock_guard<std::mutex> guard(_lock);
+  // A retune requested before a new plan may refer to a window that no longer exists
+  if (_window >= _windows.size()) { return; }
+  _enterWindow();
+  _tag = tag;
+  _skip = size_t(_settle*_sample_rate);
+  _pending = false;
+}
+
+void
+ChannelScanner::setClock(const LatencyMonitor *clock) {
+  std::lock_guard<std::mutex> guard(_lock);
+  _clock = clock;
+}
+
+void
+ChannelScanner::plan(const std::vector<Channel> &channels, double span, double bandwidth,
+                     std::vector<Window> &windows)
+{
+  windows.clear();
+  std::vector<size_t> order(channels.size());
+  for (size_t i=0; i<order.size(); i++) { order[i] = i; }
+  std::sort(order.begin(), order.end(), ChannelOrder(channels));
+
+  // Greedily collect all channels within the span starting at the lowest channel
+  size_t i = 0;
+  while (i < order.size()) {
+    Window window;
+    double first = channels[order[i]].frequency, last = first;
+    while ((i < order.size()) && ((channels[order[i]].frequency-first) <= std::max(0.0, span))) {
+      last = channels[order[i]].frequency;
+      window.channels.push_back(order[i++]);
+    }
+    window.tuner = (first+last)/2;
+    // Keep channels away from the DC offset of the tuner
+    for (size_t j=0; j<window.channels.size(); j++) {
+      if (std::abs(channels[window.channels[j]].frequency-window.tuner) < bandwidth) {
+        window.tuner -= bandwidth; break;
+      }
+    }
+    windows.push_back(window);
+  }
+}
+
+void
+ChannelScanner::config(const Config &src_cfg) {
+  // Requires type, sample rate & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+  // Check buffer type
+  if (Config::typeId< std::complex<int16_t> >() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure ChannelScanner: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId< std::complex<int16_t> >();
+    throw err;
+  }
+
+  std::lock_guard<std::mutex> guard(_lock);
+  _mixed.resize(src_cfg.bufferSize());
+  if (_sample_rate != src_cfg.sampleRate()) {
+    // The plan depends on the sample rate
+    _sample_rate = src_cfg.sampleRate();
+    _block = std::max(size_t(1), size_t(std::round(_sample_rate/_bandwidth)));
+    _dwellSamples = size_t(_dwell*_sample_rate);
+    _plan();
+    if (_scanning && _windows.size()) { _retune(); }
+  }
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Configured ChannelScanner node: " << this << std::endl
+      << " sample-rate: " << _sample_rate << std::endl
+      << " channels: " << _channels.size() << std::endl
+      << " tuning windows: " << _windows.size();
+  Logger::get().log(msg);
+}
+
+void
+ChannelScanner::process(const Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite) {
+  if ((! _scanning) || _pending) { return; }
+  std::lock_guard<std::mutex> guard(_lock);
+  if (_pending || (_window >= _windows.size())) { return; }
+
+  // Skip samples delivered before the retune took effect. The clock has seen this buffer
+  // already, a tag beyond its end stems from before a restart of the clock.
+  if (_clock && _tag) {
+    uint64_t end = _clock->samples(), start = end - std::min(end, uint64_t(buffer.size()));
+    if (_tag > end) { _tag = 0; }
+    else if (_tag > start) { _skip += _tag-start; _tag = 0; }
+    else { _tag = 0; }
+  }
+  // and those captured while the tuner settles
+  size_t offset = std::min(_skip, buffer.size());
+  _skip -= offset;
+  size_t N = std::min(buffer.size()-offset, _mixed.size());
+  if (0 == N) { return; }
+  const std::complex<int16_t> *in =
+      reinterpret_cast<const std::complex<int16_t> *>(buffer.data()) + offset;
+
+  // Measure all channels of the window from the same samples
+  const Window &window = _windows[_window];
+  for (size_t k=0; k<window.channels.size(); k++) {
+    _ncos[k].mix(in, _mixed.data(), N);
+    std::complex<double> sum = _sums[k];
+    double power = _power[k];
+    size_t fill = _blockFill;
+    for (size_t i=0; i<N; i++) {
+      sum += std::complex<double>(_mixed[i].real(), _mixed[i].imag());
+      if (++fill == _block) { power += std::norm(sum); sum = 0; fill = 0; }
+    }
+    _sums[k] = sum; _power[k] = power;
+  }
+  _numBlocks += (_blockFill+N)/_block;
+  _blockFill = (_blockFill+N) % _block;
+  _measured += N;
+
+  if (_measured >= _dwellSamples) { _evaluate(); }
+}
+
+void
+ChannelScanner::_enterWindow() {
+  const Window &window = _windows[_window];
+  for (size_t k=0; k<window.channels.size(); k++) {
+    _ncos[k].setSampleRate(_sample_rate);
+    _ncos[k].setFrequency(window.tuner-_channels[window.channels[k]].frequency);
+    _ncos[k].reset();
+    _sums[k] = 0; _power[k] = 0;
+  }
+  _blockFill = 0; _numBlocks = 0; _measured = 0;
+}
+
+void
+ChannelScanner::_evaluate() {
+  // Mean power of a sample of the channel, relative to full scale
+  const Window &window = _windows[_window];
+  double scale = double(_block)*_block*32768.0*32768.0*std::max(size_t(1), _numBlocks);
+  int best = -1; double margin = 0;
+  for (size_t k=0; k<window.channels.size(); k++) {
+    size_t idx = window.channels[k];
+    _levels[idx] = 10*std::log10(std::max(1e-20, _power[k]/scale));
+    double m = _levels[idx] - _channels[idx].squelch;
+    // Keep the active channel until it falls below the squelch by the hysteresis
+    if (int(idx) == _active) { m += scanner_hysteresis; }
+    if ((m > 0) && ((best < 0) || (m > margin))) { best = idx; margin = m; }
+  }
+
+  if (best != _active) {
+    _active = best;
+    QMetaObject::invokeMethod(_target, "_onScanChannel", Qt::QueuedConnection, Q_ARG(int, best));
+  }
+  if ((best < 0) && (_windows.size() > 1)) {
+    // Nothing received, move on
+    _window = (_window+1) % _windows.size();
+    _retune();
+  } else {
+    // Hold on the selected channel or measure the only window again
+    _enterWindow();
+  }
+}
+
+void
+ChannelScanner::_retune() {
+  _pending = true;
+  QMetaObject::invokeMethod(_target, "_onScanRetune", Qt::QueuedConnection,
+                            Q_ARG(double, _windows[_window].tuner));
+}
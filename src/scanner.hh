@@ -0,0 +1,142 @@
+#ifndef __SDR_RX_SCANNER_HH__
+#define __SDR_RX_SCANNER_HH__
+
+#include "node.hh"
+#include "nco.hh"
+#include "latency.hh"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class QObject;
+
+
+/** Scans a list of memory channels, each with its own squelch threshold.
+ *
+ * The channels are grouped into tuning windows: All channels within one window are received
+ * with a single tuner frequency and their levels are measured in parallel from the same capture.
+ * Hence, only moving to the next window requires a retune. The plan is built once, when the
+ * channels or the sample rate change.
+ *
+ * The level of each channel in the current window is measured by mixing the channel down to 0
+ * using a @c NCO, summing blocks of samples (a boxcar filter & decimator of about the channel
+ * bandwidth) and averaging the power of the sums over the dwell time. If any channel exceeds its
+ * squelch threshold, the strongest one is selected and the scanner holds until it falls below
+ * the threshold by more than the hysteresis.
+ *
+ * The scanner is connected directly to the source and hence runs in its thread. Retunes and
+ * selected channels are passed to the slots @c _onScanRetune(double) and @c _onScanChannel(int)
+ * of the target object through queued calls. The target calls @c retuned with the tag of the
+ * first sample after the retune (an index of the capture clock set by @c setClock, see
+ * @c RTLControl). Earlier samples and those within the settle time after the tag are ignored.
+ *
+ * The plan, the measurement and the levels are shared between the source thread and the GUI
+ * thread, hence they are guarded by a mutex held by @c process for the duration of a buffer. */
+class ChannelScanner: public sdr::Sink< std::complex<int16_t> >
+{
+public:
+  /** A memory channel. */
+  typedef struct {
+    /** Frequency in Hz. */
+    double frequency;
+    /** Squelch threshold in dBFS. */
+    double squelch;
+  } Channel;
+
+  /** A tuning window of the plan. */
+  typedef struct {
+    /** Tuner frequency. */
+    double tuner;
+    /** Indices of the channels received with this tuner frequency. */
+    std::vector<size_t> channels;
+  } Window;
+
+public:
+  /** Constructor.
+   * @param target Specifies the object receiving retune requests and selected channels.
+   * @param bandwidth Specifies the channel bandwidth in Hz.
+   * @param dwell Specifies the measurement time per window in seconds.
+   * @param settle Specifies the time skipped after a retune in seconds. */
+  ChannelScanner(QObject *target, double bandwidth=12.5e3, double dwell=0.02, double settle=0.005);
+  /** Destructor. */
+  virtual ~ChannelScanner();
+
+  /** Returns the channels, these are only modified by @c setChannels. */
+  inline const std::vector<Channel> &channels() const { return _channels; }
+  /** Sets the channels, the scan must be stopped. */
+  void setChannels(const std::vector<Channel> &channels);
+  /** Returns a copy of the tuning plan. */
+  std::vector<Window> windows() const;
+
+  /** Returns @c true if scanning. */
+  inline bool isScanning() const { return _scanning; }
+  /** Starts scanning at the first window, requests a retune. */
+  void start();
+  /** Stops scanning. */
+  void stop();
+  /** Must be called by the target once the tuner was retuned, @c tag is the index of the first
+   * sample w.r.t. the capture clock delivered after the retune. */
+  void retuned(uint64_t tag);
+  /** Sets the capture clock of the source, counting the samples received by the scanner. */
+  void setClock(const LatencyMonitor *clock);
+
+  /** Returns the currently selected channel or -1. */
+  inline int activeChannel() const { return _active; }
+  /** Returns the last measured level of the given channel in dBFS. */
+  double level(size_t idx) const;
+
+  /** Groups the channels into tuning windows of the given span, the tuner frequency is placed
+   * such that no channel lies at the DC offset of the tuner. */
+  static void plan(const std::vector<Channel> &channels, double span, double bandwidth,
+                   std::vector<Window> &windows);
+
+  virtual void config(const sdr::Config &src_cfg);
+  virtual void process(const sdr::Buffer< std::complex<int16_t> > &buffer, bool allow_overwrite);
+
+protected:
+  /** Builds the plan for the current channels and sample rate, the lock must be held. */
+  void _plan();
+  /** Sets up the NCOs for the current window and resets the measurement. */
+  void _enterWindow();
+  /** Evaluates the measurement of the current window. */
+  void _evaluate();
+  /** Requests a retune to the current window. */
+  void _retune();
+
+protected:
+  /** Guards the plan, the measurement state, the levels and the clock. */
+  mutable std::mutex _lock;
+  QObject *_target;
+  /** Capture clock of the source. */
+  const LatencyMonitor *_clock;
+  /** Index of the first sample after the last retune. */
+  std::atomic<uint64_t> _tag;
+  double _bandwidth, _dwell, _settle;
+  double _sample_rate;
+  std::vector<Channel> _channels;
+  std::vector<Window> _windows;
+  /** Current window. */
+  size_t _window;
+  std::atomic<bool> _scanning;
+  /** If @c true, a retune is pending and samples are ignored. */
+  std::atomic<bool> _pending;
+  /** Selected channel or -1. */
+  std::atomic<int> _active;
+  /** Samples to skip, samples measured and samples per measurement. */
+  size_t _skip, _measured, _dwellSamples;
+  /** Number of samples per block sum. */
+  size_t _block;
+  /** One NCO per channel of the current window. */
+  std::vector<NCO> _ncos;
+  /** Running block sums and accumulated power per channel of the current window. */
+  std::vector< std::complex<double> > _sums;
+  std::vector<double> _power;
+  size_t _blockFill, _numBlocks;
+  /** Last measured levels of all channels. */
+  std::vector<double> _levels;
+  /** Mixer output. */
+  std::vector< std::complex<int16_t> > _mixed;
+};
+
+#endif // __SDR_RX_SCANNER_HH__
@@ -3,11 +3,15 @@
 #include "portaudiosource.hh"
 #include "filesource.hh"
 #include "rtldatasource.hh"
+#include "rtltcpsource.hh"
+#include "generatorsource.hh"
 #include "queue.hh"
+#include "configuration.hh"
 
 
 #include <QWidget>
 #include <QComboBox>
+#include <QHBoxLayout>
 
 
 /* ********************************************************************************************* *
@@ -46,18 +50,39 @@ DataSource::tunerFrequency() const {
   return 0;
 }
 
+bool
+DataSource::tune(double f) {
+  return false;
+}
+
+bool
+DataSource::setTunerGain(double gain) {
+  return false;
+}
+
+size_t
+DataSource::droppedSamples() const {
+  return 0;
+}
+
 
 /* ********************************************************************************************* *
  * Implementation of DataSourceCtrl
  * ********************************************************************************************* */
 DataSourceCtrl::DataSourceCtrl(Receiver *receiver)
-  : QObject(receiver), Proxy(), _receiver(receiver), _source(SOURCE_PORT), _src_obj(0)
+  : QObject(receiver), Proxy(), _receiver(receiver), _source(SOURCE_PORT), _src_obj(0), _server()
 {
-  // Initialize PortAudio
-  sdr::PortAudio::init();
-
-  // Instantiate data source
-  setSource(SOURCE_PORT);
+  // Instantiate the last used data source, this avoids probing devices which are not used
+  int source = Configuration::get().value("DataSource/source", int(SOURCE_PORT)).toInt();
+  if ((source < SOURCE_PORT) || (source > SOURCE_GENERATOR)) { source = SOURCE_PORT; }
+  setSource(Src(source));
+
+  // Source stream can be shared via rtl_tcp
+  this->connect(&_server, true);
+  Configuration &config = Configuration::get();
+  if (config.value("RTLTCPServer/enabled", false).toBool()) {
+    startServer(config.value("RTLTCPServer/port", 1234).toUInt());
+  }
 
   sdr::Queue::get().addIdle(this, &DataSourceCtrl::_onQueueIdle);
   sdr::Queue::get().addStart(this, &DataSourceCtrl::_onQueueStart);
@@ -75,10 +100,12 @@ DataSourceCtrl::setSource(Src source) {
   bool was_running = _receiver->isRunning();
   if (was_running) { _receiver->stop(); }
 
-  // Unlink current source
-  _src_obj->disconnect(this);
-  // Free current source late
-  _src_obj->deleteLater();
+  if (_src_obj) {
+    // Unlink current source
+    _src_obj->disconnect(this);
+    // Free current source late
+    _src_obj->deleteLater();
+  }
 
   // Create and link new data source
   _source = source;
@@ -87,8 +114,12 @@ DataSourceCtrl::setSource(Src source) {
   case SOURCE_PORT_IQ: _src_obj = new PortAudioIQSource(this); break;
   case SOURCE_FILE: _src_obj = new FileSource(this); break;
   case SOURCE_RTL: _src_obj = new RTLDataSource(this); break;
+  case SOURCE_RTL_TCP: _src_obj = new RTLTCPDataSource(this); break;
+  case SOURCE_GENERATOR: _src_obj = new GeneratorSource(this); break;
   }
   _src_obj->source()->connect(this, true);
+  QObject::connect(_src_obj, SIGNAL(channelSelected(double)), this, SIGNAL(channelSelected(double)));
+  Configuration::get().setValue("DataSource/source", int(_source));
 
   if (was_running) { _receiver->start(); }
 }
@@ -104,6 +135,58 @@ DataSourceCtrl::tunerFrequency() const {
   return _src_obj->tunerFrequency();
 }
 
+bool
+DataSourceCtrl::tune(double f) {
+  return _src_obj->tune(f);
+}
+
+bool
+DataSourceCtrl::setTunerGain(double gain) {
+  return _src_obj->setTunerGain(gain);
+}
+
+size_t
+DataSourceCtrl::droppedSamples() const {
+  return _src_obj->droppedSamples();
+}
+
+bool
+DataSourceCtrl::isServerRunning() const {
+  return _server.isRunning();
+}
+
+bool
+DataSourceCtrl::startServer(uint16_t port) {
+  try {
+    _server.start(port);
+  } catch (sdr::SDRError &err) {
+    sdr::LogMessage msg(sdr::LOG_WARNING);
+    msg << "Can not start rtl_tcp server: " << err.what();
+    sdr::Logger::get().log(msg);
+    return false;
+  }
+  Configuration::get().setValue("RTLTCPServer/enabled", true);
+  Configuration::get().setValue("RTLTCPServer/port", port);
+  return true;
+}
+
+void
+DataSourceCtrl::stopServer() {
+  _server.stop();
+  Configuration::get().setValue("RTLTCPServer/enabled", false);
+}
+
+uint16_t
+DataSourceCtrl::serverPort() const {
+  if (_server.isRunning()) { return _server.port(); }
+  return Configuration::get().value("RTLTCPServer/port", 1234).toUInt();
+}
+
+size_t
+DataSourceCtrl::serverClients() {
+  return _server.numClients();
+}
+
 void
 DataSourceCtrl::_onQueueIdle() {
   _src_obj->triggerNext();
@@ -132,6 +215,8 @@ DataSourceCtrlView::DataSourceCtrlView(DataSourceCtrl *src_ctrl, QWidget *parent
   src_sel->addItem("Port Audio I/Q");
   src_sel->addItem("WAV File");
   src_sel->addItem("RTL2832");
+  src_sel->addItem("rtl_tcp");
+  src_sel->addItem("Signal generator");
 
   // Get current source from receiver
   switch (_src_ctrl->source()) {
@@ -139,13 +224,28 @@ DataSourceCtrlView::DataSourceCtrlView(DataSourceCtrl *src_ctrl, QWidget *parent
   case DataSourceCtrl::SOURCE_PORT_IQ: src_sel->setCurrentIndex(1); break;
   case DataSourceCtrl::SOURCE_FILE: src_sel->setCurrentIndex(2); break;
   case DataSourceCtrl::SOURCE_RTL: src_sel->setCurrentIndex(3); break;
+  case DataSourceCtrl::SOURCE_RTL_TCP: src_sel->setCurrentIndex(4); break;
+  case DataSourceCtrl::SOURCE_GENERATOR: src_sel->setCurrentIndex(5); break;
   }
   _currentSrcCtrl = _src_ctrl->createCtrlView();
 
+  QCheckBox *server = new QCheckBox("Share via rtl_tcp");
+  server->setChecked(_src_ctrl->isServerRunning());
+  _server_port = new QSpinBox();
+  _server_port->setRange(1, 65535);
+  _server_port->setValue(_src_ctrl->serverPort());
+  _server_port->setEnabled(! _src_ctrl->isServerRunning());
+
   QObject::connect(src_sel, SIGNAL(currentIndexChanged(int)), this, SLOT(_onSourceSelected(int)));
+  QObject::connect(server, SIGNAL(toggled(bool)), this, SLOT(_onServerToggled(bool)));
+
+  QHBoxLayout *server_layout = new QHBoxLayout();
+  server_layout->addWidget(server, 1);
+  server_layout->addWidget(_server_port, 0);
 
   _layout = new QVBoxLayout();
   _layout->addWidget(src_sel, 0);
+  _layout->addLayout(server_layout, 0);
   _layout->addWidget(_currentSrcCtrl, 1);
 
   setLayout(_layout);
@@ -163,6 +263,8 @@ DataSourceCtrlView::_onSourceSelected(int index) {
   case 1: _src_ctrl->setSource(DataSourceCtrl::SOURCE_PORT_IQ); break;
   case 2: _src_ctrl->setSource(DataSourceCtrl::SOURCE_FILE); break;
   case 3: _src_ctrl->setSource(DataSourceCtrl::SOURCE_RTL); break;
+  case 4: _src_ctrl->setSource(DataSourceCtrl::SOURCE_RTL_TCP); break;
+  case 5: _src_ctrl->setSource(DataSourceCtrl::SOURCE_GENERATOR); break;
   default: return;
   }
 
@@ -171,3 +273,16 @@ DataSourceCtrlView::_onSourceSelected(int index) {
   _currentSrcCtrl = _src_ctrl->createCtrlView();
   _layout->addWidget(_currentSrcCtrl);
 }
+
+void
+DataSourceCtrlView::_onServerToggled(bool enabled) {
+  if (enabled) {
+    if (! _src_ctrl->startServer(_server_port->value())) {
+      QCheckBox *server = qobject_cast<QCheckBox *>(sender());
+      server->blockSignals(true); server->setChecked(false); server->blockSignals(false);
+    }
+  } else {
+    _src_ctrl->stopServer();
+  }
+  _server_port->setEnabled(! _src_ctrl->isServerRunning());
+}
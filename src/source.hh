@@ -4,8 +4,11 @@
 #include <QObject>
 #include <QWidget>
 #include <QVBoxLayout>
+#include <QCheckBox>
+#include <QSpinBox>
 
 #include "node.hh"
+#include "rtltcpserver.hh"
 
 // Forward Declaration
 class Receiver;
@@ -30,6 +33,19 @@ public:
   /** Can be overwritten by any sub-class to provide the tuner frequency of the source. By default,
    * this method returns 0, means there is no tuner. */
   virtual double tunerFrequency() const;
+  /** Retunes the tuner without storing the frequency in the configuration. This method may be
+   * called from the processing thread. By default, it returns @c false, means there is no tuner. */
+  virtual bool tune(double f);
+  /** Sets the tuner gain in tenth of dB. By default, it returns @c false, means there is no
+   * tuner. */
+  virtual bool setTunerGain(double gain);
+  /** Returns the number of samples dropped by the source, by default 0. */
+  virtual size_t droppedSamples() const;
+
+signals:
+  /** Gets emitted by sources scanning channels once a channel was selected. The offset of the
+   * channel w.r.t. the tuner frequency is passed. */
+  void channelSelected(double offset);
 };
 
 
@@ -40,7 +56,7 @@ class DataSourceCtrl: public QObject, public sdr::Proxy
 
 public:
   typedef enum {
-    SOURCE_PORT, SOURCE_PORT_IQ, SOURCE_FILE, SOURCE_RTL
+    SOURCE_PORT, SOURCE_PORT_IQ, SOURCE_FILE, SOURCE_RTL, SOURCE_RTL_TCP, SOURCE_GENERATOR
   } Src;
 
 public:
@@ -54,6 +70,27 @@ public:
 
   /** Returns the tuner frequency of the current source or 0 if the source does not have a tuner. */
   double tunerFrequency() const;
+  /** Retunes the current source, see @c DataSource::tune. */
+  bool tune(double f);
+  /** Sets the tuner gain of the current source in tenth of dB. */
+  bool setTunerGain(double gain);
+  /** Returns the number of samples dropped by the current source. */
+  size_t droppedSamples() const;
+
+  /** Returns @c true if the source stream gets re-exported via the rtl_tcp server. */
+  bool isServerRunning() const;
+  /** Starts the rtl_tcp server on the given port. Returns @c false on error. */
+  bool startServer(uint16_t port);
+  /** Stops the rtl_tcp server. */
+  void stopServer();
+  /** Returns the port of the rtl_tcp server. */
+  uint16_t serverPort() const;
+  /** Returns the number of clients connected to the rtl_tcp server. */
+  size_t serverClients();
+
+signals:
+  /** Forwards @c DataSource::channelSelected of the current source. */
+  void channelSelected(double offset);
 
 protected:
   void _onQueueIdle();
@@ -66,6 +103,8 @@ protected:
   Src _source;
   /** Currently selected source object. */
   DataSource *_src_obj;
+  /** Re-exports the source stream. */
+  RTLTCPServer _server;
 };
 
 
@@ -80,9 +119,11 @@ public:
 
 protected slots:
   void _onSourceSelected(int index);
+  void _onServerToggled(bool enabled);
 
 protected:
   DataSourceCtrl *_src_ctrl;
+  QSpinBox *_server_port;
   QVBoxLayout *_layout;
   QWidget *_currentSrcCtrl;
 };
@@ -0,0 +1,57 @@
+#include "spectrumtraces.hh"
+#include <algorithm>
+
+
+/* ******************************************************************************************** *
+ * Implementation of SpectrumTraces
+ * ******************************************************************************************** */
+const float SpectrumTraces::Floor = -200;
+
+SpectrumTraces::SpectrumTraces(float alpha, float decay)
+  : _alpha(alpha), _decay(decay), _reset(true), _current(), _average(), _peak(), _minimum()
+{
+  // pass...
+}
+
+void
+SpectrumTraces::setAlpha(float alpha) {
+  _alpha = std::max(0.0f, std::min(1.0f, alpha));
+}
+
+void
+SpectrumTraces::setDecay(float decay) {
+  _decay = std::max(0.0f, decay);
+}
+
+void
+SpectrumTraces::reset() {
+  _reset = true;
+}
+
+void
+SpectrumTraces::update(const double *power, size_t N) {
+  if (N != _current.size()) {
+    _current.resize(N); _average.resize(N); _peak.resize(N); _minimum.resize(N);
+    _reset = true;
+  }
+
+  float *cur = _current.data(), *avg = _average.data(), *pk = _peak.data(), *mn = _minimum.data();
+  if (_reset) {
+    for (size_t i=0; i<N; i++) {
+      float db = std::max(Floor, fastDB(float(power[i])));
+      cur[i] = avg[i] = pk[i] = mn[i] = db;
+    }
+    _reset = false;
+    return;
+  }
+
+  // Fused update of all traces
+  const float alpha = _alpha, decay = _decay;
+  for (size_t i=0; i<N; i++) {
+    float db = std::max(Floor, fastDB(float(power[i])));
+    cur[i] = db;
+    avg[i] += alpha*(db-avg[i]);
+    pk[i] = std::max(db, pk[i]-decay);
+    mn[i] = std::min(db, mn[i]);
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef __SDR_RX_SPECTRUMTRACES_HH__
+#define __SDR_RX_SPECTRUMTRACES_HH__
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <stdint.h>
+
+
+/** Averaged, peak-hold and min-hold traces of a power spectrum in dB.
+ *
+ * All traces are updated in a single pass over the bins of a new power spectrum, which converts
+ * the power to dB using a fast log2 approximation (error below 0.03 dB) instead of @c std::log10.
+ * The loop is free of branches and works on contiguous float arrays, hence it gets vectorized by
+ * the compiler. The averaged trace is an exponential moving average in dB, the peak-hold trace
+ * decays slowly towards the current spectrum and the min-hold trace keeps the minimum since the
+ * last reset. */
+class SpectrumTraces
+{
+public:
+  /** Lower bound of all traces in dB. */
+  static const float Floor;
+
+public:
+  /** Constructor.
+   * @param alpha Specifies the weight of a new spectrum in the average.
+   * @param decay Specifies the decay of the peak-hold trace in dB per update. */
+  SpectrumTraces(float alpha=0.3, float decay=0.5);
+
+  /** Returns the number of bins. */
+  inline size_t size() const { return _current.size(); }
+
+  inline float alpha() const { return _alpha; }
+  void setAlpha(float alpha);
+  inline float decay() const { return _decay; }
+  void setDecay(float decay);
+
+  /** Updates the traces with a new power spectrum of @c N bins. The traces get reset if the
+   * number of bins changed. */
+  void update(const double *power, size_t N);
+  /** Resets the traces, the next spectrum initializes all of them. */
+  void reset();
+
+  /** Returns the most recent spectrum in dB. */
+  inline const std::vector<float> &current() const { return _current; }
+  /** Returns the averaged spectrum in dB. */
+  inline const std::vector<float> &average() const { return _average; }
+  /** Returns the peak-hold trace in dB. */
+  inline const std::vector<float> &peak() const { return _peak; }
+  /** Returns the min-hold trace in dB. */
+  inline const std::vector<float> &minimum() const { return _minimum; }
+
+  /** Returns an approximation of log2(x) for x > 0. */
+  static inline float fastLog2(float x) {
+    uint32_t bits; memcpy(&bits, &x, sizeof(bits));
+    float e = float(int32_t((bits >> 23) & 0xff) - 128);
+    // Mantissa in [1,2), second order polynomial approximation of 1+log2(m)
+    bits = (bits & 0x007fffff) | 0x3f800000;
+    float m; memcpy(&m, &bits, sizeof(m));
+    return e + (-0.34484843f*m + 2.02466578f)*m - 0.67487759f;
+  }
+  /** Returns an approximation of 10*log10(x) for x >= 0. */
+  static inline float fastDB(float x) {
+    // 10*log10(2) = 3.0103
+    return 3.01029996f*fastLog2(x);
+  }
+
+protected:
+  /** Weight of a new spectrum and decay of the peak trace. */
+  float _alpha, _decay;
+  /** If @c true, the next update initializes the traces. */
+  bool _reset;
+  /** The traces. */
+  std::vector<float> _current, _average, _peak, _minimum;
+};
+
+#endif // __SDR_RX_SPECTRUMTRACES_HH__
@@ -0,0 +1,115 @@
+#include "waterfallhistory.hh"
+#include <algorithm>
+#include <cstring>
+
+
+/* ******************************************************************************************** *
+ * Implementation of WaterfallHistory
+ * ******************************************************************************************** */
+WaterfallHistory::WaterfallHistory(size_t budget, float mindB, float maxdB)
+  : _budget(budget), _mindB(mindB), _maxdB(maxdB), _quantized()
+{
+  _allocate(0);
+}
+
+void
+WaterfallHistory::setBudget(size_t bytes) {
+  _budget = bytes;
+  _allocate(_quantized.size());
+}
+
+void
+WaterfallHistory::setRange(float mindB, float maxdB) {
+  _mindB = mindB; _maxdB = std::max(mindB+1, maxdB);
+  clear();
+}
+
+void
+WaterfallHistory::clear() {
+  for (size_t l=0; l<NumLevels; l++) {
+    _levels[l].head = _levels[l].rows = _levels[l].pendingRows = 0;
+  }
+}
+
+void
+WaterfallHistory::add(const float *dB, size_t N, int64_t time) {
+  if (N != _quantized.size()) { _allocate(N); }
+  if ((0 == N) || (0 == _levels[0].capacity)) { return; }
+
+  // Quantize, branch free
+  float scale = 255/(_maxdB-_mindB), offset = _mindB;
+  uint8_t *q = _quantized.data();
+  for (size_t i=0; i<N; i++) {
+    float v = std::max(0.0f, std::min(255.0f, (dB[i]-offset)*scale + 0.5f));
+    q[i] = uint8_t(v);
+  }
+  _push(0, q, time);
+}
+
+const uint8_t *
+WaterfallHistory::row(size_t level, size_t i) const {
+  const Level &lvl = _levels[level];
+  size_t idx = (lvl.head + lvl.capacity - 1 - i) % lvl.capacity;
+  return lvl.data.data() + idx*lvl.width;
+}
+
+int64_t
+WaterfallHistory::time(size_t level, size_t i) const {
+  const Level &lvl = _levels[level];
+  return lvl.times[(lvl.head + lvl.capacity - 1 - i) % lvl.capacity];
+}
+
+size_t
+WaterfallHistory::bytes() const {
+  size_t n = 0;
+  for (size_t l=0; l<NumLevels; l++) {
+    n += _levels[l].data.size() + _levels[l].pending.size();
+    n += sizeof(int64_t)*_levels[l].times.size();
+  }
+  return n;
+}
+
+void
+WaterfallHistory::_allocate(size_t N) {
+  _quantized.resize(N);
+  for (size_t l=0; l<NumLevels; l++) {
+    Level &lvl = _levels[l];
+    lvl.width = std::max(size_t(1), N >> l);
+    // Equal share of the budget for each level, including the time stamps
+    lvl.capacity = N ? (_budget/NumLevels)/(lvl.width + sizeof(int64_t)) : 0;
+    lvl.data.assign(lvl.capacity*lvl.width, 0);
+    lvl.data.shrink_to_fit();
+    lvl.times.assign(lvl.capacity, 0);
+    lvl.times.shrink_to_fit();
+    lvl.pending.assign(l ? _levels[l-1].width : 0, 0);
+    lvl.head = lvl.rows = lvl.pendingRows = 0;
+    _pendingTimes[l] = 0;
+  }
+}
+
+void
+WaterfallHistory::_push(size_t level, const uint8_t *row, int64_t time) {
+  Level &lvl = _levels[level];
+  if (0 == lvl.capacity) { return; }
+  memcpy(lvl.data.data() + lvl.head*lvl.width, row, lvl.width);
+  lvl.times[lvl.head] = time;
+  lvl.head = (lvl.head+1) % lvl.capacity;
+  lvl.rows = std::min(lvl.rows+1, lvl.capacity);
+
+  if ((level+1) >= NumLevels) { return; }
+
+  // Combine pairs of rows of this level into the next level
+  Level &next = _levels[level+1];
+  uint8_t *pending = next.pending.data();
+  if (0 == next.pendingRows) {
+    memcpy(pending, row, lvl.width);
+    _pendingTimes[level+1] = time;
+    next.pendingRows = 1;
+    return;
+  }
+  for (size_t i=0; i<lvl.width; i++) { pending[i] = std::max(pending[i], row[i]); }
+  next.pendingRows = 0;
+  // Combine pairs of bins, in place
+  for (size_t i=0; i<next.width; i++) { pending[i] = std::max(pending[2*i], pending[2*i+1]); }
+  _push(level+1, pending, _pendingTimes[level+1]);
+}
@@ -0,0 +1,94 @@
+#ifndef __SDR_RX_WATERFALLHISTORY_HH__
+#define __SDR_RX_WATERFALLHISTORY_HH__
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+
+/** A long-term history of spectra for the waterfall display.
+ *
+ * The spectra are stored quantized to 8 bit over a fixed dB range. Besides the full resolution
+ * spectra (level 0), the history keeps a pyramid of downsampled levels: Each row of level @c L
+ * combines two consecutive rows and two adjacent bins of level @c L-1, hence it covers 2^L
+ * spectra and 2^L bins. The maximum is kept, such that short or narrow signals remain visible in
+ * the overview. Zooming out or scrolling back is then served from the precomputed levels.
+ *
+ * Each level is a ring buffer holding an equal share of the memory budget. As the rows of higher
+ * levels are smaller, these cover a much longer time span (level L covers 4^L times the time span
+ * of level 0). */
+class WaterfallHistory
+{
+public:
+  /** Number of levels, including the full resolution level. */
+  static const size_t NumLevels = 6;
+
+protected:
+  /** A level of the pyramid. */
+  typedef struct {
+    /** Number of bins per row. */
+    size_t width;
+    /** Maximum number of rows, index of the next row and number of stored rows. */
+    size_t capacity, head, rows;
+    /** The rows and their time stamps. */
+    std::vector<uint8_t> data;
+    std::vector<int64_t> times;
+    /** Row combined from the previous level and the number of rows combined. */
+    std::vector<uint8_t> pending;
+    size_t pendingRows;
+  } Level;
+
+public:
+  /** Constructor.
+   * @param budget Specifies the memory budget in bytes.
+   * @param mindB Specifies the level mapped to 0.
+   * @param maxdB Specifies the level mapped to 255. */
+  WaterfallHistory(size_t budget=64*1024*1024, float mindB=-120, float maxdB=0);
+
+  /** Returns the memory budget in bytes. */
+  inline size_t budget() const { return _budget; }
+  /** Sets the memory budget, clears the history. */
+  void setBudget(size_t bytes);
+
+  inline float mindB() const { return _mindB; }
+  inline float maxdB() const { return _maxdB; }
+  /** Sets the quantization range, clears the history. */
+  void setRange(float mindB, float maxdB);
+
+  /** Appends a spectrum of @c N bins in dB, recorded at @c time (in ms). The history gets cleared
+   * if the number of bins changed. */
+  void add(const float *dB, size_t N, int64_t time);
+  /** Deletes all rows. */
+  void clear();
+
+  /** Returns the number of bins of the rows of the given level. */
+  inline size_t width(size_t level) const { return _levels[level].width; }
+  /** Returns the number of rows stored in the given level. */
+  inline size_t rows(size_t level) const { return _levels[level].rows; }
+  /** Returns the given row of the given level, row 0 is the most recent one. */
+  const uint8_t *row(size_t level, size_t i) const;
+  /** Returns the time stamp of the given row (of the first spectrum it covers). */
+  int64_t time(size_t level, size_t i) const;
+
+  /** Returns the level in dB of a quantized value. */
+  inline float decode(uint8_t value) const { return _mindB + value*(_maxdB-_mindB)/255; }
+  /** Returns the number of bytes allocated. */
+  size_t bytes() const;
+
+protected:
+  /** (Re-) Allocates the levels for spectra of @c N bins. */
+  void _allocate(size_t N);
+  /** Stores a row in the given level and passes it on to the next level. */
+  void _push(size_t level, const uint8_t *row, int64_t time);
+
+protected:
+  size_t _budget;
+  float _mindB, _maxdB;
+  /** Scratch row for the quantized spectrum. */
+  std::vector<uint8_t> _quantized;
+  /** Time stamps of the pending rows of each level. */
+  int64_t _pendingTimes[NumLevels];
+  Level _levels[NumLevels];
+};
+
+#endif // __SDR_RX_WATERFALLHISTORY_HH__
@@ -0,0 +1,385 @@
+#include "wfmstereo.hh"
+#include "bufferpool.hh"
+#include "filterdesign.hh"
+#include "logger.hh"
+#include <cmath>
+
+using namespace sdr;
+
+
+/** Number of bits of the phase used to index the cosine table. */
+#define COS_TABLE_BITS 10
+/** Offset of a quarter period in the cosine table. */
+#define COS_TABLE_QUARTER (1<<(COS_TABLE_BITS-2))
+/** Shift to obtain the cosine table index from a phase. */
+#define COS_TABLE_SHIFT (32-COS_TABLE_BITS)
+
+/** RDS bit rate. */
+#define RDS_BIT_RATE 1187.5
+/** Number of consecutive valid blocks required to declare sync. */
+#define RDS_SYNC_BLOCKS 3
+/** RDS check-word generator polynomial x^10+x^8+x^7+x^5+x^4+x^3+1. */
+#define RDS_POLY 0x5B9
+
+/** The RDS offset words A, B, C, D and C'. As the check word is the remainder of the data word
+ * XOR the offset word, the remainder of a valid block is the offset word itself. */
+static const uint16_t rds_offset[5] = { 0x0FC, 0x198, 0x168, 0x1B4, 0x350 };
+
+
+/** Returns the remainder of the 26bit block w.r.t. the RDS generator polynomial. */
+static inline uint16_t
+rds_syndrome(uint32_t block) {
+  uint32_t reg = 0;
+  for (int i=25; i>=0; i--) {
+    reg = (reg << 1) | ((block >> i) & 1);
+    if (reg & (1<<10)) { reg ^= RDS_POLY; }
+  }
+  return reg;
+}
+
+/** Maps a RDS char to a printable char. */
+static inline char
+rds_char(uint8_t c) {
+  return ((c >= 0x20) && (c < 0x7f)) ? char(c) : ' ';
+}
+
+
+/* ******************************************************************************************** *
+ * Implementation of RDSDecoder
+ * ******************************************************************************************** */
+RDSDecoder::RDSDecoder()
+  : _enabled(false), _decim(1), _decim_count(0), _acc(0), _delay_idx(0), _carrier2(0),
+    _sps(1), _clock(0), _history_idx(0), _last_symbol(false), _reg(0), _bit_count(0),
+    _block_idx(0), _bad_blocks(0), _sync_blocks(0), _synced(false), _pi(0), _text_ab(-1),
+    _ps(8, ' '), _rt(64, ' ')
+{
+  // pass...
+}
+
+RDSDecoder::~RDSDecoder() {
+  // pass...
+}
+
+bool
+RDSDecoder::config(double Fs) {
+  // The RDS signal occupies 57kHz +/- 2.4kHz
+  _enabled = (Fs >= 2*(57e3+2.4e3));
+  if (! _enabled) { reset(); return false; }
+  // Decimate to about 16 samples per bit
+  _decim = std::max(size_t(1), size_t(Fs/(16*RDS_BIT_RATE)));
+  double Fr = Fs/_decim;
+  _sps = Fr/RDS_BIT_RATE;
+  // Base-band low-pass
+  FilterDesign::lowPass(_taps, 33, 2.4e3, Fr);
+  _delay.resize(2*_taps.size());
+  // Matched filter history
+  _history.resize(2*size_t(_sps+8));
+  reset();
+  return true;
+}
+
+void
+RDSDecoder::reset() {
+  _decim_count = 0; _acc = 0; _carrier2 = 0; _clock = 0;
+  for (size_t i=0; i<_delay.size(); i++) { _delay[i] = 0; }
+  for (size_t i=0; i<_history.size(); i++) { _history[i] = 0; }
+  _delay_idx = 0; _history_idx = 0;
+  _last_symbol = false; _reg = 0; _bit_count = 0; _block_idx = 0; _bad_blocks = 0;
+  _sync_blocks = 0;
+  _synced = false; _pi = 0; _text_ab = -1;
+  std::lock_guard<std::mutex> guard(_lock);
+  _ps = std::string(8, ' '); _rt = std::string(64, ' ');
+}
+
+std::string
+RDSDecoder::programService() const {
+  std::lock_guard<std::mutex> guard(_lock);
+  return _ps;
+}
+
+std::string
+RDSDecoder::radioText() const {
+  std::lock_guard<std::mutex> guard(_lock);
+  return _rt;
+}
+
+void
+RDSDecoder::process(const float *x, const uint32_t *phase, const std::vector<float> &cos_table,
+                    size_t N)
+{
+  if (! _enabled) { return; }
+  const float *c = &cos_table[0];
+  for (size_t i=0; i<N; i++) {
+    // Mix down by 3rd harmonic of the pilot and integrate
+    uint32_t p = (3*phase[i]) >> COS_TABLE_SHIFT;
+    _acc += std::complex<float>(x[i]*c[p], -x[i]*c[(p-COS_TABLE_QUARTER) & ((1<<COS_TABLE_BITS)-1)]);
+    if (++_decim_count < _decim) { continue; }
+    // Dump integrator into the low-pass delay line
+    size_t M = _taps.size();
+    _delay[_delay_idx] = _delay[_delay_idx+M] = _acc;
+    _delay_idx = (_delay_idx+1) % M;
+    _acc = 0; _decim_count = 0;
+    std::complex<float> y = 0;
+    for (size_t j=0; j<M; j++) { y += _taps[j]*_delay[_delay_idx+j]; }
+    // Estimate the carrier phase from the squared signal (removes BPSK modulation)
+    _carrier2 += 0.002f*(y*y - _carrier2);
+    float phi = std::arg(_carrier2)/2;
+    _onSample(std::real(y*std::polar(1.0f, -phi)));
+  }
+}
+
+void
+RDSDecoder::_onSample(float value) {
+  size_t H = _history.size()/2;
+  _history[_history_idx] = _history[_history_idx+H] = value;
+  _history_idx = (_history_idx+1) % H;
+
+  _clock += 1;
+  if (_clock < _sps) { return; }
+  _clock -= _sps;
+
+  // Manchester matched filter over the last bit-period ending at "offset" samples in the past
+  size_t T = size_t(_sps+0.5), off = std::max(size_t(1), T/8);
+  float mf[3];
+  for (size_t k=0; k<3; k++) {
+    // window ends (2-k)*off samples before the newest one: early, on-time, late
+    size_t end = _history_idx+H-1-(2-k)*off;
+    float sum = 0;
+    for (size_t j=0; j<T; j++) { sum += (j < T/2 ? -1 : 1)*_history[end-j]; }
+    mf[k] = sum;
+  }
+  // Early-late timing error, shifts the clock towards the stronger side
+  float norm = std::abs(mf[0]) + std::abs(mf[2]);
+  if (norm > 0) {
+    _clock -= 0.05f*off*(std::abs(mf[2])-std::abs(mf[0]))/norm;
+  }
+
+  // Differential decoding
+  bool symbol = (mf[1] > 0);
+  _onBit(symbol != _last_symbol);
+  _last_symbol = symbol;
+}
+
+void
+RDSDecoder::_onBit(bool bit) {
+  _reg = ((_reg << 1) | (bit ? 1 : 0)) & 0x3ffffff;
+  _bit_count++;
+
+  if (! _synced) {
+    // Search for valid blocks, a random bit pattern matches an offset word with a probability of
+    // 5/1024. Hence, require RDS_SYNC_BLOCKS valid blocks in sequence, 26 bits apart.
+    uint16_t syn = rds_syndrome(_reg);
+    for (size_t i=0; i<5; i++) {
+      if (syn != rds_offset[i]) { continue; }
+      size_t idx = (4 == i) ? 2 : i;
+      if (_sync_blocks && (26 == _bit_count) && (idx == _block_idx)) {
+        _sync_blocks++;
+      } else {
+        _sync_blocks = 1;
+        for (size_t j=0; j<4; j++) { _group_valid[j] = false; }
+      }
+      _group[idx] = _reg >> 10; _group_valid[idx] = true;
+      _block_idx = (idx+1) % 4; _bit_count = 0; _bad_blocks = 0;
+      if (RDS_SYNC_BLOCKS <= _sync_blocks) {
+        _synced = true;
+        // The last block of a group may complete the sync
+        if (3 == idx) { _onGroup(); }
+      }
+      return;
+    }
+    return;
+  }
+
+  if (26 > _bit_count) { return; }
+  _bit_count = 0;
+
+  uint16_t syn = rds_syndrome(_reg);
+  bool valid = (syn == rds_offset[_block_idx]) || ((2 == _block_idx) && (syn == rds_offset[4]));
+  _group[_block_idx] = _reg >> 10; _group_valid[_block_idx] = valid;
+  if (valid) { _bad_blocks = 0; }
+  else if (++_bad_blocks > 20) { _synced = false; _sync_blocks = 0; return; }
+  if (0 == _block_idx) {
+    for (size_t j=1; j<4; j++) { _group_valid[j] = false; }
+  }
+  if (3 == _block_idx) { _onGroup(); }
+  _block_idx = (_block_idx+1) % 4;
+}
+
+void
+RDSDecoder::_onGroup() {
+  if (_group_valid[0]) { _pi = _group[0]; }
+  if (! _group_valid[1]) { return; }
+
+  uint16_t b = _group[1];
+  int type = (b >> 12) & 0xf;
+  bool version_b = (b >> 11) & 1;
+
+  std::lock_guard<std::mutex> guard(_lock);
+  if ((0 == type) && _group_valid[3]) {
+    // Basic tuning and switching information: 2 chars of the program service name
+    size_t seg = b & 0x3;
+    _ps[2*seg]   = rds_char(_group[3] >> 8);
+    _ps[2*seg+1] = rds_char(_group[3] & 0xff);
+  } else if (2 == type) {
+    // Radio text, clear text if A/B flag changes
+    int ab = (b >> 4) & 1;
+    if (ab != _text_ab) { _rt = std::string(64, ' '); _text_ab = ab; }
+    size_t seg = b & 0xf;
+    if ((! version_b) && _group_valid[2] && _group_valid[3]) {
+      _rt[4*seg]   = rds_char(_group[2] >> 8);
+      _rt[4*seg+1] = rds_char(_group[2] & 0xff);
+      _rt[4*seg+2] = rds_char(_group[3] >> 8);
+      _rt[4*seg+3] = rds_char(_group[3] & 0xff);
+    } else if (version_b && _group_valid[3]) {
+      _rt[2*seg]   = rds_char(_group[3] >> 8);
+      _rt[2*seg+1] = rds_char(_group[3] & 0xff);
+    }
+  }
+}
+
+
+
+/* ******************************************************************************************** *
+ * Implementation of WFMStereoDecoder
+ * ******************************************************************************************** */
+WFMStereoDecoder::WFMStereoDecoder(double audioRate, double tau)
+  : Sink<int16_t>(), Source(), _audioRate(audioRate), _tau(tau), _stereo_enabled(true),
+    _deemph_enabled(true), _stereo_possible(false), _locked(false), _phase(0), _omega(0),
+    _omega0(0), _omega_max(0), _kp(0), _ki(0), _pilot_i(0), _pilot_q(0), _pilot_alpha(0),
+    _detector(0), _detector_alpha(0), _pilot_level(0), _decim(1), _decim_count(0), _delay_idx(0),
+    _deemph_l(0), _deemph_r(0), _deemph_alpha(1), _buffer(), _rds()
+{
+  // Precompute cosine table
+  size_t N = (1<<COS_TABLE_BITS); _cos.resize(N);
+  for (size_t i=0; i<N; i++) { _cos[i] = std::cos(2*M_PI*i/N); }
+}
+
+WFMStereoDecoder::~WFMStereoDecoder() {
+  BufferPool::get().release(_buffer);
+}
+
+void
+WFMStereoDecoder::config(const Config &src_cfg) {
+  // Requires type, sample rate & buffer size
+  if (!src_cfg.hasType() || !src_cfg.hasSampleRate() || !src_cfg.hasBufferSize()) { return; }
+  // Check buffer type
+  if (Config::typeId<int16_t>() != src_cfg.type()) {
+    ConfigError err;
+    err << "Can not configure WFMStereoDecoder: Invalid type " << src_cfg.type()
+        << ", expected " << Config::typeId<int16_t>();
+    throw err;
+  }
+
+  double Fs = src_cfg.sampleRate();
+  // L-R signal occupies 38kHz +/- 15kHz
+  _stereo_possible = (Fs >= 2*(38e3+15e3));
+
+  // Pilot PLL, 2nd order loop with about 20Hz bandwidth
+  double scale = 4294967296.0/(2*M_PI);
+  _omega0 = 2*M_PI*19e3/Fs; _omega = _omega0; _omega_max = 2*M_PI*50/Fs;
+  double wn = 2*M_PI*20/Fs;
+  _kp = 2*0.707*wn*scale; _ki = wn*wn;
+  _phase = 0;
+  _pilot_i = _pilot_q = 0; _pilot_alpha = 2*M_PI*10/Fs;
+  // Phase detector low-pass at 500Hz, well above the loop bandwidth
+  _detector = 0; _detector_alpha = 1-std::exp(-2*M_PI*500/Fs);
+  // Pilot has 10% of the max. deviation of 75kHz
+  _pilot_level = 2*7.5e3/Fs;
+  _locked = false;
+
+  // Audio filter & decimation
+  _decim = std::max(size_t(1), size_t(Fs/_audioRate));
+  double Fo = Fs/_decim;
+  FilterDesign::lowPass(_taps, std::min(size_t(129), 8*_decim+1), std::min(15e3, 0.45*Fo), Fs);
+  _mono.assign(2*_taps.size(), 0); _diff.assign(2*_taps.size(), 0);
+  _delay_idx = 0; _decim_count = 0;
+  _deemph_alpha = 1-std::exp(-1./(_tau*Fo)); _deemph_l = _deemph_r = 0;
+
+  // Scratch & output buffers
+  _x.resize(src_cfg.bufferSize());
+  _phases.resize(src_cfg.bufferSize());
+  BufferPool::get().release(_buffer);
+  _buffer = BufferPool::get().acquire< std::complex<int16_t> >(src_cfg.bufferSize()/_decim + 1);
+
+  _rds.config(Fs);
+
+  LogMessage msg(LOG_DEBUG);
+  msg << "Configured WFMStereoDecoder: " << std::endl
+      << " input rate: " << Fs << "Hz" << std::endl
+      << " output rate: " << Fo << "Hz (decimation " << _decim << ")" << std::endl
+      << " filter order: " << _taps.size() << std::endl
+      << " stereo: " << (_stereo_possible ? "possible" : "not possible") << std::endl
+      << " RDS: " << (Fs >= 2*(57e3+2.4e3) ? "possible" : "not possible");
+  Logger::get().log(msg);
+
+  this->setConfig(Config(Config::Type_cs16, Fo, _buffer.size(), 1));
+}
+
+void
+WFMStereoDecoder::process(const Buffer<int16_t> &buffer, bool allow_overwrite) {
+  if (! _buffer.isUnused()) {
+#ifdef SDR_DEBUG
+    LogMessage msg(LOG_WARNING);
+    msg << "WFMStereoDecoder: Drop buffer: Output buffer still in use.";
+    Logger::get().log(msg);
+#endif
+    return;
+  }
+
+  size_t N = std::min(buffer.size(), _x.size());
+  const float *c = &_cos[0];
+  const uint32_t mask = (1<<COS_TABLE_BITS)-1;
+
+  // Pass 1: Track pilot. This is the only sequential part, it stores the composite signal and
+  // the pilot phase for the mixers below.
+  for (size_t i=0; i<N; i++) {
+    float x = float(buffer[i])/32768;
+    uint32_t p = _phase >> COS_TABLE_SHIFT;
+    float pi = 2*x*c[p], pq = -2*x*c[(p-COS_TABLE_QUARTER) & mask];
+    _pilot_i += _pilot_alpha*(pi-_pilot_i);
+    _pilot_q += _pilot_alpha*(pq-_pilot_q);
+    // Phase detector output low-pass filtered, the program audio mixed by the pilot must not
+    // pull the lock phase
+    _detector += _detector_alpha*(pq-_detector);
+    // Phase error normalized by the pilot amplitude (or a fraction of the expected one)
+    float err = _detector/std::max(std::abs(_pilot_i), 0.25f*_pilot_level);
+    err = std::max(-1.0f, std::min(1.0f, err));
+    _omega += _ki*err;
+    _omega = std::max(_omega0-_omega_max, std::min(_omega0+_omega_max, _omega));
+    _x[i] = x; _phases[i] = _phase;
+    _phase += uint32_t(int64_t(_omega*4294967296.0/(2*M_PI) + _kp*err));
+  }
+  _locked = (_pilot_i > 0.3f*_pilot_level) && (std::abs(_pilot_q) < 0.5f*_pilot_i);
+
+  // Pass 2: RDS shares the composite signal and pilot phase
+  _rds.process(&_x[0], &_phases[0], _cos, N);
+
+  // Pass 3: L+R & L-R signal, low-pass and decimation to the audio rate
+  bool stereo = _stereo_enabled && _stereo_possible && _locked;
+  size_t M = _taps.size(), j=0;
+  std::complex<int16_t> *out = reinterpret_cast< std::complex<int16_t> *>(_buffer.data());
+  for (size_t i=0; i<N; i++) {
+    // Mix L-R down using the 2nd harmonic of the pilot. The PLL locks to pilot = cos(phi), hence
+    // the subcarrier is sin(2*(phi+pi/2)) = -sin(2phi) = -cos(2phi-pi/2)
+    uint32_t p2 = (2*_phases[i]) >> COS_TABLE_SHIFT;
+    float d = stereo ? -2*_x[i]*c[(p2-COS_TABLE_QUARTER) & mask] : 0;
+    _mono[_delay_idx] = _mono[_delay_idx+M] = _x[i];
+    _diff[_delay_idx] = _diff[_delay_idx+M] = d;
+    _delay_idx = (_delay_idx+1) % M;
+    if (++_decim_count < _decim) { continue; }
+    _decim_count = 0;
+    // Evaluate filter only at the output rate
+    float m=0, s=0;
+    const float *mono = &_mono[_delay_idx], *diff = &_diff[_delay_idx];
+    for (size_t k=0; k<M; k++) { m += _taps[k]*mono[k]; s += _taps[k]*diff[k]; }
+    float l = m+s, r = m-s;
+    if (_deemph_enabled) {
+      _deemph_l += _deemph_alpha*(l-_deemph_l); l = _deemph_l;
+      _deemph_r += _deemph_alpha*(r-_deemph_r); r = _deemph_r;
+    }
+    l = std::max(-1.0f, std::min(1.0f, l)); r = std::max(-1.0f, std::min(1.0f, r));
+    out[j++] = std::complex<int16_t>(int16_t(32767*l), int16_t(32767*r));
+  }
+
+  if (j) { this->send(_buffer.head(j)); }
+}
@@ -0,0 +1,185 @@
+#ifndef __SDR_RX_WFMSTEREO_HH__
+#define __SDR_RX_WFMSTEREO_HH__
+
+#include "node.hh"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/** Decodes the RDS (57kHz BPSK) data stream from the WFM multiplex signal. The decoder does not
+ * track the RDS carrier itself, instead it uses the phase of the pilot-tone PLL of the
+ * @c WFMStereoDecoder (the RDS carrier is the 3rd harmonic of the pilot). Hence the decoder gets
+ * fed with the composite signal and pilot phase computed by the stereo decoder. */
+class RDSDecoder
+{
+public:
+  /** Constructor. */
+  RDSDecoder();
+  /** Destructor. */
+  virtual ~RDSDecoder();
+
+  /** (Re-) Configures the decoder for the given composite sample rate. Returns @c false if the
+   * sample rate is too low to receive RDS. */
+  bool config(double Fs);
+  /** Resets the decoder state and clears the received program service name and radio text. */
+  void reset();
+
+  /** Processes @c N composite samples @c x along with the pilot phase for each sample. The
+   * @c cos_table is the cosine table used by the stereo decoder. */
+  void process(const float *x, const uint32_t *phase, const std::vector<float> &cos_table,
+               size_t N);
+
+  /** Returns @c true if the decoder is synchronized to the RDS block structure. */
+  inline bool isSynchronized() const { return _synced.load(); }
+  /** Returns the program identification code. */
+  inline uint16_t pi() const { return _pi.load(); }
+  /** Returns the program service name (station name). */
+  std::string programService() const;
+  /** Returns the radio text. */
+  std::string radioText() const;
+
+protected:
+  /** Handles a single sample of the decimated baseband signal. */
+  void _onSample(float value);
+  /** Handles a decoded bit. */
+  void _onBit(bool bit);
+  /** Handles a complete group of 4 blocks. */
+  void _onGroup();
+
+protected:
+  /** If @c false, the decoder is disabled (sample rate too low). */
+  bool _enabled;
+  /** Decimation of the composite signal. */
+  size_t _decim, _decim_count;
+  /** Integrator for the mixed signal. */
+  std::complex<float> _acc;
+  /** Base-band low-pass filter taps and (doubled) delay line. */
+  std::vector<float> _taps;
+  std::vector< std::complex<float> > _delay;
+  size_t _delay_idx;
+  /** Estimate of the squared carrier (phase estimation for BPSK). */
+  std::complex<float> _carrier2;
+  /** Samples per bit and clock phase (in bits). */
+  float _sps, _clock;
+  /** History of the base-band signal for the matched filter. */
+  std::vector<float> _history;
+  size_t _history_idx;
+  /** Last demodulated symbol (differential decoding). */
+  bool _last_symbol;
+  /** Shift register of the last 26 bits. */
+  uint32_t _reg;
+  /** Number of bits received since the last block. */
+  size_t _bit_count;
+  /** Index of the next expected block (0=A,...,3=D). */
+  size_t _block_idx;
+  /** Number of consecutive invalid blocks. */
+  size_t _bad_blocks;
+  /** Number of consecutive valid blocks found while searching for sync. */
+  size_t _sync_blocks;
+  /** Data of the current group and validity of the blocks. */
+  uint16_t _group[4];
+  bool _group_valid[4];
+  /** Flags whether the decoder is synchronized. */
+  std::atomic<bool> _synced;
+  /** Program identification. */
+  std::atomic<uint16_t> _pi;
+  /** Last text A/B flag. */
+  int _text_ab;
+  /** Protects the strings below, they are written by the queue thread and read by the GUI. */
+  mutable std::mutex _lock;
+  /** Program service name (8 chars). */
+  std::string _ps;
+  /** Radio text (64 chars). */
+  std::string _rt;
+};
+
+
+/** Decodes the stereo multiplex signal of a WFM broadcast. It receives the composite signal as
+ * demodulated by the FM demodulator at the base-band rate (i.e. >= 120kHz) and derives the
+ * 38kHz L-R subcarrier from a PLL locked to the 19kHz pilot tone. The mono and difference signals
+ * get low-pass filtered and decimated to the audio rate in one pass and de-emphasized. The output
+ * is a stereo signal of type @c std::complex<int16_t>, where the real part holds the left channel
+ * and the imaginary part the right one. If the pilot is absent or stereo is disabled, both channels
+ * carry the mono signal. The same pass also feeds the @c RDSDecoder. */
+class WFMStereoDecoder: public sdr::Sink<int16_t>, public sdr::Source
+{
+public:
+  /** Constructor.
+   * @param audioRate Specifies the minimum output sample rate.
+   * @param tau Specifies the de-emphasis time constant (50us Europe, 75us US). */
+  WFMStereoDecoder(double audioRate=16000.0, double tau=50e-6);
+  /** Destructor. */
+  virtual ~WFMStereoDecoder();
+
+  /** Returns @c true if the stereo decoding is enabled. */
+  inline bool stereoEnabled() const { return _stereo_enabled; }
+  /** Enables or disables the stereo decoding. */
+  inline void enableStereo(bool enable) { _stereo_enabled = enable; }
+
+  /** Returns @c true if the de-emphasis is enabled. */
+  inline bool deemphEnabled() const { return _deemph_enabled; }
+  /** Enables or disables the de-emphasis. */
+  inline void enableDeemph(bool enable) { _deemph_enabled = enable; }
+
+  /** Returns @c true if the PLL is locked to the pilot tone. */
+  inline bool isPilotLocked() const { return _locked.load(); }
+
+  /** Returns the RDS decoder. */
+  inline RDSDecoder &rds() { return _rds; }
+  /** Returns the RDS decoder. */
+  inline const RDSDecoder &rds() const { return _rds; }
+
+  /** Configures the decoder. */
+  virtual void config(const sdr::Config &src_cfg);
+  /** Performs the stereo decoding. */
+  virtual void process(const sdr::Buffer<int16_t> &buffer, bool allow_overwrite);
+
+protected:
+  /** The minimum output sample rate. */
+  double _audioRate;
+  /** The de-emphasis time constant. */
+  double _tau;
+  /** If @c true, the stereo decoding is enabled. */
+  bool _stereo_enabled;
+  /** If @c true, the de-emphasis is enabled. */
+  bool _deemph_enabled;
+  /** If @c false, the sample rate is too low for stereo decoding. */
+  bool _stereo_possible;
+  /** Flags whether the pilot is locked. */
+  std::atomic<bool> _locked;
+
+  /** Cosine table indexed by the upper bits of the phase. */
+  std::vector<float> _cos;
+  /** Pilot PLL phase and frequency (phase units, 2^32 = 2pi). */
+  uint32_t _phase;
+  double _omega, _omega0, _omega_max;
+  /** PLL loop gains. */
+  double _kp, _ki;
+  /** Low-pass filtered in-phase & quadrature components of the pilot. */
+  float _pilot_i, _pilot_q, _pilot_alpha;
+  /** Low-pass filtered output of the phase detector. */
+  float _detector, _detector_alpha;
+  /** Expected pilot amplitude (for lock detection). */
+  float _pilot_level;
+
+  /** Block scratch buffers: composite signal and pilot phase. */
+  std::vector<float> _x;
+  std::vector<uint32_t> _phases;
+  /** Decimation factor. */
+  size_t _decim, _decim_count;
+  /** Audio low-pass taps and the doubled delay lines for the mono and difference signal. */
+  std::vector<float> _taps;
+  std::vector<float> _mono, _diff;
+  size_t _delay_idx;
+  /** De-emphasis filter state and coefficient. */
+  float _deemph_l, _deemph_r, _deemph_alpha;
+  /** Output buffer. */
+  sdr::Buffer< std::complex<int16_t> > _buffer;
+
+  /** The RDS decoder fed by this node. */
+  RDSDecoder _rds;
+};
+
+#endif // __SDR_RX_WFMSTEREO_HH__
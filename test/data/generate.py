@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+#
+# Generates the reference recordings of the demodulator regression test (demodtest.cc) and the
+# ideal demodulated signals they carry, which serve as initial golden outputs. The recordings are
+# stored like captured by a RTL2832 device: I/Q as unsigned 8 bit stereo WAV files.
+#
+# Usage: generate.py [DIRECTORY]
+#
+# It also writes an empty CPU baseline, the regression test gets skipped until the golden outputs
+# and the baseline were replaced by the actual outputs with "sdr-rx-demodtest DIRECTORY --update".
+#
+import os
+import sys
+import wave
+
+import numpy as np
+
+
+def write_iq(path, fs, z):
+    """Writes the complex signal z (|z| <= 1) as unsigned 8 bit stereo."""
+    iq = np.empty(2*len(z))
+    iq[0::2] = z.real
+    iq[1::2] = z.imag
+    data = np.clip(np.round(128 + 127*iq), 0, 255).astype(np.uint8)
+    with wave.open(path, "wb") as f:
+        f.setnchannels(2)
+        f.setsampwidth(1)
+        f.setframerate(int(fs))
+        f.writeframes(data.tobytes())
+
+
+def write_audio(path, fs, channels):
+    """Writes the given channels (each |x| <= 1) as 16 bit PCM."""
+    frames = np.stack(channels, axis=1).reshape(-1)
+    data = np.round(16384*frames).astype("<i2")
+    with wave.open(path, "wb") as f:
+        f.setnchannels(len(channels))
+        f.setsampwidth(2)
+        f.setframerate(int(fs))
+        f.writeframes(data.tobytes())
+
+
+def tones(t, *specs):
+    """Sum of tones given as (frequency, amplitude) pairs."""
+    return sum(a*np.sin(2*np.pi*f*t) for f, a in specs)
+
+
+def fm(fs, m, deviation):
+    """Frequency modulates the signal m (|m| <= 1)."""
+    return np.exp(1j*2*np.pi*deviation*np.cumsum(m)/fs)
+
+
+def audio_time(fs, duration):
+    return np.arange(int(fs*duration))/fs
+
+
+# Audio rates of the demodulators for the input rates below, see DemodulatorCtrl::setFilterWidth
+NARROW_FS, NARROW_AUDIO = 16000.0, 8000.0
+NFM_FS, NFM_AUDIO = 25000.0, 12500.0
+WFM_FS, WFM_AUDIO = 240000.0, 16000.0
+DURATION = 2.0
+
+# Header of the CPU baseline, "sdr-rx-demodtest DIRECTORY --update" appends the measurements
+BASELINE_HEADER = """# CPU time of the processing thread in ms per second of input.
+# Not measured yet: The golden outputs are the ideal signals written by generate.py and the
+# regression test gets skipped. Run "sdr-rx-demodtest DATADIR --update" with an optimized build,
+# check the outputs and commit them along with this file.
+"""
+
+
+def am(out):
+    t = audio_time(NARROW_FS, DURATION)
+    m = tones(t, (400, 0.5), (1300, 0.3))
+    write_iq(os.path.join(out, "am.wav"), NARROW_FS, 0.45*(1 + m))
+    ta = audio_time(NARROW_AUDIO, DURATION)
+    write_audio(os.path.join(out, "am.golden.wav"), NARROW_AUDIO,
+                [tones(ta, (400, 0.5), (1300, 0.3))])
+
+
+def nfm(out):
+    t = audio_time(NFM_FS, DURATION)
+    m = tones(t, (500, 0.6), (1500, 0.4))
+    write_iq(os.path.join(out, "nfm.wav"), NFM_FS, 0.8*fm(NFM_FS, m, 2500))
+    ta = audio_time(NFM_AUDIO, DURATION)
+    write_audio(os.path.join(out, "nfm.golden.wav"), NFM_AUDIO,
+                [tones(ta, (500, 0.6), (1500, 0.4))])
+
+
+def ssb(out, name, sign):
+    # Analytic tones above (USB) or below (LSB) the carrier
+    t = audio_time(NARROW_FS, DURATION)
+    z = 0.4*np.exp(sign*1j*2*np.pi*700*t) + 0.3*np.exp(sign*1j*2*np.pi*1900*t)
+    write_iq(os.path.join(out, name + ".wav"), NARROW_FS, z)
+    ta = audio_time(NARROW_AUDIO, DURATION)
+    write_audio(os.path.join(out, name + ".golden.wav"), NARROW_AUDIO,
+                [tones(ta, (700, 0.4), (1900, 0.3))])
+
+
+def keying(t):
+    """Slowly keyed envelope: 120ms elements with 20ms raised cosine edges."""
+    pattern = [1, 0, 1, 1, 1, 0, 0, 0]
+    element = 0.12
+    env = np.array([pattern[int(x/element) % len(pattern)] for x in t], dtype=float)
+    # Smooth the edges by convolution with a raised cosine of 20ms
+    fs = 1/(t[1]-t[0])
+    n = int(0.02*fs)
+    win = np.hanning(n)
+    return np.convolve(env, win/win.sum(), mode="same")
+
+
+def cw(out):
+    t = audio_time(NARROW_FS, DURATION)
+    write_iq(os.path.join(out, "cw.wav"), NARROW_FS,
+             0.8*keying(t)*np.exp(1j*2*np.pi*700*t))
+    ta = audio_time(NARROW_AUDIO, DURATION)
+    write_audio(os.path.join(out, "cw.golden.wav"), NARROW_AUDIO,
+                [0.8*keying(ta)*np.sin(2*np.pi*700*ta)])
+
+
+def wfm(out):
+    duration = 1.5
+    t = audio_time(WFM_FS, duration)
+    left = tones(t, (1000, 0.5))
+    right = tones(t, (2500, 0.5))
+    psi = 2*np.pi*19e3*t
+    m = 0.9*((left + right)/2 + (left - right)/2*np.sin(2*psi)) + 0.1*np.sin(psi)
+    write_iq(os.path.join(out, "wfm.wav"), WFM_FS, 0.8*fm(WFM_FS, m, 75e3))
+    ta = audio_time(WFM_AUDIO, duration)
+    write_audio(os.path.join(out, "wfm.golden.wav"), WFM_AUDIO,
+                [tones(ta, (1000, 0.5)), tones(ta, (2500, 0.5))])
+
+
+# PSK31 varicode of the characters used in the text
+VARICODE = {
+    " ": "1", "e": "11", "t": "101", "o": "111", "a": "1011", "i": "1101", "n": "1111",
+    "r": "10101", "s": "10111", "l": "11011", "h": "101011", "d": "101101",
+}
+BPSK31_TEXT = "the stone in the red sand"
+
+
+def bpsk31(out):
+    # Preamble of phase reversals (zeros), the text and a postamble of reversals
+    bits = "0"*32 + "".join(VARICODE[c] + "00" for c in BPSK31_TEXT) + "0"*32
+    # A zero reverses the phase, the transition is shaped by a raised cosine over one symbol
+    T = int(NARROW_FS/31.25)
+    x = np.empty(len(bits)*T)
+    shape = (1 - np.cos(np.pi*np.arange(T)/T))/2
+    sign = 1.0
+    for k, b in enumerate(bits):
+        prev = sign
+        if "0" == b:
+            sign = -sign
+        x[k*T:(k+1)*T] = prev*(1 - shape) + sign*shape
+    write_iq(os.path.join(out, "bpsk31.wav"), NARROW_FS, 0.8*x.astype(complex))
+    with open(os.path.join(out, "bpsk31.golden.txt"), "w") as f:
+        f.write(BPSK31_TEXT)
+
+
+def baseline(out):
+    """Writes an empty CPU baseline, the regression test gets skipped until it was measured."""
+    with open(os.path.join(out, "baseline.txt"), "w") as f:
+        f.write(BASELINE_HEADER)
+
+
+if __name__ == "__main__":
+    out = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(os.path.abspath(__file__))
+    am(out)
+    nfm(out)
+    ssb(out, "usb", 1)
+    ssb(out, "lsb", -1)
+    cw(out)
+    wfm(out)
+    bpsk31(out)
+    baseline(out)
@@ -0,0 +1,419 @@
+/* Golden-output regression test of all demodulators. Each reference recording in the data
+ * directory gets processed by the chain of a DemodulatorCtrl with the corresponding demodulator.
+ * The audio gets compared against a golden file within a SNR tolerance, the text of BPSK31
+ * exactly. The CPU time spent per second of input is compared against a baseline.
+ *
+ * Usage: sdr-rx-demodtest DATADIR [--update]
+ *
+ * With --update, the golden files and the baseline get replaced by the current outputs. Returns 0
+ * if all tests pass. As long as the baseline holds no measurements, the golden files are the ideal
+ * signals written by generate.py. Then the chains only get run, nothing gets compared and 77 gets
+ * returned, which ctest reports as skipped. */
+#include "demodulator.hh"
+#include "latency.hh"
+#include "audiorecorder.hh"
+#include "queue.hh"
+#include "logger.hh"
+
+#include <QCoreApplication>
+#include <QSettings>
+#include <QTemporaryDir>
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+#include <stdint.h>
+
+using namespace sdr;
+
+
+/** Buffer size of the player. */
+static const size_t BufferSize = 1024;
+/** Maximum delay of the demodulated audio w.r.t. the golden file in seconds. */
+static const double MaxDelay = 0.1;
+/** Number of taps of the filter fitted between golden and demodulated audio. */
+static const int FitTaps = 5;
+/** A fixture fails if its CPU time exceeds the baseline by this factor. */
+static const double CPUTolerance = 1.5;
+/** Exit code of the test if the data is not measured yet, see SKIP_RETURN_CODE of ctest. */
+static const int Unmeasured = 77;
+
+/** A reference recording and how it gets demodulated. */
+typedef struct {
+  /** Name of the fixture, the recording is NAME.wav, the golden output NAME.golden.wav or
+   * NAME.golden.txt for BPSK31. */
+  const char *name;
+  DemodulatorCtrl::Demod demod;
+  /** Time in seconds until the chain settled, not compared. */
+  double settle;
+  /** Minimum SNR of the audio w.r.t. the golden output in dB. */
+  double snr;
+} Fixture;
+
+static const Fixture fixtures[] = {
+  { "am",     DemodulatorCtrl::DEMOD_AM,     0.3, 20 },
+  { "wfm",    DemodulatorCtrl::DEMOD_WFM,    0.5, 15 },
+  { "nfm",    DemodulatorCtrl::DEMOD_NFM,    0.3, 20 },
+  { "usb",    DemodulatorCtrl::DEMOD_USB,    0.3, 20 },
+  { "lsb",    DemodulatorCtrl::DEMOD_LSB,    0.3, 20 },
+  { "cw",     DemodulatorCtrl::DEMOD_CW,     0.3, 20 },
+  { "bpsk31", DemodulatorCtrl::DEMOD_BPSK31, 0.0, 0 }
+};
+static const size_t num_fixtures = sizeof(fixtures)/sizeof(fixtures[0]);
+
+
+/** Reads a 8 or 16 bit PCM WAV file, 8 bit samples get scaled to 16 bit. */
+static bool
+read_wav(const std::string &filename, double &rate, size_t &channels,
+         std::vector<int16_t> &samples)
+{
+  std::ifstream file(filename.c_str(), std::ios::binary);
+  char tag[4]; uint32_t size;
+  file.read(tag, 4); file.read(reinterpret_cast<char *>(&size), 4);
+  if ((! file) || (0 != memcmp(tag, "RIFF", 4))) { return false; }
+  file.read(tag, 4);
+  if ((! file) || (0 != memcmp(tag, "WAVE", 4))) { return false; }
+  uint16_t format = 0, bits = 0;
+  while (file.read(tag, 4) && file.read(reinterpret_cast<char *>(&size), 4)) {
+    if (0 == memcmp(tag, "fmt ", 4)) {
+      std::vector<char> fmt(size);
+      if ((16 > size) || (! file.read(&fmt[0], size))) { return false; }
+      format = *reinterpret_cast<uint16_t *>(&fmt[0]);
+      channels = *reinterpret_cast<uint16_t *>(&fmt[2]);
+      rate = *reinterpret_cast<uint32_t *>(&fmt[4]);
+      bits = *reinterpret_cast<uint16_t *>(&fmt[14]);
+    } else if (0 == memcmp(tag, "data", 4)) {
+      if ((1 != format) || ((8 != bits) && (16 != bits)) || (0 == channels)) { return false; }
+      std::vector<char> data(size);
+      if (size && (! file.read(&data[0], size))) { return false; }
+      if (8 == bits) {
+        samples.resize(size);
+        for (size_t i=0; i<size; i++) { samples[i] = (int16_t(uint8_t(data[i]))-128)*256; }
+      } else {
+        samples.resize(size/2);
+        memcpy(&samples[0], &data[0], 2*samples.size());
+      }
+      return true;
+    } else {
+      // Chunks are padded to an even size
+      file.seekg(size + (size & 1), std::ios::cur);
+    }
+  }
+  return false;
+}
+
+
+/** Feeds a recording into the chain, one buffer each time the queue gets idle. The queue gets
+ * stopped at the end of the recording. */
+class Player: public Source
+{
+public:
+  Player() : Source(), _iq(0), _offset(0) {
+    Queue::get().addIdle(this, &Player::_onQueueIdle);
+  }
+
+  /** Plays the given interleaved I/Q samples. */
+  void play(const std::vector<int16_t> *iq, double rate) {
+    _iq = iq; _offset = 0;
+    setConfig(Config(Config::Type_cs16, rate, BufferSize, 1));
+  }
+
+protected:
+  void _onQueueIdle() {
+    size_t frames = _iq ? _iq->size()/2 : 0;
+    if (_offset >= frames) { Queue::get().stop(); return; }
+    size_t n = std::min(BufferSize, frames-_offset);
+    // A new buffer for each call, as the chain may hold on to it
+    Buffer< std::complex<int16_t> > buffer(n);
+    for (size_t i=0; i<n; i++) {
+      buffer[i] = std::complex<int16_t>((*_iq)[2*(_offset+i)], (*_iq)[2*(_offset+i)+1]);
+    }
+    _offset += n;
+    send(buffer);
+    buffer.unref();
+  }
+
+protected:
+  const std::vector<int16_t> *_iq;
+  size_t _offset;
+};
+
+
+/** Collects the demodulated audio, mono or stereo. */
+class Capture: public SinkBase
+{
+public:
+  Capture() : SinkBase(), rate(0), channels(1), samples() { }
+
+  virtual void config(const Config &src_cfg) {
+    if (!src_cfg.hasType() || !src_cfg.hasSampleRate()) { return; }
+    size_t chans = (Config::typeId< std::complex<int16_t> >() == src_cfg.type()) ? 2 : 1;
+    if ((chans != channels) || (src_cfg.sampleRate() != rate)) { samples.clear(); }
+    channels = chans; rate = src_cfg.sampleRate();
+  }
+
+  virtual void handleBuffer(const RawBuffer &buffer, bool allow_overwrite) {
+    const int16_t *data = reinterpret_cast<const int16_t *>(buffer.data());
+    samples.insert(samples.end(), data, data+buffer.bytesLen()/sizeof(int16_t));
+  }
+
+public:
+  double rate;
+  size_t channels;
+  std::vector<int16_t> samples;
+};
+
+
+/** Solves the linear system A x = b (in place) by Gaussian elimination with pivoting. */
+static bool
+solve(std::vector< std::vector<double> > &A, std::vector<double> &b) {
+  size_t n = b.size();
+  for (size_t c=0; c<n; c++) {
+    size_t p = c;
+    for (size_t r=c+1; r<n; r++) { if (std::abs(A[r][c]) > std::abs(A[p][c])) { p = r; } }
+    if (0 == A[p][c]) { return false; }
+    std::swap(A[p], A[c]); std::swap(b[p], b[c]);
+    for (size_t r=c+1; r<n; r++) {
+      double f = A[r][c]/A[c][c];
+      for (size_t k=c; k<n; k++) { A[r][k] -= f*A[c][k]; }
+      b[r] -= f*b[c];
+    }
+  }
+  for (size_t c=n; c-- > 0;) {
+    for (size_t k=c+1; k<n; k++) { b[c] -= A[c][k]*b[k]; }
+    b[c] /= A[c][c];
+  }
+  return true;
+}
+
+/** Returns the SNR in dB of a channel of the demodulated audio w.r.t. the golden audio. The
+ * delay is found by cross correlation. Then a short filter and an offset get fitted from the
+ * golden to the demodulated audio, hence gain, fractional delays and the ripple of filters are
+ * not counted as noise. The first @c skip frames are ignored. */
+static double
+snr(const std::vector<int16_t> &out, const std::vector<int16_t> &golden, size_t channels,
+    size_t channel, size_t skip, size_t max_lag)
+{
+  size_t n = std::min(out.size(), golden.size())/channels;
+  std::vector<double> x(n), g(n);
+  for (size_t i=0; i<n; i++) { x[i] = out[i*channels+channel]; g[i] = golden[i*channels+channel]; }
+
+  // x[i] ~ g[i-delay], the range of i is restricted such that all taps are valid
+  const int half = FitTaps/2;
+  int best = 0; double best_corr = -1;
+  for (int d=-int(max_lag); d<=int(max_lag); d++) {
+    int lo = std::max(int(skip), d+half), hi = std::min(int(n), int(n)+d-half);
+    double c = 0;
+    for (int i=lo; i<hi; i++) { c += x[i]*g[i-d]; }
+    if (std::abs(c) > best_corr) { best_corr = std::abs(c); best = d; }
+  }
+  int lo = std::max(int(skip), best+half+1), hi = std::min(int(n), int(n)+best-half-1);
+  if (hi-lo < 100) { return -100; }
+
+  // Least squares fit of offset and filter taps
+  const size_t M = FitTaps+1;
+  std::vector< std::vector<double> > A(M, std::vector<double>(M, 0));
+  std::vector<double> b(M, 0), v(M);
+  for (int i=lo; i<hi; i++) {
+    v[0] = 1;
+    for (int k=-half; k<=half; k++) { v[k+half+1] = g[i-best+k]; }
+    for (size_t r=0; r<M; r++) {
+      b[r] += v[r]*x[i];
+      for (size_t c=0; c<M; c++) { A[r][c] += v[r]*v[c]; }
+    }
+  }
+  if (! solve(A, b)) { return -100; }
+  double signal = 0, noise = 0;
+  for (int i=lo; i<hi; i++) {
+    double y = 0;
+    for (int k=-half; k<=half; k++) { y += b[k+half+1]*g[i-best+k]; }
+    signal += y*y; noise += (x[i]-b[0]-y)*(x[i]-b[0]-y);
+  }
+  if (0 == noise) { return 300; }
+  if (0 == signal) { return -100; }
+  return 10*std::log10(signal/noise);
+}
+
+
+static bool
+check(bool ok, const std::string &name) {
+  std::cerr << (ok ? "PASS " : "FAIL ") << name << std::endl;
+  return ok;
+}
+
+
+/** Result of running a fixture. */
+typedef struct {
+  Capture audio;
+  QString text;
+  double cpu;
+} Result;
+
+/** Runs the recording through a demodulator. */
+static bool
+run(Player &player, const Fixture &fixture, const std::vector<int16_t> &iq, double rate,
+    Result &result)
+{
+  LatencyMonitor monitor;
+  DemodulatorCtrl ctrl;
+  // Plain chain: Fixed gain, no noise blanker, VFO at the center of the recording
+  ctrl.enableAGC(false);
+  ctrl.setGain(0);
+  ctrl.enableNoiseBlanker(false);
+  ctrl.setCenterFreq(0);
+  ctrl.setDemod(fixture.demod);
+  ctrl.connectLatencyProbes(&monitor);
+  ctrl.audioSource()->connect(&result.audio, true);
+
+  player.connect(&monitor, true);
+  player.connect(ctrl.in(), true);
+  player.play(&iq, rate);
+  Queue::get().start();
+  Queue::get().wait();
+  player.disconnect(ctrl.in());
+  player.disconnect(&monitor);
+
+  result.cpu = monitor.cpuLoad();
+  if (DemodulatorCtrl::DEMOD_BPSK31 == fixture.demod) {
+    BPSK31Demodulator *bpsk = dynamic_cast<BPSK31Demodulator *>(ctrl.demod());
+    if (bpsk) { bpsk->takeText(result.text); }
+  }
+  ctrl.audioSource()->disconnect(&result.audio);
+  return true;
+}
+
+
+int main(int argc, char *argv[]) {
+  if (2 > argc) {
+    std::cerr << "Usage: " << argv[0] << " DATADIR [--update]" << std::endl;
+    return 1;
+  }
+  QCoreApplication app(argc, argv);
+  std::string dir = argv[1];
+  bool update = (3 <= argc) && (std::string("--update") == argv[2]);
+  Logger::get().addHandler(new StreamLogHandler(std::cerr, LOG_WARNING));
+
+  // Do not touch the settings of the user, start from the defaults
+  QTemporaryDir settings;
+  QSettings::setPath(QSettings::NativeFormat, QSettings::UserScope, settings.path());
+  QSettings::setPath(QSettings::IniFormat, QSettings::UserScope, settings.path());
+
+  // Read baseline: lines of "name cpu", comments start with '#'
+  std::map<std::string, double> baseline;
+  std::ifstream baseline_file((dir+"/baseline.txt").c_str());
+  std::string line;
+  while (std::getline(baseline_file, line)) {
+    if (line.empty() || ('#' == line[0])) { continue; }
+    std::istringstream items(line);
+    std::string name; double cpu;
+    if (items >> name >> cpu) { baseline[name] = cpu; }
+  }
+  // Without a baseline, the golden outputs are placeholders too
+  bool unmeasured = (! update) && baseline.empty();
+  if (unmeasured) {
+    std::cerr << "SKIP: " << dir << "/baseline.txt holds no measurements, the golden outputs are "
+              << "the ideal signals of generate.py. Run \"" << argv[0] << " " << dir
+              << " --update\" with an optimized build and verify the results first." << std::endl;
+  }
+
+  Player player;
+  bool ok = true;
+  std::map<std::string, double> measured;
+  for (size_t f=0; f<num_fixtures; f++) {
+    const Fixture &fixture = fixtures[f];
+    std::string name = fixture.name, path = dir + "/" + name;
+    double rate; size_t channels;
+    std::vector<int16_t> iq;
+    if ((! read_wav(path+".wav", rate, channels, iq)) || (2 != channels)) {
+      ok &= check(false, name + ": read I/Q recording " + path + ".wav");
+      continue;
+    }
+
+    Result result;
+    run(player, fixture, iq, rate, result);
+    measured[name] = result.cpu;
+    std::cerr << name << ": " << result.audio.samples.size()/result.audio.channels
+              << " frames at " << result.audio.rate << "Hz, cpu " << result.cpu
+              << "ms per s of input" << std::endl;
+
+    if (update) {
+      if (DemodulatorCtrl::DEMOD_BPSK31 == fixture.demod) {
+        std::ofstream text((path+".golden.txt").c_str());
+        text << result.text.toStdString();
+      } else {
+        WavWriter writer;
+        ok &= check(writer.open(path+".golden.wav", WavWriter::PCM16, uint32_t(result.audio.rate),
+                                result.audio.channels) &&
+                    writer.write(&result.audio.samples[0],
+                                 result.audio.samples.size()/result.audio.channels),
+                    name + ": write golden output");
+        writer.close();
+      }
+      continue;
+    }
+    if (unmeasured) { continue; }
+
+    // Compare output
+    if (DemodulatorCtrl::DEMOD_BPSK31 == fixture.demod) {
+      std::ifstream file((path+".golden.txt").c_str());
+      std::stringstream golden; golden << file.rdbuf();
+      std::cerr << name << ": text \"" << result.text.toStdString() << "\"" << std::endl;
+      ok &= check(golden.str() == result.text.toStdString(), name + ": text equals golden text");
+    } else {
+      double golden_rate; size_t golden_channels;
+      std::vector<int16_t> golden;
+      if (! read_wav(path+".golden.wav", golden_rate, golden_channels, golden)) {
+        ok &= check(false, name + ": read golden output");
+        continue;
+      }
+      const Capture &audio = result.audio;
+      bool format = check((golden_rate == audio.rate) && (golden_channels == audio.channels),
+                          name + ": audio format equals golden format");
+      ok &= format;
+      if (! format) { continue; }
+      // The output may miss a partial buffer at the end
+      size_t frames = audio.samples.size()/audio.channels;
+      ok &= check(frames + MaxDelay*audio.rate >= golden.size()/golden_channels,
+                  name + ": audio length");
+      for (size_t c=0; c<audio.channels; c++) {
+        double s = snr(audio.samples, golden, audio.channels, c, size_t(fixture.settle*audio.rate),
+                       size_t(MaxDelay*audio.rate));
+        std::stringstream label;
+        label << name << ": channel " << c << " SNR " << s << "dB >= " << fixture.snr << "dB";
+        ok &= check(s >= fixture.snr, label.str());
+      }
+    }
+
+    // Compare CPU time, only meaningful for optimized builds
+    if (! baseline.count(name)) {
+      ok &= check(false, name + ": baseline CPU time");
+      continue;
+    }
+    std::stringstream label;
+    label << name << ": cpu " << result.cpu << "ms <= " << CPUTolerance << " x baseline "
+          << baseline[name] << "ms";
+#ifdef __OPTIMIZE__
+    ok &= check(result.cpu <= CPUTolerance*baseline[name], label.str());
+#else
+    std::cerr << "SKIP " << label.str() << " (unoptimized build)" << std::endl;
+#endif
+  }
+
+  if (update) {
+    std::ofstream file((dir+"/baseline.txt").c_str());
+    file << "# CPU time of the processing thread in ms per second of input." << std::endl
+         << "# Updated by \"sdr-rx-demodtest DATADIR --update\" with an optimized build."
+         << std::endl;
+    std::map<std::string, double>::iterator item = measured.begin();
+    for (; item!=measured.end(); item++) {
+      file << item->first << " " << item->second << std::endl;
+    }
+  }
+
+  if (! ok) { return 1; }
+  return unmeasured ? Unmeasured : 0;
+}
@@ -0,0 +1,150 @@
+/* Accuracy tests of the fast FM discriminator (FastFMDemod) against an exact atan2 discriminator
+ * and the libsdr FMDemod it replaces. Returns 0 if all tests pass. */
+#include "fmdemod.hh"
+#include "demod.hh"
+#include "logger.hh"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace sdr;
+
+
+/** Sample rate of the synthetic FM signal. */
+static const double Fs = 240e3;
+/** Configured buffer size. */
+static const size_t BufferSize = 1024;
+
+
+/** Collects the demodulated samples. */
+class Capture: public Sink<int16_t>
+{
+public:
+  Capture() : Sink<int16_t>(), samples() { }
+
+  virtual void config(const Config &src_cfg) {
+    // pass...
+  }
+
+  virtual void process(const Buffer<int16_t> &buffer, bool allow_overwrite) {
+    for (size_t i=0; i<buffer.size(); i++) { samples.push_back(buffer[i]); }
+  }
+
+public:
+  std::vector<int16_t> samples;
+};
+
+
+/** Generates N samples of a FM signal modulated by two tones with a total deviation of 75kHz.
+ * The amplitude varies slowly, such that the discriminator sees weak and strong samples. */
+static void
+fm_signal(std::vector< std::complex<int16_t> > &signal, size_t N) {
+  signal.resize(N);
+  double phase = 0;
+  for (size_t i=0; i<N; i++) {
+    double t = i/Fs;
+    double f = 50e3*std::sin(2*M_PI*1e3*t) + 25e3*std::sin(2*M_PI*6.3e3*t+0.3);
+    double a = 16000*(0.55 + 0.45*std::cos(2*M_PI*3.0*t));
+    signal[i] = std::complex<int16_t>(int16_t(std::round(a*std::cos(phase))),
+                                      int16_t(std::round(a*std::sin(phase))));
+    phase += 2*M_PI*f/Fs;
+  }
+}
+
+/** Exact discriminator, a phase difference of pi maps to 32767. */
+static void
+exact_demod(const std::vector< std::complex<int16_t> > &signal, std::vector<double> &out) {
+  out.resize(signal.size());
+  std::complex<double> last(0,0);
+  for (size_t i=0; i<signal.size(); i++) {
+    std::complex<double> z(signal[i].real(), signal[i].imag());
+    out[i] = (32767/M_PI)*std::arg(z*std::conj(last));
+    last = z;
+  }
+}
+
+/** Runs the signal through the given node in buffers of @c M samples. */
+static void
+run(SinkBase &node, const std::vector< std::complex<int16_t> > &signal, size_t M,
+    bool allow_overwrite)
+{
+  Buffer< std::complex<int16_t> > buffer(M);
+  for (size_t offset=0; offset<signal.size(); offset+=M) {
+    size_t n = std::min(M, signal.size()-offset);
+    for (size_t i=0; i<n; i++) { buffer[i] = signal[offset+i]; }
+    node.handleBuffer(buffer.head(n), allow_overwrite);
+  }
+  buffer.unref();
+}
+
+static bool
+check(bool ok, const char *name) {
+  std::cerr << (ok ? "PASS " : "FAIL ") << name << std::endl;
+  return ok;
+}
+
+
+int main(int argc, char *argv[]) {
+  Logger::get().addHandler(new StreamLogHandler(std::cerr, LOG_WARNING));
+  Config cfg(Config::Type_cs16, Fs, BufferSize, 1);
+  bool ok = true;
+
+  std::vector< std::complex<int16_t> > signal;
+  fm_signal(signal, 64*BufferSize);
+  std::vector<double> exact;
+  exact_demod(signal, exact);
+
+  // Reference: libsdr FMDemod
+  FMDemod<int16_t> ref_demod; Capture ref;
+  ref_demod.connect(&ref, true); ref_demod.config(cfg);
+  run(ref_demod, signal, BufferSize, false);
+
+  // FastFMDemod using its own output buffer
+  FastFMDemod fast_demod; Capture fast;
+  fast_demod.connect(&fast, true); fast_demod.config(cfg);
+  run(fast_demod, signal, BufferSize, false);
+
+  ok &= check(fast.samples.size() == signal.size(), "fast: output length");
+  ok &= check(ref.samples.size() == signal.size(), "libsdr: output length");
+  if (! ok) { return 1; }
+
+  // Error bound w.r.t. the exact discriminator (documented as 3 LSB), the first sample depends
+  // on the initial state
+  double max_err = 0, fast_err2 = 0, ref_err2 = 0, fr = 0, rr = 0, ee = 0;
+  for (size_t i=1; i<signal.size(); i++) {
+    max_err = std::max(max_err, std::abs(fast.samples[i]-exact[i]));
+    fast_err2 += (fast.samples[i]-exact[i])*(fast.samples[i]-exact[i]);
+    ref_err2 += (ref.samples[i]-exact[i])*(ref.samples[i]-exact[i]);
+    fr += double(fast.samples[i])*ref.samples[i]; rr += double(ref.samples[i])*ref.samples[i];
+    ee += exact[i]*exact[i];
+  }
+  std::cerr << "max. error: " << max_err << " LSB, SNR fast: "
+            << 10*std::log10(ee/fast_err2) << "dB, SNR libsdr: "
+            << 10*std::log10(ee/ref_err2) << "dB" << std::endl;
+  ok &= check(max_err <= 3, "fast: max. error <= 3 LSB");
+  // Not less accurate than the replaced implementation
+  ok &= check(fast_err2 <= ref_err2, "fast: error <= libsdr error");
+  // Same scaling as the replaced implementation, least-squares gain w.r.t. libsdr output
+  double gain = fr/rr;
+  std::cerr << "gain w.r.t. libsdr: " << gain << std::endl;
+  ok &= check(std::abs(gain-1) < 0.02, "fast: scaling matches libsdr within 2%");
+
+  // In-place demodulation yields the same result
+  FastFMDemod inplace_demod; Capture inplace;
+  inplace_demod.connect(&inplace, true); inplace_demod.config(cfg);
+  run(inplace_demod, signal, BufferSize, true);
+  ok &= check(inplace.samples == fast.samples, "fast: in-place equals out-of-place");
+
+  // Buffers larger than configured are processed completely and continue the phase of the
+  // previous buffer, in both paths
+  for (int overwrite=0; overwrite<2; overwrite++) {
+    FastFMDemod large_demod; Capture large;
+    large_demod.connect(&large, true); large_demod.config(cfg);
+    run(large_demod, signal, 3*BufferSize+17, bool(overwrite));
+    ok &= check(large.samples == fast.samples,
+                overwrite ? "fast: oversized buffers in-place" : "fast: oversized buffers");
+  }
+
+  return ok ? 0 : 1;
+}